@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "stats.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static uint8_t* base = NULL;
+static size_t capacity = 0;
+static size_t used = 0;
+static int sealed = 0;
+
+
+#ifdef __GLIBC__
+// glibc's own entry points; defining malloc here routes every allocation in
+// the process, libc's internal ones included, through the counter
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+    if (__atomic_load_n(&sealed, __ATOMIC_RELAXED)) {
+        stats_add(STAT_HEAP_ALLOCS, 1);
+    }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    if (__atomic_load_n(&sealed, __ATOMIC_RELAXED)) {
+        stats_add(STAT_HEAP_ALLOCS, 1);
+    }
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+    if (__atomic_load_n(&sealed, __ATOMIC_RELAXED)) {
+        stats_add(STAT_HEAP_ALLOCS, 1);
+    }
+    return __libc_realloc(p, size);
+}
+#endif
+
+
+// ============================================================================
+
+
+//// map the arena and fault it in, so its pages count in RSS from the start
+int arena_init(size_t size) {
+    void* p;
+
+    size = (size + 4095) & ~(size_t)4095;
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (p == MAP_FAILED) {
+        log2file("arena of %zu KiB: %s\n", size / 1024, strerror(errno));
+        return -1;
+    }
+    base = p;
+    capacity = size;
+    used = 0;
+    return 0;
+}
+
+//// size bytes for good, ARENA_ALIGN aligned; NULL once the arena is full
+void* arena_alloc(size_t size) {
+    void* p;
+
+    if (base == NULL) {
+        return malloc(size);
+    }
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size > capacity - used) {
+        log2file("arena full, %zu of %zu bytes used, raise arena_kb\n", used, capacity);
+        return NULL;
+    }
+    p = base + used;
+    used += size;
+    return p;
+}
+
+size_t arena_used() {
+    return used;
+}
+
+//// startup is over, count heap allocations from now on
+void arena_seal() {
+    log_msg(LOGLVL_INFO, "arena: %zu of %zu bytes used at startup\n", used, capacity);
+    __atomic_store_n(&sealed, 1, __ATOMIC_RELAXED);
+}
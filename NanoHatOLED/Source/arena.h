@@ -0,0 +1,30 @@
+#ifndef __ARENA__H__
+#define __ARENA__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Runtime memory. What the daemon allocates after it has read its config
+ * comes out of one arena of arena_kb, mapped and faulted in at startup; the
+ * allocator bumps a pointer and nothing goes back, so a module carves what
+ * it needs once and reuses it for the daemon's lifetime. Everything else
+ * is static or lives in the shared segments.
+ *
+ * arena_seal() marks the end of startup. From then on every malloc, calloc
+ * and realloc in the process is counted ("heap_allocs" on the stats socket),
+ * which stays at zero in steady state; an embedded view's interpreter is
+ * the exception, its allocations count too. Before arena_init (the bench,
+ * the tools) arena_alloc is plain malloc.
+ */
+
+#define ARENA_KB        64
+#define ARENA_ALIGN     16
+
+extern int    arena_init(size_t size);
+extern void*  arena_alloc(size_t size);
+extern size_t arena_used();
+extern void   arena_seal();
+
+
+#endif
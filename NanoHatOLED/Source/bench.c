@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "gpio.h"
+#include "gesture.h"
+#include "evring.h"
+#include "loop.h"
+#include "timer.h"
+#include "fb.h"
+#include "draw.h"
+#include "render.h"
+#include "ssd1306.h"
+#include "logger.h"
+
+/*
+ * NanoHatOLED-bench: drives the daemon's key-to-pixel path with synthetic
+ * edges from a mock gpio backend and a mock i2c sink, and reports latency
+ * per stage and frame cost per screen.
+ *
+ * A press goes the way it does in the daemon: the event goes into an event
+ * ring, a view process forked off the bench reads it like nanohat/events.py
+ * and sends the new screen to a draw socket, and the commit is flushed by
+ * the render writer thread to the mock panel. The view waits for the
+ * panel's frame counter before it reports the press done.
+ *
+ *   edge       edge timestamp to the event in the ring (epoll, gpio read,
+ *              gesture engine)
+ *   ring       to the view reading it (eventfd wakeup, ring read)
+ *   view       the view building its draw datagram
+ *   render     to the first I2C transfer (socket send and receive, draw
+ *              commands, commit, writer wakeup, page diff)
+ *   flush      first to last I2C transfer of the frame
+ *   total      edge timestamp to the last transfer
+ *
+ * The frames part draws the screens straight into a framebuffer and flushes
+ * it on the bench's thread, for the cost of a frame alone. The screens are
+ * the draw commands the system monitor sends. Bus time is not spent, it is
+ * estimated from the bytes sent unless -s is given.
+ */
+
+
+// ============================================================================
+
+
+#define BENCH_SCREENS   4
+#define BENCH_RING      "/nanohat-oled-bench-events"
+#define BENCH_FB        "/nanohat-oled-bench-fb"
+#define BENCH_DRAW      "/tmp/nanohat-oled-bench-draw.sock"
+#define BENCH_STAGES    6
+
+//// one press, in a mapping shared with the view process
+struct press {
+    uint64_t    edge;           /* the edge's timestamp */
+    uint64_t    pushed;         /* KEY_DOWN went into the ring */
+    uint64_t    received;       /* the view read it */
+    uint64_t    sent;           /* the view is sending its draw datagram */
+    uint64_t    xfer_first;     /* first I2C transfer of the frame began */
+    uint64_t    xfer_last;      /* last one ended */
+};
+
+static int bench_khz = I2C_DEFAULT_KHZ;
+static int simulate_bus = 0;
+
+static struct press* log_ = NULL;
+static int npressed = 0;
+static int pressing = -1;       /* press whose frame the writer sends, -1 none */
+static const char* stage_names[] = { "edge", "ring", "view", "render", "flush", "total" };
+
+
+// ============================================================================
+// mock gpio backend: events are queued by the bench, an eventfd wakes the loop
+
+
+static struct gpio_event queued[GPIO_EVENT_BATCH];
+static int nqueued = 0;
+
+static int mock_open(struct gpio_bank* bank) {
+    bank->fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (bank->fds[0] < 0) {
+        return -1;
+    }
+    bank->nfds = 1;
+    return 0;
+}
+
+static int mock_read(struct gpio_bank* bank, int fd, struct gpio_event* ev, int max) {
+    uint64_t count;
+    int n = nqueued < max ? nqueued : max;
+
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        return -1;
+    }
+    memcpy(ev, queued, n * sizeof(*ev));
+    memmove(queued, queued + n, (nqueued - n) * sizeof(*ev));
+    nqueued -= n;
+    return n;
+}
+
+static void mock_close(struct gpio_bank* bank) {
+    if (bank->nfds) {
+        close(bank->fds[0]);
+        bank->nfds = 0;
+    }
+}
+
+static const struct gpio_backend mock_backend = {
+    "mock", mock_open, mock_read, mock_close
+};
+
+static struct gpio_bank keys = {
+    &mock_backend, NULL, { 0, 2, 3 }, 3, GPIO_EDGE_BOTH
+};
+static struct loop_source key_source;
+
+static void inject(int key, int edge) {
+    uint64_t one = 1;
+
+    queued[nqueued].key = key;
+    queued[nqueued].edge = edge;
+    queued[nqueued].timestamp_ns = clock_ns(CLOCK_MONOTONIC);
+    queued[nqueued].seqno = ++keys.seqno;
+    nqueued++;
+    if (write(keys.fds[0], &one, sizeof(one)) < 0) {
+        perror("eventfd");
+    }
+}
+
+
+// ============================================================================
+// mock i2c sink
+
+
+//// runs on the render writer thread for the presses, on the bench thread for
+//// the frames part; a press gets the time of its first and last transfer
+static int mock_xfer(struct i2c_bus* bus, struct i2c_msg* msgs, int n) {
+    int current = __atomic_load_n(&pressing, __ATOMIC_ACQUIRE);
+    struct timespec ts;
+    uint64_t bytes = 0, ns;
+    int i;
+
+    if (current >= 0 && log_[current].xfer_first == 0) {
+        log_[current].xfer_first = clock_ns(CLOCK_MONOTONIC);
+    }
+    if (simulate_bus) {
+        for (i = 0; i < n; i++) {
+            bytes += msgs[i].len + 1;   // payload plus the address byte
+        }
+        ns = bytes * 9 * 1000000ull / bench_khz;
+        ts.tv_sec = ns / NSEC_PER_SEC;
+        ts.tv_nsec = ns % NSEC_PER_SEC;
+        nanosleep(&ts, NULL);
+    }
+    if (current >= 0) {
+        log_[current].xfer_last = clock_ns(CLOCK_MONOTONIC);
+    }
+    return 0;
+}
+
+static void mock_panel(struct ssd1306* panel) {
+    memset(panel, 0, sizeof(*panel));
+    panel->bus.fd = -1;
+    panel->bus.nr = -1;
+    panel->bus.addr = SSD1306_ADDR_PRIMARY;
+    panel->bus.max_msg = I2C_BUF_SIZE;
+    panel->bus.clock_khz = bench_khz;
+    panel->bus.xfer = mock_xfer;
+    panel->addr = SSD1306_ADDR_PRIMARY;
+}
+
+
+// ============================================================================
+// the monitor's screens as draw commands, frame varies the live values
+
+
+static int put_text(uint8_t* p, int x, int y, const char* text) {
+    int len = strlen(text);
+
+    p[0] = DRAW_TEXT;
+    p[1] = x; p[2] = x >> 8;
+    p[3] = y; p[4] = y >> 8;
+    p[5] = 8; p[6] = FB_WHITE; p[7] = len;
+    memcpy(p + 8, text, len);
+    return 8 + len;
+}
+
+static int build_screen(uint8_t* p, int screen, int frame) {
+    char s[32];
+    int n = 0;
+
+    p[n++] = DRAW_CLEAR;
+    p[n++] = FB_BLACK;
+    switch (screen) {
+    case 0:
+        n += put_text(p + n, 0, 0, "Wed, Oct 14 2026");
+        snprintf(s, sizeof(s), "%02d:%02d:%02d", 12 + frame / 3600 % 12,
+                frame / 60 % 60, frame % 60);
+        n += put_text(p + n, 0, 20, s);
+        n += put_text(p + n, 0, 40, "TZ: Nairobi");
+        break;
+    case 1:
+        snprintf(s, sizeof(s), "CPU: %d.%d%%", frame * 7 % 100, frame % 10);
+        n += put_text(p + n, 0, 0, s);
+        snprintf(s, sizeof(s), "RAM: %d.%d%%", 40 + frame % 3, frame % 10);
+        n += put_text(p + n, 0, 12, s);
+        n += put_text(p + n, 0, 24, "     201MB/491MB");
+        n += put_text(p + n, 0, 36, "Disk: 31.2%");
+        n += put_text(p + n, 0, 48, "      4GB/14GB");
+        break;
+    case 2:
+        n += put_text(p + n, 0, 0, "Network Info");
+        n += put_text(p + n, 0, 12, "IP: 192.168.1.23");
+        snprintf(s, sizeof(s), "TX: %dMB", 120 + frame / 30);
+        n += put_text(p + n, 0, 24, s);
+        snprintf(s, sizeof(s), "RX: %dMB", 800 + frame / 10);
+        n += put_text(p + n, 0, 36, s);
+        break;
+    default:
+        n += put_text(p + n, 0, 0, "Temperature");
+        snprintf(s, sizeof(s), "CPU: %d.%dC", 45 + frame / 20 % 10, frame % 10);
+        n += put_text(p + n, 0, 20, s);
+        n += put_text(p + n, 0, 40, "Status: COOL");
+        break;
+    }
+    p[n++] = DRAW_COMMIT;
+    return n;
+}
+
+
+// ============================================================================
+
+
+static struct ssd1306 panel;
+static struct fb frame;
+static struct loop_source done_source = { -1, NULL, NULL };
+
+static void keys_ready(struct loop_source* src, uint32_t events) {
+    struct gpio_event gev[GPIO_EVENT_BATCH];
+    int j, count;
+
+    count = gpio_read_events(src->ctx, src->fd, gev, GPIO_EVENT_BATCH);
+    for (j = 0; j < count; j++) {
+        gesture_edge(&gev[j]);
+    }
+}
+
+//// the daemon's part: every event goes to the ring, a release ends a press
+static void on_gesture(int key, int kind, uint64_t timestamp_ns, uint32_t value) {
+    if (kind == EVRING_KEY_DOWN) {
+        log_[npressed].edge = timestamp_ns;
+        log_[npressed].pushed = clock_ns(CLOCK_MONOTONIC);
+        __atomic_store_n(&pressing, npressed, __ATOMIC_RELEASE);
+        npressed++;
+    }
+    evring_push(key, kind, timestamp_ns, value);
+    if (kind != EVRING_KEY_DOWN) {
+        loop_stop();
+    }
+}
+
+//// the view said its frame went out
+static void view_done(struct loop_source* src, uint32_t events) {
+    uint64_t n;
+
+    if (read(src->fd, &n, sizeof(n)) > 0) {
+        loop_stop();
+    }
+}
+
+static void* map_shm(const char* name, size_t bytes) {
+    int fd = shm_open(name, O_RDWR, 0);
+    void* p;
+
+    if (fd < 0) {
+        return NULL;
+    }
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+//// the view process: reads the ring, sends the next screen on F1 and waits
+//// for the panel's frame counter to move, then tells the bench
+static void view_main(int efd, int done_fd) {
+    size_t bytes = sizeof(struct evring_header) + EVRING_SIZE * sizeof(struct evring_entry);
+    struct evring_header* ring = map_shm(BENCH_RING, bytes);
+    struct render_shm* fb = map_shm(BENCH_FB, sizeof(struct render_shm));
+    uint8_t pkt[DRAW_MAX_PACKET];
+    struct sockaddr_un addr;
+    struct pollfd pfd = { efd, POLLIN, 0 };
+    const struct evring_entry* e;
+    uint32_t head, tail, frames;
+    uint64_t one = 1, n, now;
+    int sock, screen = 0, i = 0, len;
+
+    sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (ring == NULL || fb == NULL || sock < 0) {
+        _exit(1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, BENCH_DRAW, sizeof(addr.sun_path) - 1);
+    ring->wants = 0;
+    __atomic_store_n(&ring->consumer_pid, getpid(), __ATOMIC_RELEASE);
+    if (write(done_fd, &one, sizeof(one)) < 0) {
+        _exit(1);
+    }
+
+    for (;;) {
+        if (poll(&pfd, 1, -1) < 0 || read(efd, &n, sizeof(n)) < 0) {
+            continue;
+        }
+        now = clock_ns(CLOCK_MONOTONIC);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for (tail = ring->tail; tail != head; tail++) {
+            e = &ring->entries[tail & (ring->size - 1)];
+            if (e->kind != EVRING_KEY_DOWN) {
+                continue;
+            }
+            log_[i].received = now;
+            frames = __atomic_load_n(&fb->frames, __ATOMIC_ACQUIRE);
+            screen = (screen + 1) % BENCH_SCREENS;
+            len = build_screen(pkt, screen, i);
+            // the daemon may be done flushing before sendto returns
+            log_[i].sent = clock_ns(CLOCK_MONOTONIC);
+            sendto(sock, pkt, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+            while (__atomic_load_n(&fb->frames, __ATOMIC_ACQUIRE) == frames) {
+                sched_yield();
+            }
+            i++;
+            if (write(done_fd, &one, sizeof(one)) < 0) {
+                _exit(1);
+            }
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report_stage(const char* name, uint64_t* v, int n) {
+    qsort(v, n, sizeof(*v), cmp_u64);
+    printf("  %-8s p50 %8.1f us   p99 %8.1f us   max %8.1f us\n", name,
+            v[n / 2] / 1000.0, v[n * 99 / 100] / 1000.0, v[n - 1] / 1000.0);
+}
+
+//// draw frames of one screen back to back with the live values changing
+static void bench_screen(int s, int frames) {
+    uint8_t pkt[DRAW_MAX_PACKET];
+    unsigned int bytes0, tx0;
+    uint64_t t0, t;
+    double per_frame;
+    int i, len;
+
+    fb_clear(&frame, FB_BLACK);
+    len = build_screen(pkt, s, 0);
+    draw_exec(&frame, pkt, len);
+    ssd1306_flush(&panel, &frame);
+
+    bytes0 = panel.bus.bytes;
+    tx0 = panel.bus.transactions;
+    t0 = clock_ns(CLOCK_MONOTONIC);
+    for (i = 1; i <= frames; i++) {
+        len = build_screen(pkt, s, i);
+        draw_exec(&frame, pkt, len);
+        ssd1306_flush(&panel, &frame);
+    }
+    t = clock_ns(CLOCK_MONOTONIC) - t0;
+
+    per_frame = (double)(panel.bus.bytes - bytes0) / frames;
+    printf("  screen %d  %9.0f fps cpu   %6.1f bytes/frame   %4.2f ioctl/frame"
+            "   %5.2f ms bus/frame at %d kHz\n", s,
+            frames * 1e9 / t, per_frame, (double)(panel.bus.transactions - tx0) / frames,
+            per_frame * 9 / bench_khz, bench_khz);
+}
+
+
+// ============================================================================
+
+
+int main(int argc, char* argv[]) {
+    struct gesture_config cfg[3];
+    struct pollfd pfd = { -1, POLLIN, 0 };
+    uint64_t* stages[BENCH_STAGES];
+    uint64_t n;
+    int presses = 1000, frames = 1000;
+    pid_t view;
+    int i, opt;
+
+    while ((opt = getopt(argc, argv, "n:f:k:s")) != -1) {
+        switch (opt) {
+        case 'n':
+            presses = atoi(optarg);
+            break;
+        case 'f':
+            frames = atoi(optarg);
+            break;
+        case 'k':
+            bench_khz = atoi(optarg);
+            break;
+        case 's':
+            simulate_bus = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n presses] [-f frames] [-k khz] [-s]\n", argv[0]);
+            exit(2);
+        }
+    }
+    if (presses < 1 || frames < 1 || bench_khz < 1) {
+        exit(2);
+    }
+    log_set_level(LOGLVL_WARN);
+
+    // leading-edge debouncing adds nothing to a press, so only the engine's
+    // own cost is measured; long/double timers stay off
+    for (i = 0; i < 3; i++) {
+        cfg[i].debounce_ms = 0;
+        cfg[i].long_ms = 0;
+        cfg[i].repeat_ms = 0;
+        cfg[i].double_ms = 0;
+    }
+    log_ = mmap(NULL, presses * sizeof(*log_), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    for (i = 0; i < BENCH_STAGES; i++) {
+        stages[i] = calloc(presses, sizeof(uint64_t));
+    }
+    mock_panel(&panel);
+    fb_clear(&frame, FB_BLACK);
+    ssd1306_flush(&panel, &frame);
+
+    done_source.fd = eventfd(0, EFD_CLOEXEC);
+    if (log_ == MAP_FAILED || done_source.fd < 0 || loop_init() != 0 ||
+            gesture_init(cfg, keys.nlines, on_gesture) != 0 || gpio_open(&keys) != 0 ||
+            evring_create(BENCH_RING, EVRING_SIZE) != 0 || render_add(&panel, BENCH_FB) != 0 ||
+            draw_open(BENCH_DRAW) != 0) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+    key_source.fd = keys.fds[0];
+    key_source.handler = keys_ready;
+    key_source.ctx = &keys;
+    loop_add(&key_source, EPOLLIN);
+    done_source.handler = view_done;
+    loop_add(&done_source, EPOLLIN);
+
+    view = fork();
+    if (view == 0) {
+        view_main(evring_eventfd(), done_source.fd);
+    }
+    // the view says once that it is attached
+    pfd.fd = done_source.fd;
+    if (view < 0 || poll(&pfd, 1, 5000) != 1 || read(pfd.fd, &n, sizeof(n)) < 0) {
+        fprintf(stderr, "the view didn't attach\n");
+        return 1;
+    }
+
+    printf("key to pixel, %d presses of F1 (mock gpio, event ring, view process, "
+            "render writer, mock i2c%s)\n", presses, simulate_bus ? " with bus time" : "");
+    for (i = 0; i < presses; i++) {
+        inject(0, GPIO_EDGE_RISING);
+        loop_run();
+        inject(0, GPIO_EDGE_FALLING);
+        loop_run();
+    }
+    __atomic_store_n(&pressing, -1, __ATOMIC_RELEASE);
+    for (i = 0; i < presses; i++) {
+        stages[0][i] = log_[i].pushed - log_[i].edge;
+        stages[1][i] = log_[i].received - log_[i].pushed;
+        stages[2][i] = log_[i].sent - log_[i].received;
+        stages[3][i] = log_[i].xfer_first - log_[i].sent;
+        stages[4][i] = log_[i].xfer_last - log_[i].xfer_first;
+        stages[5][i] = log_[i].xfer_last - log_[i].edge;
+    }
+    for (i = 0; i < BENCH_STAGES; i++) {
+        report_stage(stage_names[i], stages[i], presses);
+    }
+
+    printf("frames, %d per screen\n", frames);
+    for (i = 0; i < BENCH_SCREENS; i++) {
+        bench_screen(i, frames);
+    }
+
+    kill(view, SIGTERM);
+    waitpid(view, NULL, 0);
+    draw_close();
+    render_close();
+    evring_destroy();
+    close(done_source.fd);
+    gpio_close(&keys);
+    gesture_close();
+    loop_close();
+    return 0;
+}
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include "config.h"
+#include "daemonize.h"
+#include "metrics.h"
+#include "history.h"
+#include "power.h"
+#include "arena.h"
+#include "layout.h"
+#include "loop.h"
+#include "timer.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+#define SETTINGS    offsetof(struct config, debounce_ms)
+
+enum { SET_UINT, SET_STRING };
+
+struct setting {
+    const char*     name;
+    int             type;
+    size_t          offset;
+    unsigned int    max;        /* largest value, or the buffer size */
+};
+
+static const struct setting settings[] = {
+    { "long_ms",    SET_UINT,   offsetof(struct config, long_ms),    10000 },
+    { "repeat_ms",  SET_UINT,   offsetof(struct config, repeat_ms),  10000 },
+    { "double_ms",  SET_UINT,   offsetof(struct config, double_ms),  10000 },
+    { "metrics_ms", SET_UINT,   offsetof(struct config, metrics_ms), 3600000 },
+    { "refresh_ms", SET_UINT,   offsetof(struct config, refresh_ms), 3600000 },
+    { "brightness", SET_UINT,   offsetof(struct config, brightness), 255 },
+    { "python",     SET_STRING, offsetof(struct config, python),     sizeof(((struct config*)0)->python) },
+    { "script",     SET_STRING, offsetof(struct config, script),     sizeof(((struct config*)0)->script) },
+    { "ntp_server", SET_STRING, offsetof(struct config, ntp_server), sizeof(((struct config*)0)->ntp_server) },
+    { "timezone",   SET_STRING, offsetof(struct config, timezone),   sizeof(((struct config*)0)->timezone) },
+    { "history_samples", SET_UINT, offsetof(struct config, history_samples), 1 << 20 },
+    { "history_ms", SET_UINT,   offsetof(struct config, history_ms), 86400000 },
+    { "history_batch", SET_UINT, offsetof(struct config, history_batch), HISTORY_BATCH_MAX },
+    { "history_path", SET_STRING, offsetof(struct config, history_path), sizeof(((struct config*)0)->history_path) },
+    { "display_timeout", SET_UINT, offsetof(struct config, display_timeout), 86400 },
+    { "dim_brightness", SET_UINT, offsetof(struct config, dim_brightness), 255 },
+    { "dim_start",  SET_UINT,   offsetof(struct config, dim_start),  23 },
+    { "dim_end",    SET_UINT,   offsetof(struct config, dim_end),    23 },
+    { "arena_kb",   SET_UINT,   offsetof(struct config, arena_kb),   65536 },
+    { "layout_path", SET_STRING, offsetof(struct config, layout_path), sizeof(((struct config*)0)->layout_path) },
+    { "cpu_mask",   SET_UINT,   offsetof(struct config, cpu_mask),   UINT32_MAX },
+    { "rt_priority", SET_UINT,  offsetof(struct config, rt_priority), 99 },
+    { "lock_memory", SET_UINT,  offsetof(struct config, lock_memory), 1 },
+};
+
+static struct config fallback;          /* when the snapshot can't be mapped */
+static struct config* current = &fallback;
+static const char* source_path = NULL;
+static const char* source_base = NULL;
+static config_handler on_change = NULL;
+static struct loop_source watch = { -1, NULL, NULL };
+static struct timer settle = { { -1, NULL, NULL } };
+
+
+static void set_defaults(struct config* cfg) {
+    int i;
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->magic = CONFIG_MAGIC;
+    cfg->version = CONFIG_VERSION;
+    cfg->size = sizeof(*cfg);
+    for (i = 0; i < GESTURE_MAX_KEYS; i++) {
+        cfg->debounce_ms[i] = GESTURE_DEBOUNCE_MS;
+    }
+    cfg->long_ms = GESTURE_LONG_MS;
+    cfg->repeat_ms = GESTURE_REPEAT_MS;
+    cfg->double_ms = GESTURE_DOUBLE_MS;
+    cfg->metrics_ms = METRICS_PERIOD_MS;
+    cfg->refresh_ms = 1000;
+    cfg->brightness = 0xcf;         // what the panel init sequence sets
+    snprintf(cfg->python, sizeof(cfg->python), "%s", PYTHON3_INTERP);
+    snprintf(cfg->script, sizeof(cfg->script), "%s", PYTHON3_SCRIPT);
+    snprintf(cfg->ntp_server, sizeof(cfg->ntp_server), "%s", TIMESYNC_SERVER);
+    snprintf(cfg->timezone, sizeof(cfg->timezone), "UTC");
+    cfg->history_samples = HISTORY_SAMPLES;
+    cfg->history_ms = HISTORY_PERIOD_MS;
+    cfg->history_batch = HISTORY_BATCH;
+    snprintf(cfg->history_path, sizeof(cfg->history_path), "%s", HISTORY_FILE);
+    cfg->dim_brightness = POWER_DIM_BRIGHTNESS;
+    cfg->arena_kb = ARENA_KB;
+    snprintf(cfg->layout_path, sizeof(cfg->layout_path), "%s", LAYOUT_FILE);
+}
+
+//// 20,20,50: the last value repeats for the remaining keys
+static int parse_debounce(const char* arg, struct config* cfg) {
+    unsigned long ms = 0;
+    char* end;
+    int i;
+
+    for (i = 0; i < GESTURE_MAX_KEYS; i++) {
+        if (*arg) {
+            ms = strtoul(arg, &end, 10);
+            if (end == arg || (*end && *end != ',') || ms > 1000) {
+                return -1;
+            }
+            arg = *end ? end + 1 : end;
+        }
+        cfg->debounce_ms[i] = ms;
+    }
+    return 0;
+}
+
+static int parse_setting(const char* name, const char* value, struct config* cfg) {
+    const struct setting* s;
+    unsigned long n;
+    char* end;
+    unsigned int i;
+
+    if (strcmp(name, "debounce_ms") == 0) {
+        return parse_debounce(value, cfg);
+    }
+    for (i = 0; i < sizeof(settings) / sizeof(settings[0]); i++) {
+        s = &settings[i];
+        if (strcmp(name, s->name) != 0) {
+            continue;
+        }
+        if (s->type == SET_STRING) {
+            if (strlen(value) >= s->max) {
+                return -1;
+            }
+            strcpy((char*)cfg + s->offset, value);
+            return 0;
+        }
+        n = strtoul(value, &end, 0);
+        if (end == value || *end || n > s->max) {
+            return -1;
+        }
+        *(uint32_t*)((char*)cfg + s->offset) = n;
+        return 0;
+    }
+    return -1;
+}
+
+static int parse_line(char* line, struct config* cfg) {
+    char name[32], value[64];
+    int ret;
+
+    ret = devtab_entry(line, &cfg->devices);
+    if (ret <= 0) {
+        return ret;
+    }
+    if (sscanf(line, "%31s %63s", name, value) != 2) {
+        return -1;
+    }
+    return parse_setting(name, value, cfg);
+}
+
+
+// ============================================================================
+
+
+//// write cfg as the new snapshot and map it; the old one is marked stale
+static struct config* publish(const struct config* cfg) {
+    char tmp[sizeof(CONFIG_SNAPSHOT) + 8];
+    struct config* map;
+    int fd;
+
+    snprintf(tmp, sizeof(tmp), "%s.new", CONFIG_SNAPSHOT);
+    fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log2file("config snapshot %s: %s\n", tmp, strerror(errno));
+        return NULL;
+    }
+    fchmod(fd, 0644);
+    if (write(fd, cfg, sizeof(*cfg)) != sizeof(*cfg)) {
+        log2file("config snapshot %s: %s\n", tmp, strerror(errno));
+        close(fd);
+        unlink(tmp);
+        return NULL;
+    }
+    map = mmap(NULL, sizeof(*map), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log2file("mmap %s failed: %s\n", tmp, strerror(errno));
+        unlink(tmp);
+        return NULL;
+    }
+    if (rename(tmp, CONFIG_SNAPSHOT) != 0) {
+        log2file("config snapshot %s: %s\n", CONFIG_SNAPSHOT, strerror(errno));
+        munmap(map, sizeof(*map));
+        unlink(tmp);
+        return NULL;
+    }
+    if (current != &fallback) {
+        __atomic_store_n(&current->stale, 1, __ATOMIC_RELEASE);
+    }
+    return map;
+}
+
+//// compile the file again and swap the snapshot if anything changed
+static void reload(struct timer* t, uint64_t expirations) {
+    struct config cfg, prev;
+    struct config* old = current;
+    struct config* map;
+
+    if (config_compile(source_path, &cfg) != 0) {
+        log2file("config %s unreadable, keeping generation %u\n",
+                source_path, old->generation);
+        return;
+    }
+    if (memcmp((char*)&cfg + SETTINGS, (char*)old + SETTINGS, sizeof(cfg) - SETTINGS) == 0) {
+        return;
+    }
+    cfg.generation = old->generation + 1;
+    map = publish(&cfg);
+    if (map == NULL) {
+        // the daemon still switches over, only the views keep the old one
+        if (old == &fallback) {
+            memcpy(&prev, old, sizeof(prev));
+            old = &prev;
+        }
+        memcpy(&fallback, &cfg, sizeof(cfg));
+        map = &fallback;
+    }
+    current = map;
+    log2file("config %s: generation %u\n", source_path, cfg.generation);
+    if (on_change != NULL) {
+        on_change(current, old);
+    }
+    if (old != &fallback && old != &prev) {
+        munmap(old, sizeof(*old));
+    }
+}
+
+//// something in the config file's directory changed
+static void watch_ready(struct loop_source* src, uint32_t events) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event* ev;
+    ssize_t len;
+    char* p;
+    int hit = 0;
+
+    while ((len = read(src->fd, buf, sizeof(buf))) > 0) {
+        for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event*)p;
+            if (ev->len > 0 && strcmp(ev->name, source_base) == 0) {
+                hit = 1;
+            }
+        }
+    }
+    if (hit) {
+        timer_oneshot(&settle, CONFIG_SETTLE_MS * NSEC_PER_MSEC);
+    }
+}
+
+//// editors replace the file rather than write it, so the directory is watched
+static int watch_source(const char* path) {
+    char dir[256];
+    const char* slash = strrchr(path, '/');
+
+    if (slash == NULL) {
+        snprintf(dir, sizeof(dir), ".");
+        source_base = path;
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+        if (dir[0] == '\0') {
+            snprintf(dir, sizeof(dir), "/");
+        }
+        source_base = slash + 1;
+    }
+
+    watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch.fd < 0) {
+        log2file("inotify: %s\n", strerror(errno));
+        return -1;
+    }
+    if (inotify_add_watch(watch.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        log2file("watch %s: %s\n", dir, strerror(errno));
+        close(watch.fd);
+        watch.fd = -1;
+        return -1;
+    }
+    watch.handler = watch_ready;
+    if (timer_init(&settle, CLOCK_MONOTONIC, reload, NULL) != 0 ||
+            loop_add(&watch, EPOLLIN) != 0) {
+        timer_close(&settle);
+        close(watch.fd);
+        watch.fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+
+// ============================================================================
+
+
+//// defaults overlaid with the file's entries, 0 if it could be read; bad
+//// entries are logged and skipped
+int config_compile(const char* path, struct config* cfg) {
+    static char text[CONFIG_TEXT_MAX + 1];    // stdio would allocate a FILE per reload
+    char *line, *next, *p;
+    ssize_t n;
+    size_t len = 0;
+    int fd, lineno = 0;
+
+    set_defaults(cfg);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            log2file("config %s: %s\n", path, strerror(errno));
+        }
+        return -1;
+    }
+    while (len < CONFIG_TEXT_MAX && (n = read(fd, text + len, CONFIG_TEXT_MAX - len)) > 0) {
+        len += n;
+    }
+    close(fd);
+    if (len == CONFIG_TEXT_MAX) {
+        log2file("config %s: only the first %d bytes are read\n", path, CONFIG_TEXT_MAX);
+    }
+    text[len] = '\0';
+
+    for (line = text; *line; line = next) {
+        lineno++;
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        } else {
+            next = line + strlen(line);
+        }
+        if ((p = strchr(line, '#')) != NULL) {
+            *p = '\0';
+        }
+        for (p = line; *p == ' ' || *p == '\t'; p++) {
+        }
+        if (*p == '\0') {
+            continue;
+        }
+        if (parse_line(p, cfg) != 0) {
+            log2file("config %s:%d: bad entry\n", path, lineno);
+        }
+    }
+    return 0;
+}
+
+//// compile path, publish the snapshot and reload on every change to the
+//// file (after loop_init); changed is called on the loop thread
+int config_open(const char* path, config_handler changed) {
+    struct config* map;
+
+    source_path = path;
+    on_change = changed;
+    if (config_compile(path, &fallback) == 0) {
+        log2file("config %s: %d panels, %d key banks\n", path,
+                fallback.devices.npanels, fallback.devices.nbanks);
+    }
+    map = publish(&fallback);
+    if (map != NULL) {
+        current = map;
+        setenv("NANOHAT_CONFIG", CONFIG_SNAPSHOT, 1);
+    }
+    setenv("NANOHAT_CONFIG_FILE", path, 1);
+    if (watch_source(path) != 0) {
+        log2file("config changes need a restart\n");
+        return -1;
+    }
+    return 0;
+}
+
+//// the current snapshot, never NULL
+const struct config* config_get() {
+    return current;
+}
+
+void config_close() {
+    timer_close(&settle);
+    if (watch.fd >= 0) {
+        loop_del(&watch);
+        close(watch.fd);
+        watch.fd = -1;
+    }
+    if (current != &fallback) {
+        munmap(current, sizeof(*current));
+        current = &fallback;
+        unlink(CONFIG_SNAPSHOT);
+    }
+}
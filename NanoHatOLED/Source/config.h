@@ -0,0 +1,98 @@
+#ifndef __CONFIG__H__
+#define __CONFIG__H__
+
+#include <stdint.h>
+#include "gesture.h"
+#include "devtab.h"
+
+/*
+ * One text config file (CONFIG_FILE, -D path) holds the device table and the
+ * settings, one "name value" per line, '#' starts a comment:
+ *
+ *   debounce_ms 20,20,50       per key, the last value repeats
+ *   long_ms     800            repeat_ms, double_ms likewise (0 disables)
+ *   metrics_ms  1000           metrics sample period
+ *   refresh_ms  1000           the view's redraw period
+ *   brightness  207            panel contrast 0-255
+ *   python      python3.8      view interpreter and script, used from the
+ *   script      bakebit_nanohat_oled.py    next view start on
+ *   ntp_server  pool.ntp.org
+ *   timezone    UTC            for the view's clock
+ *   history_path    /run/nanohat-oled-history   metrics history ring file,
+ *   history_samples 1024       its capacity, one sample per history_ms,
+ *   history_ms      10000      written history_batch samples at a time
+ *   history_batch   6
+ *   display_timeout 300        seconds without a key until the panels sleep,
+ *                              0 (the default) keeps them on
+ *   dim_start   22             local hours (timezone) between which the
+ *   dim_end     7              contrast is dim_brightness, equal hours
+ *   dim_brightness  16         never dim
+ *   arena_kb    64             runtime memory, read at startup (arena.h)
+ *   layout_path /etc/nanohat-oled.layout   screens for DRAW_LAYOUT (layout.h)
+ *   cpu_mask    0x1            CPUs, real-time priority and memory locking
+ *   rt_priority 10             of the daemon's threads, read at startup
+ *   lock_memory 1              (rtsched.h), 0 by default
+ *
+ * The daemon compiles it into a fixed layout snapshot, CONFIG_SNAPSHOT,
+ * which it and the views map. An inotify watch recompiles on every change;
+ * the new snapshot is written next to the old one and renamed over it, so a
+ * reader maps either the old or the new one, never a mix. The old snapshot
+ * gets stale set, which is all a reader has to check to know it should map
+ * the file again.
+ *
+ *   0   magic   4   version   8   size   12  generation   16  stale
+ *   64  settings (see struct config)   536 device table
+ */
+
+#define CONFIG_SNAPSHOT     "/dev/shm/nanohat-oled-config"
+#define CONFIG_MAGIC        0x4643484e      /* "NHCF" */
+#define CONFIG_VERSION      6
+#define CONFIG_SETTLE_MS    100     /* editors write in bursts, reload once */
+#define CONFIG_TEXT_MAX     16384   /* of the config file, the rest is ignored */
+
+struct config {
+    uint32_t        magic;
+    uint32_t        version;
+    uint32_t        size;
+    uint32_t        generation;     /* bumped by every reload that changed something */
+    uint32_t        stale;          /* a newer snapshot replaced this one */
+    uint8_t         pad[44];
+
+    uint32_t        debounce_ms[GESTURE_MAX_KEYS];
+    uint32_t        long_ms;
+    uint32_t        repeat_ms;
+    uint32_t        double_ms;
+    uint32_t        metrics_ms;
+    uint32_t        refresh_ms;
+    uint32_t        brightness;
+    char            python[32];
+    char            script[64];
+    char            ntp_server[64];
+    char            timezone[48];
+    uint32_t        history_samples;
+    uint32_t        history_ms;
+    uint32_t        history_batch;
+    char            history_path[68];
+    uint32_t        display_timeout;
+    uint32_t        dim_brightness;
+    uint32_t        dim_start;
+    uint32_t        dim_end;
+    uint32_t        arena_kb;
+    char            layout_path[64];
+    uint32_t        cpu_mask;
+    uint32_t        rt_priority;
+    uint32_t        lock_memory;
+
+    struct devtab   devices;
+};
+
+//// old is the previous snapshot, still mapped for the duration of the call
+typedef void (*config_handler)(const struct config* cfg, const struct config* old);
+
+extern int  config_compile(const char* path, struct config* cfg);
+extern int  config_open(const char* path, config_handler changed);
+extern const struct config* config_get();
+extern void config_close();
+
+
+#endif
@@ -37,34 +37,12 @@ THE SOFTWARE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdio.h>
-#include <stdarg.h>
 #include <string.h>
 
 #include "daemonize.h"
+#include "logger.h"
 
-//extern void log2file(const char *fmt, ...);
-
-static void _log2file(const char* fmt, va_list vl) {
-    FILE* file_out;
-    file_out = fopen(LOG_FILE_NAME,"a+");
-    if (file_out == NULL) {
-        return;
-    }
-    vfprintf(file_out, fmt, vl);
-    fclose(file_out);
-}
-
-void log2file(const char *fmt, ...) {
-    if (DEBUG) {
-        va_list vl;
-        va_start(vl, fmt);
-        _log2file(fmt, vl);
-        va_end(vl);
-    }
-}
-
-
-void daemonize(const char *cmd)
+void daemonize(const char *cmd, int foreground)
 {
     int i, fd0, fd1, fd2;
     pid_t pid;
@@ -85,33 +63,39 @@ void daemonize(const char *cmd)
     }
 
     /*
-     * Become a session leader to lose controlling TTY.
-     */
-    if ((pid = fork()) < 0) {
-        log2file("%s: can't fork\n", cmd);
-        exit(1);
-    } else if (pid != 0) /* parent */ {
-        exit(0);
-    }
-
-    setsid();
-
-    /*
-     * Ensure future opens won't allocate controlling TTYs.
+     * Under a supervisor the process it started stays the daemon, only
+     * the steps after the forks (cwd, descriptors) apply.
      */
-    sa.sa_handler = SIG_IGN;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    if (sigaction(SIGHUP, &sa, NULL) < 0) {
-        log2file("%s: can't ignore SIGHUP\n");
-        exit(1);
-    }
-
-    if ((pid = fork()) < 0) {
-        log2file("%s: can't fork\n", cmd);
-        exit(1);
-    } else if (pid != 0) /* parent */ {
-        exit(0);
+    if (!foreground) {
+        /*
+         * Become a session leader to lose controlling TTY.
+         */
+        if ((pid = fork()) < 0) {
+            log2file("%s: can't fork\n", cmd);
+            exit(1);
+        } else if (pid != 0) /* parent */ {
+            exit(0);
+        }
+
+        setsid();
+
+        /*
+         * Ensure future opens won't allocate controlling TTYs.
+         */
+        sa.sa_handler = SIG_IGN;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = 0;
+        if (sigaction(SIGHUP, &sa, NULL) < 0) {
+            log2file("%s: can't ignore SIGHUP\n");
+            exit(1);
+        }
+
+        if ((pid = fork()) < 0) {
+            log2file("%s: can't fork\n", cmd);
+            exit(1);
+        } else if (pid != 0) /* parent */ {
+            exit(0);
+        }
     }
 
     /*
@@ -38,8 +38,32 @@ THE SOFTWARE.
 #define PYTHON3_INTERP  "python3.8"
 #define PYTHON3_SCRIPT  "bakebit_nanohat_oled.py"
 
+/* "cdev" (/dev/gpiochipN line events) or "sysfs", override with -g */
+#define GPIO_BACKEND    "cdev"
+#define GPIO_CHIP       "/dev/gpiochip0"
+
+/* native SSD1306 renderer, enabled with -r (-i overrides the bus) */
+#define OLED_I2C_BUS    "/dev/i2c-0"
+#define DRAW_SOCKET     "/var/run/nanohat-oled-draw.sock"
+
+/* counters and latency histograms, one text dump per connection */
+#define STATS_SOCKET    "/var/run/nanohat-oled-stats.sock"
+
+/* panels, key banks and settings, override with -D (see Source/config.h);
+ * without devices one bank on GPIO_CHIP and, with -r, one panel on
+ * OLED_I2C_BUS; the defines here are the defaults for the settings */
+#define CONFIG_FILE     "/etc/nanohat-oled.conf"
+
+/* SNTP server for time syncs the view asks for, override with -t; a
+ * datagram to the socket asks for one */
+#define TIMESYNC_SERVER "pool.ntp.org"
+#define TIMESYNC_SOCKET "/var/run/nanohat-oled-sync.sock"
+
+/* how long startup waits for the gpio and i2c nodes to appear */
+#define DEVICE_WAIT_MS  5000
+
 extern int isAlreadyRunning();
-extern void daemonize(const char *cmd);
+extern void daemonize(const char *cmd, int foreground);
 
 
 #endif
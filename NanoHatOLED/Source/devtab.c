@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devtab.h"
+
+
+// ============================================================================
+
+
+static int parse_lines(char* list, struct devtab_bank* bank) {
+    char* tok;
+    char* end;
+    long line;
+
+    bank->nlines = 0;
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        line = strtol(tok, &end, 10);
+        if (end == tok || *end || line < 0 || bank->nlines == GPIO_MAX_LINES) {
+            return -1;
+        }
+        bank->lines[bank->nlines++] = line;
+    }
+    return bank->nlines > 0 ? 0 : -1;
+}
+
+
+// ============================================================================
+
+
+//// one line of the config file, 1 if it isn't a panel or keys entry
+int devtab_entry(char* line, struct devtab* tab) {
+    char kind[16] = "", path[DEVTAB_PATH_MAX], arg[64] = "";
+    struct devtab_panel* panel;
+    struct devtab_bank* bank;
+    char* end;
+    int n;
+
+    n = sscanf(line, "%15s %63s %63s", kind, path, arg);
+    if (n < 2) {
+        return strcmp(kind, "panel") == 0 || strcmp(kind, "keys") == 0 ? -1 : 1;
+    }
+    if (strcmp(kind, "panel") == 0) {
+        if (tab->npanels == RENDER_MAX_PANELS) {
+            return -1;
+        }
+        panel = &tab->panels[tab->npanels];
+        strcpy(panel->bus, path);
+        panel->addr = n == 3 ? strtol(arg, &end, 0) : 0;
+        if (n == 3 && (*end || panel->addr < 0 || panel->addr > 0x7f)) {
+            return -1;
+        }
+        tab->npanels++;
+        return 0;
+    }
+    if (strcmp(kind, "keys") == 0 && n == 3) {
+        if (tab->nbanks == DEVTAB_MAX_BANKS) {
+            return -1;
+        }
+        bank = &tab->banks[tab->nbanks];
+        strcpy(bank->chip, path);
+        if (parse_lines(arg, bank) != 0) {
+            return -1;
+        }
+        tab->nbanks++;
+        return 0;
+    }
+    return strcmp(kind, "keys") == 0 ? -1 : 1;
+}
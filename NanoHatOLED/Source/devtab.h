@@ -0,0 +1,42 @@
+#ifndef __DEVTAB__H__
+#define __DEVTAB__H__
+
+#include "gpio.h"
+#include "render.h"
+
+/*
+ * The devices one daemon drives, entries of the config file (CONFIG_FILE or
+ * -D path, see Source/config.h). One entry per line:
+ *
+ *   panel  /dev/i2c-0  0x3c        SSD1306 on a bus, address 0 probes both
+ *   keys   /dev/gpiochip0  0,2,3   lines of one chip, in key order
+ *
+ * Keys are numbered across banks in table order, so the second bank's
+ * first line is key 3 above. Panels are numbered the same way (DRAW_PANEL).
+ */
+
+#define DEVTAB_MAX_BANKS    4
+#define DEVTAB_PATH_MAX     64
+
+struct devtab_panel {
+    char    bus[DEVTAB_PATH_MAX];
+    int     addr;
+};
+
+struct devtab_bank {
+    char    chip[DEVTAB_PATH_MAX];
+    int     lines[GPIO_MAX_LINES];
+    int     nlines;
+};
+
+struct devtab {
+    struct devtab_panel panels[RENDER_MAX_PANELS];
+    int                 npanels;
+    struct devtab_bank  banks[DEVTAB_MAX_BANKS];
+    int                 nbanks;
+};
+
+extern int devtab_entry(char* line, struct devtab* tab);
+
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include "devwait.h"
+#include "logger.h"
+
+/*
+ * Device nodes show up in devtmpfs, where inotify sees them being created.
+ * sysfs does not report new entries to inotify, so the wait also rechecks
+ * every DEVWAIT_RECHECK_MS; that only costs anything while something is
+ * still missing.
+ */
+
+
+// ============================================================================
+
+
+#define DEVWAIT_RECHECK_MS  50
+
+static long elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 +
+            (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+//// index of the first path that doesn't exist yet, n if all do
+static int first_missing(const char* const* paths, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (access(paths[i], F_OK) != 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+//// watch the directory a path will be created in
+static void watch_parent(int ifd, const char* path) {
+    char dir[128];
+    char* slash;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        return;
+    }
+    *slash = '\0';
+    inotify_add_watch(ifd, dir[0] ? dir : "/", IN_CREATE | IN_MOVED_TO | IN_ATTRIB);
+}
+
+
+// ============================================================================
+
+
+//// wait until every path exists, returns 0 or -1 once timeout_ms passed
+int devwait(const char* const* paths, int n, int timeout_ms) {
+    struct timespec start;
+    struct pollfd pfd;
+    char events[1024];
+    long left;
+    int i, ifd;
+
+    i = first_missing(paths, n);
+    if (i == n) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd >= 0) {
+        for (; i < n; i++) {
+            watch_parent(ifd, paths[i]);
+        }
+    }
+    pfd.fd = ifd;
+    pfd.events = POLLIN;
+
+    while ((i = first_missing(paths, n)) < n) {
+        left = timeout_ms - elapsed_ms(&start);
+        if (left <= 0) {
+            log2file("%s did not show up within %d ms\n", paths[i], timeout_ms);
+            break;
+        }
+        if (poll(&pfd, ifd >= 0 ? 1 : 0,
+                left < DEVWAIT_RECHECK_MS ? left : DEVWAIT_RECHECK_MS) > 0) {
+            while (read(ifd, events, sizeof(events)) > 0);
+        }
+    }
+
+    if (ifd >= 0) {
+        close(ifd);
+    }
+    if (i == n) {
+        log_msg(LOGLVL_DEBUG, "devices ready after %ld ms\n", elapsed_ms(&start));
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,7 @@
+#ifndef __DEVWAIT__H__
+#define __DEVWAIT__H__
+
+extern int devwait(const char* const* paths, int n, int timeout_ms);
+
+
+#endif
@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "draw.h"
+#include "render.h"
+#include "font.h"
+#include "loop.h"
+#include "timer.h"
+#include "tz.h"
+#include "history.h"
+#include "layout.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+struct clock_field {
+    int16_t     x, y;
+    uint8_t     size, color, kind;
+    int         zone;
+};
+
+//// what the commands leave behind between frames, one per panel
+struct draw_state {
+    struct text_cache   texts[DRAW_TEXT_SLOTS];
+    unsigned int        text_next;
+    struct clock_field  clocks[DRAW_CLOCK_SLOTS];
+    int                 nclocks;
+    const struct layout_op* widgets;    /* of the screen up, NULL: none */
+    int                 nwidgets;
+    int                 wclocks;        /* clocks among them */
+    unsigned int        generation;     /* of the layout file they came from */
+    char                screen[LAYOUT_NAME_MAX];
+    int                 zone;           /* for clocks that name none */
+    int64_t             keys[LAYOUT_SCREEN_OPS];
+};
+
+static struct loop_source draw_source = { -1, NULL, NULL };
+static const char* draw_path = NULL;
+static struct draw_state states[RENDER_MAX_PANELS];
+static struct draw_state* cur = &states[0];    /* panel being drawn */
+static struct timer clock_tick = { { -1, NULL, NULL } };
+static struct metrics latest;           /* the widgets show this sample */
+
+static const char* wday_names[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char* month_names[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+
+static int16_t field(const uint8_t* p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+//// white text goes through a cache slot keyed by its position, so a line
+//// that reads the same as last frame (a date, a label) is not rasterized again
+static void draw_text(struct fb* fb, int x, int y, int size, int color,
+                      const uint8_t* text, int len) {
+    const struct font* font = font_by_height(size);
+    char s[TEXT_CACHE_LEN];
+    long key = ((long)(y & 0xffff) << 16) | (x & 0xffff);
+    struct text_cache* cache = NULL;
+    unsigned int i;
+
+    if (len > TEXT_CACHE_LEN - 1) {
+        len = TEXT_CACHE_LEN - 1;
+    }
+    memcpy(s, text, len);
+    s[len] = '\0';
+    if (color != FB_WHITE) {
+        font_draw(fb, x, y, font, s, color);
+        return;
+    }
+
+    for (i = 0; i < DRAW_TEXT_SLOTS && cache == NULL; i++) {
+        if (text_cache_valid(&cur->texts[i], key) && cur->texts[i].font == font) {
+            cache = &cur->texts[i];
+        }
+    }
+    if (cache == NULL) {
+        cache = &cur->texts[cur->text_next++ % DRAW_TEXT_SLOTS];
+        cache->valid = 0;
+    }
+    text_cache_set(cache, font, key, s);
+    text_cache_draw(cache, fb, x, y);
+}
+
+//// format and draw one clock field for t (seconds since the epoch)
+static void draw_clock(struct fb* fb, const struct clock_field* c, int64_t t) {
+    struct tz_local l;
+    char s[TEXT_CACHE_LEN];
+    int len;
+
+    tz_localtime(c->zone, t, &l);
+    if (c->kind == DRAW_CLOCK_DATE) {
+        len = snprintf(s, sizeof(s), "%s, %s %02d %04d", wday_names[l.wday],
+                month_names[l.month - 1], l.day, l.year);
+    } else if (c->kind == DRAW_CLOCK_ZONE) {
+        len = snprintf(s, sizeof(s), "%s", l.abbr);
+    } else {
+        len = snprintf(s, sizeof(s), "%02d:%02d:%02d", l.hour, l.min, l.sec);
+    }
+    draw_text(fb, c->x, c->y, c->size, c->color, (const uint8_t*)s, len);
+}
+
+static void add_clock(struct fb* fb, const uint8_t* p, const uint8_t* zone, int len) {
+    char name[TZ_NAME_MAX];
+    struct clock_field* c;
+
+    if (cur->nclocks == DRAW_CLOCK_SLOTS) {
+        return;
+    }
+    c = &cur->clocks[cur->nclocks++];
+    c->x = field(p);
+    c->y = field(p + 2);
+    c->size = p[4];
+    c->color = p[5];
+    c->kind = p[6];
+    snprintf(name, sizeof(name), "%.*s", len, (const char*)zone);
+    c->zone = tz_find(name);
+    draw_clock(fb, c, clock_ns(CLOCK_REALTIME) / NSEC_PER_SEC);
+}
+
+//// a history series across the box, one sample per column
+static void draw_spark(struct fb* fb, int x, int y, int w, int h, int color, int series) {
+    int32_t v[FB_WIDTH];
+    int32_t lo = 0, hi = 1000;
+    int i, n, py, prev = -1;
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    if (w > FB_WIDTH) {
+        w = FB_WIDTH;
+    }
+    fb_fill(fb, x, y, w, h, color == FB_BLACK ? FB_WHITE : FB_BLACK);
+    n = history_series(series, w, v);
+    if (series == HISTORY_TEMP) {
+        lo = INT32_MAX;
+        hi = INT32_MIN;
+        for (i = 0; i < n; i++) {
+            if (v[i] != HISTORY_NO_TEMP) {
+                lo = v[i] < lo ? v[i] : lo;
+                hi = v[i] > hi ? v[i] : hi;
+            }
+        }
+        if (lo > hi) {
+            lo = hi = 0;            // no readings, nothing gets drawn
+        }
+        if (hi - lo < 50) {
+            lo = (lo + hi) / 2 - 25;
+            hi = lo + 50;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (v[i] == HISTORY_NO_TEMP && series == HISTORY_TEMP) {
+            prev = -1;
+            continue;
+        }
+        py = y + h - 1 - (int)((int64_t)(v[i] - lo) * (h - 1) / (hi - lo));
+        py = py < y ? y : py > y + h - 1 ? y + h - 1 : py;
+        if (prev < 0) {
+            fb_pixel(fb, x + w - n + i, py, color);
+        } else {
+            fb_vline(fb, x + w - n + i, py < prev ? py : prev, (py < prev ? prev - py : py - prev) + 1, color);
+        }
+        prev = py;
+    }
+}
+
+static void draw_widget(struct fb* fb, const struct layout_op* op, int64_t key,
+                        int64_t now, int full) {
+    struct clock_field c;
+    char s[TEXT_CACHE_LEN];
+
+    switch (op->kind) {
+    case LAYOUT_TEXT:
+        draw_text(fb, op->x, op->y, op->font->height, FB_WHITE,
+                (const uint8_t*)op->text, strlen(op->text));
+        break;
+    case LAYOUT_VALUE:
+        if (full && op->text[0]) {
+            draw_text(fb, op->x, op->y, op->font->height, FB_WHITE,
+                    (const uint8_t*)op->text, strlen(op->text));
+        }
+        // values change every sample, they don't churn the text cache
+        fb_fill(fb, op->vx, op->y, op->x + op->w - op->vx, op->h, FB_BLACK);
+        layout_format(op, key, s, sizeof(s));
+        font_draw(fb, op->vx, op->y, op->font, s, FB_WHITE);
+        break;
+    case LAYOUT_BAR:
+        fb_fill(fb, op->x, op->y, op->w, op->h, FB_BLACK);
+        fb_rect(fb, op->x, op->y, op->w, op->h, FB_WHITE);
+        fb_fill(fb, op->x + 1, op->y + 1, key, op->h - 2, FB_WHITE);
+        break;
+    case LAYOUT_SPARK:
+        draw_spark(fb, op->x, op->y, op->w, op->h, FB_WHITE, op->bind);
+        break;
+    case LAYOUT_CLOCK:
+        c.x = op->x;
+        c.y = op->y;
+        c.size = op->font->height;
+        c.color = FB_WHITE;
+        c.kind = op->bind;
+        c.zone = op->zone >= 0 ? op->zone : cur->zone;
+        draw_clock(fb, &c, now);
+        break;
+    }
+}
+
+//// look the panel's screen up in the layout that is loaded now
+static void bind_screen() {
+    int i;
+
+    cur->widgets = layout_ops(layout_find(cur->screen), &cur->nwidgets);
+    cur->generation = layout_generation();
+    cur->wclocks = 0;
+    for (i = 0; i < cur->nwidgets; i++) {
+        cur->wclocks += cur->widgets[i].kind == LAYOUT_CLOCK;
+    }
+}
+
+//// redraw the widgets of the panel's screen whose key changed, all of them
+//// if full; returns how many were drawn
+static int draw_widgets(struct fb* fb, int full) {
+    int64_t now = clock_ns(CLOCK_REALTIME) / NSEC_PER_SEC;
+    int64_t key;
+    int i, n = 0;
+
+    if (cur->widgets != NULL && cur->generation != layout_generation()) {
+        // the file was compiled again, by another panel or a config change
+        bind_screen();
+        fb_clear(fb, FB_BLACK);
+        full = 1;
+    }
+    for (i = 0; i < cur->nwidgets; i++) {
+        key = layout_key(&cur->widgets[i], &latest, cur->zone, now);
+        if (!full && key == cur->keys[i]) {
+            continue;
+        }
+        cur->keys[i] = key;
+        draw_widget(fb, &cur->widgets[i], key, now, full);
+        n++;
+    }
+    return n;
+}
+
+//// DRAW_LAYOUT: put a screen up unless it is up already
+static void select_screen(struct fb* fb, const uint8_t* name, int len,
+                          const uint8_t* zone, int zlen) {
+    char s[LAYOUT_NAME_MAX], z[TZ_NAME_MAX];
+    int zi;
+
+    snprintf(s, sizeof(s), "%.*s", len, (const char*)name);
+    snprintf(z, sizeof(z), "%.*s", zlen, (const char*)zone);
+    zi = tz_find(z[0] ? z : "UTC");
+    if (cur->widgets != NULL && cur->generation == layout_generation() &&
+            cur->zone == zi && strcmp(cur->screen, s) == 0) {
+        return;
+    }
+    snprintf(cur->screen, sizeof(cur->screen), "%s", s);
+    cur->zone = zi;
+    bind_screen();
+    fb_clear(fb, FB_BLACK);
+    cur->nclocks = 0;
+    if (cur->widgets == NULL) {
+        log2file("no layout screen %s\n", s);
+        return;
+    }
+    draw_widgets(fb, 1);
+}
+
+//// a wall clock second started (or the clock was set): redraw the fields
+static void clock_fired(struct timer* t, uint64_t expirations) {
+    int64_t now = clock_ns(CLOCK_REALTIME) / NSEC_PER_SEC;
+    int panel, i, n;
+
+    for (panel = 0; panel < render_active(); panel++) {
+        cur = &states[panel];
+        for (i = 0; i < cur->nclocks; i++) {
+            draw_clock(render_fb(panel), &cur->clocks[i], now);
+        }
+        n = cur->wclocks > 0 ? draw_widgets(render_fb(panel), 0) : 0;
+        if (cur->nclocks > 0 || n > 0) {
+            render_commit(panel);
+        }
+    }
+    cur = &states[0];
+}
+
+//// tick only while a frame on screen has clock fields or clock widgets
+static void schedule_clocks() {
+    int panel, n = 0;
+
+    if (clock_tick.src.fd < 0) {
+        return;
+    }
+    for (panel = 0; panel < RENDER_MAX_PANELS; panel++) {
+        n += states[panel].nclocks + states[panel].wclocks;
+    }
+    if (n > 0 && clock_tick.period_ns == 0) {
+        timer_start(&clock_tick, NSEC_PER_SEC);
+    } else if (n == 0 && clock_tick.period_ns != 0) {
+        timer_stop(&clock_tick);
+    }
+}
+
+
+// ============================================================================
+
+
+//// run the commands in buf against fb
+//// returns 1 if the buffer ended a frame with DRAW_COMMIT, 0 if not, -1 if
+//// it is malformed (commands before the bad one have been applied)
+int draw_exec(struct fb* fb, const uint8_t* buf, int len) {
+    const uint8_t* p = buf;
+    const uint8_t* end = buf + len;
+    int commit = 0;
+    int x, y, w, h, need;
+
+    while (p < end) {
+        uint8_t op = *p++;
+        commit = 0;
+        switch (op) {
+        case DRAW_CLEAR:
+            if (end - p < 1) return -1;
+            fb_clear(fb, p[0]);
+            cur->nclocks = 0;
+            cur->widgets = NULL;
+            cur->nwidgets = cur->wclocks = 0;
+            p += 1;
+            break;
+        case DRAW_PIXEL:
+            if (end - p < 5) return -1;
+            fb_pixel(fb, field(p), field(p + 2), p[4]);
+            p += 5;
+            break;
+        case DRAW_HLINE:
+            if (end - p < 7) return -1;
+            fb_hline(fb, field(p), field(p + 2), field(p + 4), p[6]);
+            p += 7;
+            break;
+        case DRAW_VLINE:
+            if (end - p < 7) return -1;
+            fb_vline(fb, field(p), field(p + 2), field(p + 4), p[6]);
+            p += 7;
+            break;
+        case DRAW_RECT:
+        case DRAW_FILL:
+            if (end - p < 9) return -1;
+            if (op == DRAW_RECT) {
+                fb_rect(fb, field(p), field(p + 2), field(p + 4), field(p + 6), p[8]);
+            } else {
+                fb_fill(fb, field(p), field(p + 2), field(p + 4), field(p + 6), p[8]);
+            }
+            p += 9;
+            break;
+        case DRAW_PAGES:
+        case DRAW_ROWS:
+            if (end - p < 8) return -1;
+            x = field(p); y = field(p + 2); w = field(p + 4); h = field(p + 6);
+            p += 8;
+            if (w < 0 || h < 0) return -1;
+            need = (op == DRAW_PAGES) ? ((h + 7) / 8) * w : ((w + 7) / 8) * h;
+            if (end - p < need) return -1;
+            if (op == DRAW_PAGES) {
+                fb_blit_pages(fb, x, y, w, h, p);
+            } else {
+                fb_blit_rows(fb, x, y, w, h, p);
+            }
+            p += need;
+            break;
+        case DRAW_TEXT:
+            if (end - p < 7) return -1;
+            need = p[6];
+            if (end - p < 7 + need) return -1;
+            draw_text(fb, field(p), field(p + 2), p[4], p[5], p + 7, need);
+            p += 7 + need;
+            break;
+        case DRAW_CLOCK:
+            if (end - p < 8) return -1;
+            need = p[7];
+            if (end - p < 8 + need) return -1;
+            add_clock(fb, p, p + 8, need);
+            p += 8 + need;
+            break;
+        case DRAW_SPARK:
+            if (end - p < 10) return -1;
+            draw_spark(fb, field(p), field(p + 2), field(p + 4), field(p + 6), p[8], p[9]);
+            p += 10;
+            break;
+        case DRAW_LAYOUT:
+            if (end - p < 1) return -1;
+            need = p[0];
+            if (end - p < 2 + need || end - p < 2 + need + p[1 + need]) return -1;
+            select_screen(fb, p + 1, need, p + 2 + need, p[1 + need]);
+            p += 2 + need + p[1 + need];
+            break;
+        case DRAW_COMMIT:
+            commit = 1;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return commit;
+}
+
+
+// ============================================================================
+
+
+static void draw_ready(struct loop_source* src, uint32_t events) {
+    static uint8_t buf[DRAW_MAX_PACKET];
+    const uint8_t* p;
+    ssize_t len;
+    int panel, ret;
+
+    while ((len = recv(src->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        p = buf;
+        panel = 0;
+        if (len >= 2 && buf[0] == DRAW_PANEL) {
+            panel = buf[1];
+            p += 2;
+            len -= 2;
+        }
+        if (panel >= render_active()) {
+            log2file("draw packet for missing panel %d\n", panel);
+            continue;
+        }
+        cur = &states[panel];
+        ret = draw_exec(render_fb(panel), p, len);
+        if (ret < 0) {
+            log2file("malformed draw packet of %d bytes\n", (int)len);
+        } else if (ret > 0) {
+            render_commit(panel);
+        }
+    }
+    cur = &states[0];
+    schedule_clocks();
+}
+
+//// bind the draw command socket and add it to the loop
+int draw_open(const char* path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log2file("draw socket: %s\n", strerror(errno));
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        log2file("bind %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    chmod(path, 0666);
+
+    draw_source.fd = fd;
+    draw_source.handler = draw_ready;
+    if (loop_add(&draw_source, EPOLLIN) != 0) {
+        draw_close();
+        return -1;
+    }
+    if (timer_init(&clock_tick, CLOCK_REALTIME, clock_fired, NULL) != 0) {
+        log2file("clock fields won't tick\n");
+    }
+    draw_path = path;
+    return 0;
+}
+
+//// a new metrics sample, the widgets that show it differently are redrawn
+void draw_update(const struct metrics* m) {
+    int panel;
+
+    memcpy(&latest, m, sizeof(latest));
+    for (panel = 0; panel < render_active(); panel++) {
+        cur = &states[panel];
+        if (cur->widgets != NULL && draw_widgets(render_fb(panel), 0) > 0) {
+            render_commit(panel);
+        }
+    }
+    cur = &states[0];
+}
+
+//// stop or restart the clock fields' tick, they are redrawn on restart
+void draw_suspend(int suspend) {
+    if (suspend) {
+        timer_pause(&clock_tick);
+    } else if (clock_tick.paused) {
+        timer_resume(&clock_tick);
+        if (clock_tick.period_ns) {
+            clock_fired(&clock_tick, 1);
+        }
+    }
+}
+
+void draw_close() {
+    timer_close(&clock_tick);
+    memset(states, 0, sizeof(states));
+    if (draw_source.fd >= 0) {
+        loop_del(&draw_source);
+        close(draw_source.fd);
+        draw_source.fd = -1;
+    }
+    if (draw_path != NULL) {
+        unlink(draw_path);
+        draw_path = NULL;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef __DRAW__H__
+#define __DRAW__H__
+
+#include <stdint.h>
+#include "fb.h"
+#include "metrics.h"
+
+/*
+ * Draw commands accepted on DRAW_SOCKET (SOCK_DGRAM). A datagram holds any
+ * number of commands back to back; each is an op byte followed by its fields.
+ * x, y, w, h are little endian int16, color is one byte (FB_BLACK, FB_WHITE,
+ * FB_INVERT). A client normally sends one frame per datagram ending in
+ * DRAW_COMMIT, which diffs the frame against the panel and flushes it.
+ *
+ *   DRAW_CLEAR   color
+ *   DRAW_PIXEL   x y color
+ *   DRAW_HLINE   x y w color
+ *   DRAW_VLINE   x y h color
+ *   DRAW_RECT    x y w h color
+ *   DRAW_FILL    x y w h color
+ *   DRAW_PAGES   x y w h data[ceil(h/8)*w]     framebuffer page layout
+ *   DRAW_ROWS    x y w h data[ceil(w/8)*h]     row-major, MSB first (PIL "1")
+ *   DRAW_TEXT    x y size color len text[len]  size 8 or 16, opaque cells
+ *   DRAW_CLOCK   x y size color kind len zone[len]
+ *   DRAW_SPARK   x y w h color series          HISTORY_* from the history ring
+ *   DRAW_LAYOUT  len name[len] zlen zone[zlen] a screen of the layout file
+ *   DRAW_COMMIT
+ *   DRAW_PANEL   panel                         first in a datagram only
+ *
+ * DRAW_CLOCK draws the time (DRAW_CLOCK_*) in a zone from /usr/share/zoneinfo
+ * ("Europe/London") and keeps it as a field of the frame: the daemon redraws
+ * and flushes it on every wall clock second by itself, until the next
+ * DRAW_CLEAR, so a clock screen needs no frames from the view.
+ *
+ * DRAW_SPARK clears its box and draws the newest w samples of a history
+ * series as a line, the newest at the right edge. Percentages span the full
+ * height; temperatures span the range they cover, at least 5 degC.
+ *
+ * DRAW_LAYOUT puts up a screen of the layout file (layout.h): the frame is
+ * cleared and every widget drawn, and from then on the daemon keeps the
+ * widgets current by itself, redrawing the ones whose value changed, until
+ * the next DRAW_CLEAR. zone is for its clocks that name none. Selecting the
+ * screen that is already up (same name and zone) does nothing, so a view
+ * can send it at the start of every frame and draw its own parts after it.
+ *
+ * With several panels a datagram that starts with DRAW_PANEL goes to that
+ * panel (0 without it); each panel keeps its own text cache and clocks.
+ */
+
+#define DRAW_MAX_PACKET 4096
+#define DRAW_TEXT_SLOTS 8       /* strings kept rasterized between frames */
+#define DRAW_CLOCK_SLOTS 4      /* clock fields per frame */
+
+#define DRAW_CLEAR      0x01
+#define DRAW_PIXEL      0x02
+#define DRAW_HLINE      0x03
+#define DRAW_VLINE      0x04
+#define DRAW_RECT       0x05
+#define DRAW_FILL       0x06
+#define DRAW_PAGES      0x07
+#define DRAW_ROWS       0x08
+#define DRAW_TEXT       0x09
+#define DRAW_CLOCK      0x0a
+#define DRAW_PANEL      0x0b
+#define DRAW_SPARK      0x0c
+#define DRAW_LAYOUT     0x0d
+#define DRAW_COMMIT     0x7f
+
+#define DRAW_CLOCK_TIME 0       /* 14:05:09 */
+#define DRAW_CLOCK_DATE 1       /* Wed, Oct 14 2026 */
+#define DRAW_CLOCK_ZONE 2       /* EAT, BST... */
+
+extern int  draw_exec(struct fb* fb, const uint8_t* buf, int len);
+extern int  draw_open(const char* path);
+extern void draw_update(const struct metrics* m);
+extern void draw_suspend(int suspend);
+extern void draw_close();
+
+
+#endif
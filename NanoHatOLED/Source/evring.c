@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "evring.h"
+#include "stats.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static struct evring_header* ring = NULL;
+static size_t ring_bytes = 0;
+static const char* ring_name = NULL;
+static int efd = -1;
+
+
+// ============================================================================
+
+
+//// create the shared segment and the wakeup eventfd
+//// the eventfd is inherited by the view, its number goes to $NANOHAT_EVENTFD
+int evring_create(const char* name, unsigned int size) {
+    char num[12];
+    int fd;
+
+    if (size == 0 || (size & (size - 1)) != 0) {
+        log2file("event ring size %u is not a power of two\n", size);
+        return -1;
+    }
+
+    ring_bytes = sizeof(struct evring_header) + size * sizeof(struct evring_entry);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log2file("shm_open %s failed: %s\n", name, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, ring_bytes) != 0) {
+        log2file("ftruncate %s failed: %s\n", name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    ring = mmap(NULL, ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        log2file("mmap %s failed: %s\n", name, strerror(errno));
+        ring = NULL;
+        return -1;
+    }
+
+    efd = eventfd(0, EFD_NONBLOCK);
+    if (efd < 0) {
+        log2file("eventfd failed: %s\n", strerror(errno));
+        evring_destroy();
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->version = EVRING_VERSION;
+    ring->size = size;
+    ring->entry_size = sizeof(struct evring_entry);
+    ring->producer_pid = getpid();
+    ring->eventfd = efd;
+    __atomic_store_n(&ring->magic, EVRING_MAGIC, __ATOMIC_RELEASE);
+
+    ring_name = name;
+    sprintf(num, "%d", efd);
+    setenv("NANOHAT_EVENTFD", num, 1);
+    setenv("NANOHAT_EVRING", name, 1);
+    return 0;
+}
+
+//// append one event and wake the consumer, never blocks
+//// returns -1 and counts a drop when the consumer is a full ring behind
+int evring_push(int key, int kind, uint64_t timestamp_ns, uint32_t value) {
+    struct evring_entry* e;
+    uint32_t head, tail;
+    uint64_t one = 1;
+
+    if (ring == NULL) {
+        return -1;
+    }
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= ring->size) {
+        ring->dropped++;
+        stats_add(STAT_DROPPED, 1);
+        return -1;
+    }
+
+    e = &ring->entries[head & (ring->size - 1)];
+    e->timestamp_ns = timestamp_ns;
+    e->value = value;
+    e->key = key;
+    e->kind = kind;
+    e->reserved = 0;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    if (write(efd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log2file("eventfd write failed: %s\n", strerror(errno));
+    }
+    return 0;
+}
+
+//// non-zero once a view has mapped the ring and announced itself
+int evring_attached() {
+    return ring != NULL && __atomic_load_n(&ring->consumer_pid, __ATOMIC_ACQUIRE) != 0;
+}
+
+//// pid of the attached view, 0 if none
+pid_t evring_consumer() {
+    return ring ? (pid_t)__atomic_load_n(&ring->consumer_pid, __ATOMIC_ACQUIRE) : 0;
+}
+
+//// forget the current consumer, e.g. after the view exited
+void evring_detach() {
+    if (ring != NULL) {
+        __atomic_store_n(&ring->consumer_pid, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->heartbeat, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->wants, 0, __ATOMIC_RELEASE);
+    }
+}
+
+//// the view's heartbeat counter, 0 until it sends the first one
+uint32_t evring_heartbeat() {
+    return ring ? __atomic_load_n(&ring->heartbeat, __ATOMIC_ACQUIRE) : 0;
+}
+
+//// what the attached view's screen depends on, SCHED_* bits
+uint32_t evring_wants() {
+    return evring_attached() ? __atomic_load_n(&ring->wants, __ATOMIC_ACQUIRE) : 0;
+}
+
+int evring_eventfd() {
+    return efd;
+}
+
+void evring_destroy() {
+    if (ring != NULL) {
+        munmap(ring, ring_bytes);
+        ring = NULL;
+    }
+    if (efd >= 0) {
+        close(efd);
+        efd = -1;
+    }
+    if (ring_name != NULL) {
+        shm_unlink(ring_name);
+        ring_name = NULL;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef __EVRING__H__
+#define __EVRING__H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Single-producer/single-consumer key event ring shared with the python view.
+ *
+ * The segment lives in /dev/shm (EVRING_NAME) and is laid out as below, all
+ * fields little/host endian. The daemon only writes head, the view only
+ * writes tail, consumer_pid, heartbeat and wants. After each
+ * push the daemon bumps an eventfd whose number is in the header and in
+ * $NANOHAT_EVENTFD of the spawned view.
+ *
+ *   0   magic           4   version         8   size (entries, 2^n)
+ *   12  entry_size      16  producer_pid    20  eventfd
+ *   24  consumer_pid    28  dropped         32  heartbeat (bumped by the view)
+ *   36  wants (SCHED_* the view's screen depends on, see sched.h)
+ *   64  head            128 tail            192 entries[size]
+ */
+
+#define EVRING_NAME         "/nanohat-oled-events"
+#define EVRING_MAGIC        0x5645484e      /* "NHEV" */
+#define EVRING_VERSION      1
+#define EVRING_SIZE         256
+
+#define EVRING_KEY_DOWN     1       /* debounced press */
+#define EVRING_KEY_UP       2       /* value: ms held */
+#define EVRING_KEY_LONG     3       /* value: ms held */
+#define EVRING_KEY_REPEAT   4       /* value: repeat count, from 1 */
+#define EVRING_KEY_DOUBLE   5       /* after the DOWN, value: ms since the first press */
+#define EVRING_FRAME        6       /* redraw, value: SCHED_* reasons, key unused */
+
+struct evring_entry {
+    uint64_t    timestamp_ns;   /* CLOCK_MONOTONIC */
+    uint32_t    value;          /* kind specific, e.g. press duration in ms */
+    uint8_t     key;
+    uint8_t     kind;           /* EVRING_* */
+    uint16_t    reserved;
+};
+
+struct evring_header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    size;
+    uint32_t    entry_size;
+    uint32_t    producer_pid;
+    int32_t     eventfd;
+    uint32_t    consumer_pid;
+    uint32_t    dropped;
+    uint32_t    heartbeat;
+    uint32_t    wants;
+    uint8_t     pad0[24];
+    uint32_t    head;
+    uint8_t     pad1[60];
+    uint32_t    tail;
+    uint8_t     pad2[60];
+    struct evring_entry entries[];
+};
+
+extern int  evring_create(const char* name, unsigned int size);
+extern int  evring_push(int key, int kind, uint64_t timestamp_ns, uint32_t value);
+extern int  evring_attached();
+extern pid_t evring_consumer();
+extern void evring_detach();
+extern uint32_t evring_heartbeat();
+extern uint32_t evring_wants();
+extern int  evring_eventfd();
+extern void evring_destroy();
+
+
+#endif
@@ -0,0 +1,185 @@
+#include <string.h>
+#include "fb.h"
+
+
+// ============================================================================
+
+
+//// write the bits of v selected by mask into one page byte
+static inline void put(struct fb* fb, int page, int x, uint8_t v, uint8_t mask, int color) {
+    uint8_t* p = &fb->pix[page][x];
+
+    if (color == FB_INVERT) {
+        *p ^= v & mask;
+    } else {
+        *p = (*p & ~mask) | (v & mask);
+    }
+}
+
+//// clip [a, a+len) to [0, limit), returns the clipped length
+static int clip(int* a, int len, int limit) {
+    if (*a < 0) {
+        len += *a;
+        *a = 0;
+    }
+    if (*a + len > limit) {
+        len = limit - *a;
+    }
+    return len;
+}
+
+
+// ============================================================================
+
+
+void fb_clear(struct fb* fb, int color) {
+    if (color == FB_INVERT) {
+        fb_fill(fb, 0, 0, FB_WIDTH, FB_HEIGHT, FB_INVERT);
+        return;
+    }
+    memset(fb->pix, color ? 0xff : 0x00, sizeof(fb->pix));
+}
+
+void fb_pixel(struct fb* fb, int x, int y, int color) {
+    if (x < 0 || x >= FB_WIDTH || y < 0 || y >= FB_HEIGHT) {
+        return;
+    }
+    put(fb, y >> 3, x, color ? 0xff : 0x00, 1 << (y & 7), color);
+}
+
+int fb_get_pixel(const struct fb* fb, int x, int y) {
+    if (x < 0 || x >= FB_WIDTH || y < 0 || y >= FB_HEIGHT) {
+        return 0;
+    }
+    return (fb->pix[y >> 3][x] >> (y & 7)) & 1;
+}
+
+void fb_hline(struct fb* fb, int x, int y, int w, int color) {
+    fb_fill(fb, x, y, w, 1, color);
+}
+
+void fb_vline(struct fb* fb, int x, int y, int h, int color) {
+    fb_fill(fb, x, y, 1, h, color);
+}
+
+void fb_rect(struct fb* fb, int x, int y, int w, int h, int color) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    fb_hline(fb, x, y, w, color);
+    if (h > 1) {
+        fb_hline(fb, x, y + h - 1, w, color);
+    }
+    if (h > 2) {
+        fb_vline(fb, x, y + 1, h - 2, color);
+        if (w > 1) {
+            fb_vline(fb, x + w - 1, y + 1, h - 2, color);
+        }
+    }
+}
+
+//// fill a box, whole pages are done a column byte at a time
+void fb_fill(struct fb* fb, int x, int y, int w, int h, int color) {
+    uint8_t v = color ? 0xff : 0x00;
+    uint8_t mask;
+    int page, y0, y1, i;
+
+    w = clip(&x, w, FB_WIDTH);
+    h = clip(&y, h, FB_HEIGHT);
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    for (page = y >> 3; page <= (y + h - 1) >> 3; page++) {
+        y0 = (page == y >> 3) ? (y & 7) : 0;
+        y1 = (page == (y + h - 1) >> 3) ? ((y + h - 1) & 7) : 7;
+        mask = (uint8_t)((0xff << y0) & (0xff >> (7 - y1)));
+        if (mask == 0xff && color != FB_INVERT) {
+            memset(&fb->pix[page][x], v, w);
+            continue;
+        }
+        for (i = 0; i < w; i++) {
+            put(fb, page, x + i, v, mask, color);
+        }
+    }
+}
+
+//// copy a w x h bitmap in the framebuffer's own page layout (ceil(h/8) pages
+//// of w bytes) to x, y; page aligned blits reduce to memcpy
+void fb_blit_pages(struct fb* fb, int x, int y, int w, int h, const uint8_t* data) {
+    int pages = (h + 7) >> 3;
+    int base, shift, sp, dp, i, cx, rows;
+    uint8_t mask, v;
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    // floor division so blits may start above the top edge
+    base = (y >= 0) ? (y >> 3) : -((7 - y) >> 3);
+    shift = y - base * 8;
+
+    for (sp = 0; sp < pages; sp++) {
+        rows = (sp == pages - 1 && (h & 7)) ? (h & 7) : 8;
+        mask = (uint8_t)(0xff >> (8 - rows));
+        dp = base + sp;
+
+        if (shift == 0 && rows == 8 && x >= 0 && x + w <= FB_WIDTH) {
+            if (dp >= 0 && dp < FB_PAGES) {
+                memcpy(&fb->pix[dp][x], &data[sp * w], w);
+            }
+            continue;
+        }
+        for (i = 0; i < w; i++) {
+            cx = x + i;
+            if (cx < 0 || cx >= FB_WIDTH) {
+                continue;
+            }
+            v = data[sp * w + i];
+            if (dp >= 0 && dp < FB_PAGES) {
+                put(fb, dp, cx, v << shift, mask << shift, FB_WHITE);
+            }
+            if (shift != 0 && dp + 1 >= 0 && dp + 1 < FB_PAGES) {
+                put(fb, dp + 1, cx, v >> (8 - shift), mask >> (8 - shift), FB_WHITE);
+            }
+        }
+    }
+}
+
+//// copy a w x h bitmap in row-major, MSB first layout (PIL mode "1")
+void fb_blit_rows(struct fb* fb, int x, int y, int w, int h, const uint8_t* data) {
+    int stride = (w + 7) >> 3;
+    int cx, cy;
+
+    for (cy = 0; cy < h; cy++) {
+        const uint8_t* row = data + cy * stride;
+        for (cx = 0; cx < w; cx++) {
+            fb_pixel(fb, x + cx, y + cy, (row[cx >> 3] >> (7 - (cx & 7))) & 1);
+        }
+    }
+}
+
+//// find the changed column span of each page, returns the dirty byte count
+int fb_diff(const struct fb* cur, const struct fb* shown, struct fb_dirty* dirty) {
+    int page, x0, x1, bytes = 0;
+
+    dirty->pages = 0;
+    for (page = 0; page < FB_PAGES; page++) {
+        const uint8_t* a = cur->pix[page];
+        const uint8_t* b = shown->pix[page];
+
+        dirty->x0[page] = FB_WIDTH - 1;
+        dirty->x1[page] = 0;
+        if (memcmp(a, b, FB_WIDTH) == 0) {
+            continue;
+        }
+        for (x0 = 0; a[x0] == b[x0]; x0++)
+            ;
+        for (x1 = FB_WIDTH - 1; a[x1] == b[x1]; x1--)
+            ;
+        dirty->x0[page] = x0;
+        dirty->x1[page] = x1;
+        dirty->pages++;
+        bytes += x1 - x0 + 1;
+    }
+    return bytes;
+}
@@ -0,0 +1,47 @@
+#ifndef __FB__H__
+#define __FB__H__
+
+#include <stdint.h>
+
+#define FB_WIDTH    128
+#define FB_HEIGHT   64
+#define FB_PAGES    (FB_HEIGHT / 8)
+
+#define FB_BLACK    0
+#define FB_WHITE    1
+#define FB_INVERT   2
+
+/*
+ * Packed 1 bpp framebuffer in SSD1306 GDDRAM order: 8 pages of 128 column
+ * bytes, bit n of a byte is row page*8+n. Blitting page-aligned data is a
+ * plain memcpy/OR and a page row goes to the panel as is.
+ */
+struct fb {
+    uint8_t pix[FB_PAGES][FB_WIDTH];
+};
+
+//// columns [x0, x1] of each page differ from what the panel shows, x0 > x1
+//// means the page is clean
+struct fb_dirty {
+    uint8_t x0[FB_PAGES];
+    uint8_t x1[FB_PAGES];
+    int     pages;      /* number of dirty pages */
+};
+
+extern void fb_clear(struct fb* fb, int color);
+extern void fb_pixel(struct fb* fb, int x, int y, int color);
+extern int  fb_get_pixel(const struct fb* fb, int x, int y);
+extern void fb_hline(struct fb* fb, int x, int y, int w, int color);
+extern void fb_vline(struct fb* fb, int x, int y, int h, int color);
+extern void fb_rect(struct fb* fb, int x, int y, int w, int h, int color);
+extern void fb_fill(struct fb* fb, int x, int y, int w, int h, int color);
+extern void fb_blit_pages(struct fb* fb, int x, int y, int w, int h,
+                          const uint8_t* data);
+extern void fb_blit_rows(struct fb* fb, int x, int y, int w, int h,
+                         const uint8_t* data);
+
+extern int  fb_diff(const struct fb* cur, const struct fb* shown,
+                    struct fb_dirty* dirty);
+
+
+#endif
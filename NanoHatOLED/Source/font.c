@@ -0,0 +1,401 @@
+#include <string.h>
+#include "font.h"
+
+/*
+ * glyphs8 is a 5x8 font, one page per glyph with bit 0 at the top. glyphs16
+ * is the same font scaled to 10x16 with Scale2x, which keeps diagonals
+ * smooth; each glyph is its top page followed by its bottom page.
+ */
+
+
+// ============================================================================
+
+
+static const uint8_t glyphs8[95 * 5] = {
+    0x00, 0x00, 0x00, 0x00, 0x00,    // space
+    0x00, 0x00, 0x5f, 0x00, 0x00,    // !
+    0x00, 0x07, 0x00, 0x07, 0x00,    // "
+    0x14, 0x7f, 0x14, 0x7f, 0x14,    // #
+    0x24, 0x2a, 0x7f, 0x2a, 0x12,    // $
+    0x23, 0x13, 0x08, 0x64, 0x62,    // %
+    0x36, 0x49, 0x56, 0x20, 0x50,    // &
+    0x00, 0x08, 0x07, 0x03, 0x00,    // '
+    0x00, 0x1c, 0x22, 0x41, 0x00,    // (
+    0x00, 0x41, 0x22, 0x1c, 0x00,    // )
+    0x2a, 0x1c, 0x7f, 0x1c, 0x2a,    // *
+    0x08, 0x08, 0x3e, 0x08, 0x08,    // +
+    0x00, 0x80, 0x70, 0x30, 0x00,    // ,
+    0x08, 0x08, 0x08, 0x08, 0x08,    // -
+    0x00, 0x00, 0x60, 0x60, 0x00,    // .
+    0x20, 0x10, 0x08, 0x04, 0x02,    // /
+    0x3e, 0x51, 0x49, 0x45, 0x3e,    // 0
+    0x00, 0x42, 0x7f, 0x40, 0x00,    // 1
+    0x72, 0x49, 0x49, 0x49, 0x46,    // 2
+    0x21, 0x41, 0x49, 0x4d, 0x33,    // 3
+    0x18, 0x14, 0x12, 0x7f, 0x10,    // 4
+    0x27, 0x45, 0x45, 0x45, 0x39,    // 5
+    0x3c, 0x4a, 0x49, 0x49, 0x31,    // 6
+    0x41, 0x21, 0x11, 0x09, 0x07,    // 7
+    0x36, 0x49, 0x49, 0x49, 0x36,    // 8
+    0x46, 0x49, 0x49, 0x29, 0x1e,    // 9
+    0x00, 0x36, 0x36, 0x00, 0x00,    // :
+    0x00, 0x40, 0x34, 0x00, 0x00,    // ;
+    0x00, 0x08, 0x14, 0x22, 0x41,    // <
+    0x14, 0x14, 0x14, 0x14, 0x14,    // =
+    0x00, 0x41, 0x22, 0x14, 0x08,    // >
+    0x02, 0x01, 0x59, 0x09, 0x06,    // ?
+    0x3e, 0x41, 0x5d, 0x59, 0x4e,    // @
+    0x7c, 0x12, 0x11, 0x12, 0x7c,    // A
+    0x7f, 0x49, 0x49, 0x49, 0x36,    // B
+    0x3e, 0x41, 0x41, 0x41, 0x22,    // C
+    0x7f, 0x41, 0x41, 0x41, 0x3e,    // D
+    0x7f, 0x49, 0x49, 0x49, 0x41,    // E
+    0x7f, 0x09, 0x09, 0x09, 0x01,    // F
+    0x3e, 0x41, 0x41, 0x51, 0x73,    // G
+    0x7f, 0x08, 0x08, 0x08, 0x7f,    // H
+    0x00, 0x41, 0x7f, 0x41, 0x00,    // I
+    0x20, 0x40, 0x41, 0x3f, 0x01,    // J
+    0x7f, 0x08, 0x14, 0x22, 0x41,    // K
+    0x7f, 0x40, 0x40, 0x40, 0x40,    // L
+    0x7f, 0x02, 0x1c, 0x02, 0x7f,    // M
+    0x7f, 0x04, 0x08, 0x10, 0x7f,    // N
+    0x3e, 0x41, 0x41, 0x41, 0x3e,    // O
+    0x7f, 0x09, 0x09, 0x09, 0x06,    // P
+    0x3e, 0x41, 0x51, 0x21, 0x5e,    // Q
+    0x7f, 0x09, 0x19, 0x29, 0x46,    // R
+    0x26, 0x49, 0x49, 0x49, 0x32,    // S
+    0x03, 0x01, 0x7f, 0x01, 0x03,    // T
+    0x3f, 0x40, 0x40, 0x40, 0x3f,    // U
+    0x1f, 0x20, 0x40, 0x20, 0x1f,    // V
+    0x3f, 0x40, 0x38, 0x40, 0x3f,    // W
+    0x63, 0x14, 0x08, 0x14, 0x63,    // X
+    0x03, 0x04, 0x78, 0x04, 0x03,    // Y
+    0x61, 0x59, 0x49, 0x4d, 0x43,    // Z
+    0x00, 0x7f, 0x41, 0x41, 0x41,    // [
+    0x02, 0x04, 0x08, 0x10, 0x20,    // backslash
+    0x00, 0x41, 0x41, 0x41, 0x7f,    // ]
+    0x04, 0x02, 0x01, 0x02, 0x04,    // ^
+    0x40, 0x40, 0x40, 0x40, 0x40,    // _
+    0x00, 0x03, 0x07, 0x08, 0x00,    // `
+    0x20, 0x54, 0x54, 0x78, 0x40,    // a
+    0x7f, 0x28, 0x44, 0x44, 0x38,    // b
+    0x38, 0x44, 0x44, 0x44, 0x28,    // c
+    0x38, 0x44, 0x44, 0x28, 0x7f,    // d
+    0x38, 0x54, 0x54, 0x54, 0x18,    // e
+    0x00, 0x08, 0x7e, 0x09, 0x02,    // f
+    0x18, 0xa4, 0xa4, 0x9c, 0x78,    // g
+    0x7f, 0x08, 0x04, 0x04, 0x78,    // h
+    0x00, 0x44, 0x7d, 0x40, 0x00,    // i
+    0x20, 0x40, 0x40, 0x3d, 0x00,    // j
+    0x7f, 0x10, 0x28, 0x44, 0x00,    // k
+    0x00, 0x41, 0x7f, 0x40, 0x00,    // l
+    0x7c, 0x04, 0x78, 0x04, 0x78,    // m
+    0x7c, 0x08, 0x04, 0x04, 0x78,    // n
+    0x38, 0x44, 0x44, 0x44, 0x38,    // o
+    0xfc, 0x18, 0x24, 0x24, 0x18,    // p
+    0x18, 0x24, 0x24, 0x18, 0xfc,    // q
+    0x7c, 0x08, 0x04, 0x04, 0x08,    // r
+    0x48, 0x54, 0x54, 0x54, 0x24,    // s
+    0x04, 0x04, 0x3f, 0x44, 0x24,    // t
+    0x3c, 0x40, 0x40, 0x20, 0x7c,    // u
+    0x1c, 0x20, 0x40, 0x20, 0x1c,    // v
+    0x3c, 0x40, 0x30, 0x40, 0x3c,    // w
+    0x44, 0x28, 0x10, 0x28, 0x44,    // x
+    0x4c, 0x90, 0x90, 0x90, 0x7c,    // y
+    0x44, 0x64, 0x54, 0x4c, 0x44,    // z
+    0x00, 0x08, 0x36, 0x41, 0x00,    // {
+    0x00, 0x00, 0x77, 0x00, 0x00,    // |
+    0x00, 0x41, 0x36, 0x08, 0x00,    // }
+    0x02, 0x01, 0x02, 0x04, 0x02,    // ~
+};
+
+static const uint8_t glyphs16[95 * 20] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // space
+    0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x33, 0x33, 0x00, 0x00, 0x00, 0x00,    // !
+    0x00, 0x00, 0x3f, 0x3f, 0x00, 0x00, 0x3f, 0x3f, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // "
+    0x30, 0x38, 0xff, 0xff, 0x30, 0x30, 0xff, 0xff, 0x38, 0x30,
+    0x03, 0x07, 0x3f, 0x3f, 0x03, 0x03, 0x3f, 0x3f, 0x07, 0x03,    // #
+    0x30, 0x78, 0xcc, 0xce, 0xff, 0xff, 0xce, 0xcc, 0x8c, 0x0c,
+    0x0c, 0x0c, 0x0c, 0x1c, 0x3f, 0x3f, 0x1c, 0x0c, 0x07, 0x03,    // $
+    0x06, 0x0f, 0x0f, 0x86, 0xc0, 0xe0, 0x70, 0x38, 0x1c, 0x0c,
+    0x0c, 0x0e, 0x07, 0x03, 0x01, 0x00, 0x18, 0x3c, 0x3c, 0x18,    // %
+    0x3c, 0x3e, 0xc3, 0xc3, 0x3e, 0x3c, 0x00, 0x00, 0x00, 0x00,
+    0x0f, 0x1f, 0x38, 0x30, 0x33, 0x33, 0x0c, 0x0c, 0x33, 0x33,    // &
+    0x00, 0x00, 0xc0, 0xe0, 0x7e, 0x3f, 0x1f, 0x06, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // '
+    0x00, 0x00, 0xf0, 0xf8, 0x1c, 0x0e, 0x07, 0x03, 0x00, 0x00,
+    0x00, 0x00, 0x03, 0x07, 0x0e, 0x1c, 0x38, 0x30, 0x00, 0x00,    // (
+    0x00, 0x00, 0x03, 0x07, 0x0e, 0x1c, 0xf8, 0xf0, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x38, 0x1c, 0x0e, 0x07, 0x03, 0x00, 0x00,    // )
+    0xcc, 0xcc, 0xe0, 0xf0, 0xff, 0xff, 0xf0, 0xe0, 0xcc, 0xcc,
+    0x0c, 0x0c, 0x01, 0x03, 0x3f, 0x3f, 0x03, 0x01, 0x0c, 0x0c,    // *
+    0xc0, 0xc0, 0xc0, 0xe0, 0xfc, 0xfc, 0xe0, 0xc0, 0xc0, 0xc0,
+    0x00, 0x00, 0x00, 0x01, 0x0f, 0x0f, 0x01, 0x00, 0x00, 0x00,    // +
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0xc0, 0xe0, 0x7e, 0x3f, 0x1f, 0x06, 0x00, 0x00,    // ,
+    0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // -
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x18, 0x3c, 0x3c, 0x18, 0x00, 0x00,    // .
+    0x00, 0x00, 0x00, 0x80, 0xc0, 0xe0, 0x70, 0x38, 0x1c, 0x0c,
+    0x0c, 0x0e, 0x07, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,    // /
+    0xfc, 0xfe, 0x07, 0x03, 0xc3, 0xe3, 0x33, 0x33, 0xfe, 0xfc,
+    0x0f, 0x1f, 0x33, 0x33, 0x31, 0x30, 0x30, 0x38, 0x1f, 0x0f,    // 0
+    0x00, 0x00, 0x0c, 0x1e, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x38, 0x3f, 0x3f, 0x38, 0x30, 0x00, 0x00,    // 1
+    0x0c, 0x8e, 0xc7, 0xc3, 0xc3, 0xc3, 0xc3, 0xe7, 0x7e, 0x3c,
+    0x1f, 0x3f, 0x39, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,    // 2
+    0x03, 0x03, 0x03, 0x03, 0xc3, 0xe3, 0xf3, 0x73, 0x9f, 0x0e,
+    0x0c, 0x1c, 0x38, 0x30, 0x30, 0x30, 0x30, 0x39, 0x1f, 0x0f,    // 3
+    0xc0, 0xe0, 0x30, 0x38, 0x0c, 0x8e, 0xff, 0xff, 0x80, 0x00,
+    0x01, 0x03, 0x03, 0x03, 0x03, 0x07, 0x3f, 0x3f, 0x07, 0x03,    // 4
+    0x1e, 0x3f, 0x33, 0x33, 0x33, 0x33, 0x33, 0x73, 0xe3, 0xc3,
+    0x0c, 0x1c, 0x38, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1f, 0x0f,    // 5
+    0xf0, 0xf8, 0xcc, 0xce, 0xc7, 0xc3, 0xc3, 0xc3, 0x83, 0x03,
+    0x0f, 0x1f, 0x39, 0x30, 0x30, 0x30, 0x30, 0x39, 0x1f, 0x0f,    // 6
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x83, 0xc3, 0xe7, 0x7f, 0x3e,
+    0x30, 0x38, 0x1c, 0x0e, 0x07, 0x03, 0x01, 0x00, 0x00, 0x00,    // 7
+    0x3c, 0x3e, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xe7, 0x3e, 0x3c,
+    0x0f, 0x1f, 0x39, 0x30, 0x30, 0x30, 0x30, 0x39, 0x1f, 0x0f,    // 8
+    0x3c, 0x7e, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xe7, 0xfe, 0xfc,
+    0x30, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1c, 0x0c, 0x07, 0x03,    // 9
+    0x00, 0x00, 0x18, 0x3c, 0x3c, 0x18, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x06, 0x0f, 0x0f, 0x06, 0x00, 0x00, 0x00, 0x00,    // :
+    0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x38, 0x1f, 0x0f, 0x00, 0x00, 0x00, 0x00,    // ;
+    0x00, 0x00, 0xc0, 0xe0, 0x30, 0x38, 0x1c, 0x0e, 0x07, 0x03,
+    0x00, 0x00, 0x00, 0x01, 0x03, 0x07, 0x0e, 0x1c, 0x38, 0x30,    // <
+    0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,    // =
+    0x00, 0x00, 0x03, 0x07, 0x0e, 0x1c, 0x38, 0x30, 0xe0, 0xc0,
+    0x00, 0x00, 0x30, 0x38, 0x1c, 0x0e, 0x07, 0x03, 0x01, 0x00,    // >
+    0x0c, 0x0e, 0x07, 0x03, 0x83, 0xc3, 0xc3, 0xe7, 0x7e, 0x3c,
+    0x00, 0x00, 0x00, 0x00, 0x33, 0x33, 0x01, 0x00, 0x00, 0x00,    // ?
+    0xfc, 0xfe, 0x07, 0x03, 0xf3, 0xf3, 0xc3, 0xc7, 0xfe, 0x7c,
+    0x0f, 0x1f, 0x38, 0x30, 0x31, 0x33, 0x33, 0x31, 0x31, 0x30,    // @
+    0xf0, 0xf8, 0x9c, 0x0e, 0x03, 0x03, 0x0e, 0x9c, 0xf8, 0xf0,
+    0x3f, 0x3f, 0x07, 0x03, 0x03, 0x03, 0x03, 0x07, 0x3f, 0x3f,    // A
+    0xfe, 0xff, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xe7, 0x3e, 0x3c,
+    0x1f, 0x3f, 0x39, 0x30, 0x30, 0x30, 0x30, 0x39, 0x1f, 0x0f,    // B
+    0xfc, 0xfe, 0x07, 0x03, 0x03, 0x03, 0x03, 0x07, 0x0e, 0x0c,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1c, 0x0c,    // C
+    0xfe, 0xff, 0x07, 0x03, 0x03, 0x03, 0x03, 0x07, 0xfe, 0xfc,
+    0x1f, 0x3f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1f, 0x0f,    // D
+    0xfe, 0xff, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0x03, 0x03,
+    0x1f, 0x3f, 0x39, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,    // E
+    0xfe, 0xff, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0x03, 0x03,
+    0x3f, 0x3f, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // F
+    0xfc, 0xfe, 0x07, 0x03, 0x03, 0x03, 0x03, 0x07, 0x0f, 0x0e,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x30, 0x33, 0x33, 0x3f, 0x1e,    // G
+    0xff, 0xff, 0xe0, 0xc0, 0xc0, 0xc0, 0xc0, 0xe0, 0xff, 0xff,
+    0x3f, 0x3f, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, 0x3f, 0x3f,    // H
+    0x00, 0x00, 0x03, 0x07, 0xff, 0xff, 0x07, 0x03, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x38, 0x3f, 0x3f, 0x38, 0x30, 0x00, 0x00,    // I
+    0x00, 0x00, 0x00, 0x00, 0x03, 0x07, 0xff, 0xff, 0x07, 0x03,
+    0x0c, 0x1c, 0x38, 0x30, 0x30, 0x38, 0x1f, 0x0f, 0x00, 0x00,    // J
+    0xff, 0xff, 0xc0, 0xc0, 0x30, 0x38, 0x1c, 0x0e, 0x07, 0x03,
+    0x3f, 0x3f, 0x00, 0x00, 0x03, 0x07, 0x0e, 0x1c, 0x38, 0x30,    // K
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x1f, 0x3f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,    // L
+    0xff, 0xff, 0x0e, 0x0c, 0xf0, 0xf0, 0x0c, 0x0e, 0xff, 0xff,
+    0x3f, 0x3f, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x3f, 0x3f,    // M
+    0xff, 0xff, 0x38, 0x30, 0xe0, 0xc0, 0x00, 0x00, 0xff, 0xff,
+    0x3f, 0x3f, 0x00, 0x00, 0x00, 0x01, 0x03, 0x07, 0x3f, 0x3f,    // N
+    0xfc, 0xfe, 0x07, 0x03, 0x03, 0x03, 0x03, 0x07, 0xfe, 0xfc,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1f, 0x0f,    // O
+    0xfe, 0xff, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xe7, 0x7e, 0x3c,
+    0x3f, 0x3f, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // P
+    0xfc, 0xfe, 0x07, 0x03, 0x03, 0x03, 0x03, 0x07, 0xfe, 0xfc,
+    0x0f, 0x1f, 0x38, 0x30, 0x33, 0x33, 0x0c, 0x0c, 0x33, 0x33,    // Q
+    0xfe, 0xff, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xe7, 0x7e, 0x3c,
+    0x3f, 0x3f, 0x00, 0x00, 0x03, 0x07, 0x0c, 0x1c, 0x38, 0x30,    // R
+    0x3c, 0x7e, 0xe7, 0xc3, 0xc3, 0xc3, 0xc3, 0xc7, 0x8e, 0x0c,
+    0x0c, 0x1c, 0x38, 0x30, 0x30, 0x30, 0x30, 0x39, 0x1f, 0x0f,    // S
+    0x0e, 0x0f, 0x03, 0x03, 0xff, 0xff, 0x03, 0x03, 0x0f, 0x0e,
+    0x00, 0x00, 0x00, 0x00, 0x3f, 0x3f, 0x00, 0x00, 0x00, 0x00,    // T
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1f, 0x0f,    // U
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff,
+    0x03, 0x07, 0x0e, 0x1c, 0x30, 0x30, 0x1c, 0x0e, 0x07, 0x03,    // V
+    0xff, 0xff, 0x00, 0x00, 0xc0, 0xc0, 0x00, 0x00, 0xff, 0xff,
+    0x0f, 0x1f, 0x30, 0x30, 0x0f, 0x0f, 0x30, 0x30, 0x1f, 0x0f,    // W
+    0x0f, 0x1f, 0x38, 0x30, 0xc0, 0xc0, 0x30, 0x38, 0x1f, 0x0f,
+    0x3c, 0x3e, 0x07, 0x03, 0x00, 0x00, 0x03, 0x07, 0x3e, 0x3c,    // X
+    0x0f, 0x1f, 0x38, 0x70, 0xc0, 0xc0, 0x70, 0x38, 0x1f, 0x0f,
+    0x00, 0x00, 0x00, 0x00, 0x3f, 0x3f, 0x00, 0x00, 0x00, 0x00,    // Y
+    0x03, 0x03, 0x83, 0xc3, 0xc3, 0xe3, 0xf3, 0x73, 0x1f, 0x0e,
+    0x1c, 0x3e, 0x33, 0x33, 0x31, 0x30, 0x30, 0x30, 0x30, 0x30,    // Z
+    0x00, 0x00, 0xfe, 0xff, 0x07, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x00, 0x00, 0x1f, 0x3f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x30,    // [
+    0x0c, 0x1c, 0x38, 0x70, 0xe0, 0xc0, 0x80, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x03, 0x07, 0x0e, 0x0c,    // backslash
+    0x00, 0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x07, 0xff, 0xfe,
+    0x00, 0x00, 0x30, 0x30, 0x30, 0x30, 0x30, 0x38, 0x3f, 0x1f,    // ]
+    0x30, 0x38, 0x1c, 0x0e, 0x03, 0x03, 0x0e, 0x1c, 0x38, 0x30,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // ^
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,    // _
+    0x00, 0x00, 0x06, 0x1f, 0x3f, 0x7e, 0xe0, 0xc0, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // `
+    0x00, 0x00, 0x30, 0x30, 0x30, 0x30, 0xe0, 0xc0, 0x00, 0x00,
+    0x0c, 0x1e, 0x33, 0x33, 0x33, 0x33, 0x3f, 0x3f, 0x38, 0x30,    // a
+    0xff, 0xff, 0xc0, 0xc0, 0x70, 0x30, 0x30, 0x70, 0xe0, 0xc0,
+    0x3f, 0x3f, 0x0c, 0x0c, 0x38, 0x30, 0x30, 0x38, 0x1f, 0x0f,    // b
+    0xc0, 0xe0, 0x70, 0x30, 0x30, 0x30, 0x30, 0x70, 0xe0, 0xc0,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1c, 0x0c,    // c
+    0xc0, 0xe0, 0x70, 0x30, 0x30, 0x70, 0xc0, 0xc0, 0xff, 0xff,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x38, 0x0c, 0x0c, 0x3f, 0x3f,    // d
+    0xc0, 0xe0, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0xe0, 0xc0,
+    0x0f, 0x1f, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x03, 0x01,    // e
+    0x00, 0x00, 0xc0, 0xe0, 0xfc, 0xfe, 0xe3, 0xc3, 0x0e, 0x0c,
+    0x00, 0x00, 0x00, 0x01, 0x3f, 0x3f, 0x01, 0x00, 0x00, 0x00,    // f
+    0xc0, 0xe0, 0x70, 0x30, 0x30, 0x70, 0xf0, 0xe0, 0xe0, 0x80,
+    0x03, 0x07, 0xce, 0xcc, 0xcc, 0xce, 0xc1, 0xe3, 0x7f, 0x3f,    // g
+    0xff, 0xff, 0xc0, 0xc0, 0x70, 0x30, 0x30, 0x70, 0xe0, 0xc0,
+    0x3f, 0x3f, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3f, 0x3f,    // h
+    0x00, 0x00, 0x30, 0x70, 0xf3, 0xe3, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x38, 0x3f, 0x3f, 0x38, 0x30, 0x00, 0x00,    // i
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf3, 0xf3, 0x00, 0x00,
+    0x0c, 0x1c, 0x38, 0x30, 0x30, 0x38, 0x1f, 0x0f, 0x00, 0x00,    // j
+    0xff, 0xff, 0x00, 0x00, 0xc0, 0xe0, 0x70, 0x30, 0x00, 0x00,
+    0x3f, 0x3f, 0x03, 0x03, 0x0c, 0x1c, 0x38, 0x30, 0x00, 0x00,    // k
+    0x00, 0x00, 0x03, 0x07, 0xff, 0xfe, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x38, 0x3f, 0x3f, 0x38, 0x30, 0x00, 0x00,    // l
+    0xe0, 0xf0, 0x30, 0x30, 0xc0, 0xc0, 0x30, 0x30, 0xe0, 0xc0,
+    0x3f, 0x3f, 0x00, 0x00, 0x3f, 0x3f, 0x00, 0x00, 0x3f, 0x3f,    // m
+    0xf0, 0xf0, 0xc0, 0xc0, 0x70, 0x30, 0x30, 0x70, 0xe0, 0xc0,
+    0x3f, 0x3f, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3f, 0x3f,    // n
+    0xc0, 0xe0, 0x70, 0x30, 0x30, 0x30, 0x30, 0x70, 0xe0, 0xc0,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x30, 0x30, 0x38, 0x1f, 0x0f,    // o
+    0xf0, 0xf0, 0xc0, 0x80, 0x70, 0x30, 0x30, 0x70, 0xe0, 0xc0,
+    0xff, 0xff, 0x03, 0x01, 0x0e, 0x0c, 0x0c, 0x0e, 0x07, 0x03,    // p
+    0xc0, 0xe0, 0x70, 0x30, 0x30, 0x70, 0x80, 0xc0, 0xf0, 0xf0,
+    0x03, 0x07, 0x0e, 0x0c, 0x0c, 0x0e, 0x01, 0x03, 0xff, 0xff,    // q
+    0xf0, 0xf0, 0xc0, 0xc0, 0x70, 0x30, 0x30, 0x70, 0xe0, 0xc0,
+    0x3f, 0x3f, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // r
+    0xc0, 0xe0, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,
+    0x30, 0x31, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x1e, 0x0c,    // s
+    0x30, 0x30, 0x30, 0x78, 0xff, 0xff, 0x78, 0x30, 0x30, 0x30,
+    0x00, 0x00, 0x00, 0x00, 0x0f, 0x1f, 0x30, 0x30, 0x1c, 0x0c,    // t
+    0xf0, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0xf0,
+    0x0f, 0x1f, 0x38, 0x30, 0x30, 0x38, 0x0c, 0x0e, 0x3f, 0x3f,    // u
+    0xf0, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0xf0,
+    0x03, 0x07, 0x0e, 0x1c, 0x30, 0x30, 0x1c, 0x0e, 0x07, 0x03,    // v
+    0xf0, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0xf0,
+    0x0f, 0x1f, 0x30, 0x30, 0x0f, 0x0f, 0x30, 0x30, 0x1f, 0x0f,    // w
+    0x30, 0x70, 0xe0, 0xc0, 0x00, 0x00, 0xc0, 0xe0, 0x70, 0x30,
+    0x30, 0x38, 0x1c, 0x0c, 0x03, 0x03, 0x0c, 0x1c, 0x38, 0x30,    // x
+    0xf0, 0xf0, 0x80, 0x00, 0x00, 0x00, 0x00, 0x80, 0xf0, 0xf0,
+    0x30, 0x71, 0xe3, 0xc3, 0xc3, 0xc3, 0xc3, 0xe7, 0x7f, 0x3f,    // y
+    0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0xf0, 0xf0, 0x70, 0x30,
+    0x30, 0x38, 0x3c, 0x3e, 0x33, 0x33, 0x31, 0x30, 0x30, 0x30,    // z
+    0x00, 0x00, 0xc0, 0xe0, 0x3c, 0x3e, 0x07, 0x03, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x0f, 0x1f, 0x38, 0x30, 0x00, 0x00,    // {
+    0x00, 0x00, 0x00, 0x00, 0x3f, 0x3f, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x3f, 0x3f, 0x00, 0x00, 0x00, 0x00,    // |
+    0x00, 0x00, 0x03, 0x07, 0x3e, 0x3c, 0xe0, 0xc0, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x38, 0x1f, 0x0f, 0x01, 0x00, 0x00, 0x00,    // }
+    0x0c, 0x0e, 0x03, 0x03, 0x0e, 0x1c, 0x30, 0x30, 0x1c, 0x0c,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,    // ~
+};
+
+const struct font font8 = { 5, 8, 6, ' ', 95, glyphs8 };
+const struct font font16 = { 10, 16, 12, ' ', 95, glyphs16 };
+
+
+// ============================================================================
+
+
+static const uint8_t* glyph(const struct font* font, unsigned char c) {
+    if (c < font->first || c >= font->first + font->count) {
+        c = '?';
+    }
+    return font->glyphs + (c - font->first) * font->width * (font->height / 8);
+}
+
+//// one character cell (glyph plus spacing columns) in page layout
+static void make_cell(const struct font* font, unsigned char c, int color,
+                      uint8_t* cell) {
+    const uint8_t* g = glyph(font, c);
+    int pages = font->height / 8;
+    int p, i;
+
+    for (p = 0; p < pages; p++) {
+        uint8_t* row = cell + p * font->advance;
+        memcpy(row, g + p * font->width, font->width);
+        memset(row + font->width, 0, font->advance - font->width);
+        if (color == FB_BLACK) {
+            for (i = 0; i < font->advance; i++) {
+                row[i] = ~row[i];
+            }
+        }
+    }
+}
+
+
+// ============================================================================
+
+
+const struct font* font_by_height(int height) {
+    return (height >= 16) ? &font16 : &font8;
+}
+
+int font_text_width(const struct font* font, const char* text) {
+    return strlen(text) * font->advance;
+}
+
+//// draw text with opaque cells (FB_WHITE on black, FB_BLACK inverted) so a
+//// redraw over older text needs no clear, returns the x after the text
+int font_draw(struct fb* fb, int x, int y, const struct font* font,
+              const char* text, int color) {
+    uint8_t cell[FONT_MAX_PAGES * 16];
+
+    for (; *text && x < FB_WIDTH; text++, x += font->advance) {
+        make_cell(font, *text, color, cell);
+        fb_blit_pages(fb, x, y, font->advance, font->height, cell);
+    }
+    return x;
+}
+
+int text_cache_valid(const struct text_cache* cache, long key) {
+    return cache->valid && cache->key == key;
+}
+
+//// rasterize text into the cache, nothing is done if it didn't change
+void text_cache_set(struct text_cache* cache, const struct font* font,
+                    long key, const char* text) {
+    uint8_t cell[FONT_MAX_PAGES * 16];
+    int pages = font->height / 8;
+    int n, i, p;
+
+    cache->key = key;
+    if (cache->valid && cache->font == font && !strcmp(cache->text, text)) {
+        return;
+    }
+    strncpy(cache->text, text, TEXT_CACHE_LEN - 1);
+    cache->text[TEXT_CACHE_LEN - 1] = '\0';
+    cache->font = font;
+
+    n = strlen(cache->text);
+    if (n * font->advance > FB_WIDTH) {
+        n = FB_WIDTH / font->advance;
+    }
+    cache->width = n * font->advance;
+    for (i = 0; i < n; i++) {
+        make_cell(font, cache->text[i], FB_WHITE, cell);
+        for (p = 0; p < pages; p++) {
+            memcpy(cache->strip + p * cache->width + i * font->advance,
+                    cell + p * font->advance, font->advance);
+        }
+    }
+    cache->valid = 1;
+}
+
+void text_cache_draw(const struct text_cache* cache, struct fb* fb, int x, int y) {
+    if (cache->valid) {
+        fb_blit_pages(fb, x, y, cache->width, cache->font->height, cache->strip);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef __FONT__H__
+#define __FONT__H__
+
+#include <stdint.h>
+#include "fb.h"
+
+#define FONT_MAX_PAGES  2
+#define TEXT_CACHE_LEN  32
+
+//// fixed-size bitmap font, glyphs in framebuffer page layout: each glyph is
+//// height/8 pages of width column bytes, so a page-aligned glyph is a memcpy
+struct font {
+    uint8_t         width;      /* glyph columns */
+    uint8_t         height;     /* rows, a multiple of 8 */
+    uint8_t         advance;    /* columns per character cell */
+    uint8_t         first;      /* first character in the table */
+    uint8_t         count;
+    const uint8_t*  glyphs;
+};
+
+//// a string rendered once; key picks the slot (draw_text uses the text's
+//// position), text_cache_set rasterizes again only when the string differs
+struct text_cache {
+    int                 valid;
+    long                key;
+    const struct font*  font;
+    int                 width;
+    char                text[TEXT_CACHE_LEN];
+    uint8_t             strip[FONT_MAX_PAGES * FB_WIDTH];  /* pages of width bytes */
+};
+
+extern const struct font font8;
+extern const struct font font16;
+
+extern const struct font* font_by_height(int height);
+extern int  font_text_width(const struct font* font, const char* text);
+extern int  font_draw(struct fb* fb, int x, int y, const struct font* font,
+                      const char* text, int color);
+
+extern int  text_cache_valid(const struct text_cache* cache, long key);
+extern void text_cache_set(struct text_cache* cache, const struct font* font,
+                           long key, const char* text);
+extern void text_cache_draw(const struct text_cache* cache, struct fb* fb,
+                            int x, int y);
+
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "gesture.h"
+#include "evring.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static struct gesture_key keys[GESTURE_MAX_KEYS];
+static int nkeys = 0;
+static gesture_handler emit = NULL;
+static struct timer due = { { -1, NULL, NULL } };
+static int manual = 0;              /* gesture_virtual(): no timer */
+
+
+//// arm the timer for the earliest deadline of any key
+static void rearm() {
+    uint64_t next, now;
+
+    if (manual || due.src.fd < 0) {
+        return;
+    }
+    next = gesture_next();
+    if (next == 0) {
+        timer_stop(&due);
+        return;
+    }
+    now = clock_ns(CLOCK_MONOTONIC);
+    timer_oneshot(&due, next > now ? next - now : 1);
+}
+
+static uint32_t ms_between(uint64_t from_ns, uint64_t to_ns) {
+    return to_ns > from_ns ? (uint32_t)((to_ns - from_ns) / NSEC_PER_MSEC) : 0;
+}
+
+static void accept(struct gesture_key* k, int level, uint64_t ts) {
+    const struct gesture_config* cfg = k->cfg;
+
+    k->level = level;
+    k->changed_ns = ts;
+    if (cfg->debounce_ms) {
+        k->settle_at = ts + cfg->debounce_ms * NSEC_PER_MSEC;
+    }
+
+    if (!level) {
+        k->hold_at = 0;
+        emit(k->key, EVRING_KEY_UP, ts, ms_between(k->pressed_ns, ts));
+        return;
+    }
+
+    k->pressed_ns = ts;
+    k->repeats = 0;
+    emit(k->key, EVRING_KEY_DOWN, ts, 0);
+    if (cfg->double_ms && k->last_press_ns &&
+            ts - k->last_press_ns <= cfg->double_ms * NSEC_PER_MSEC) {
+        emit(k->key, EVRING_KEY_DOUBLE, ts, ms_between(k->last_press_ns, ts));
+        k->last_press_ns = 0;
+    } else {
+        k->last_press_ns = ts;
+    }
+    if (cfg->long_ms) {
+        k->hold_at = ts + cfg->long_ms * NSEC_PER_MSEC;
+    }
+}
+
+//// the debounce window closed, catch up with where the contact settled
+static void settle_expired(struct gesture_key* k, uint64_t at) {
+    k->settle_at = 0;
+    if (k->raw != k->level) {
+        accept(k, k->raw, at);
+    }
+}
+
+//// held for long_ms, then every repeat_ms
+static void hold_expired(struct gesture_key* k, uint64_t at) {
+    k->hold_at = 0;
+    if (!k->level) {
+        return;
+    }
+    if (k->repeats == 0) {
+        emit(k->key, EVRING_KEY_LONG, at, ms_between(k->pressed_ns, at));
+    } else {
+        emit(k->key, EVRING_KEY_REPEAT, at, k->repeats);
+    }
+    k->repeats++;
+    // a long press is not the first half of a double press
+    k->last_press_ns = 0;
+    if (k->cfg->repeat_ms) {
+        k->hold_at = at + k->cfg->repeat_ms * NSEC_PER_MSEC;
+    }
+}
+
+static void due_expired(struct timer* t, uint64_t expirations) {
+    gesture_expire(clock_ns(CLOCK_MONOTONIC));
+}
+
+//// run the deadlines up to now, the earliest first
+static void run_due(uint64_t now) {
+    struct gesture_key *k, *first;
+    uint64_t at;
+    int i, settle;
+
+    for (;;) {
+        first = NULL;
+        at = 0;
+        settle = 0;
+        for (i = 0; i < nkeys; i++) {
+            k = &keys[i];
+            if (k->settle_at && k->settle_at <= now && (first == NULL || k->settle_at < at)) {
+                first = k;
+                at = k->settle_at;
+                settle = 1;
+            }
+            if (k->hold_at && k->hold_at <= now && (first == NULL || k->hold_at < at)) {
+                first = k;
+                at = k->hold_at;
+                settle = 0;
+            }
+        }
+        if (first == NULL) {
+            return;
+        }
+        if (settle) {
+            settle_expired(first, at);
+        } else {
+            hold_expired(first, at);
+        }
+    }
+}
+
+
+// ============================================================================
+
+
+//// set up one state machine per key, the loop must be initialized
+int gesture_init(const struct gesture_config* cfg, int n, gesture_handler handler) {
+    int i;
+
+    if (n > GESTURE_MAX_KEYS) {
+        n = GESTURE_MAX_KEYS;
+    }
+    emit = handler;
+    for (i = 0; i < n; i++) {
+        memset(&keys[i], 0, sizeof(keys[i]));
+        keys[i].cfg = &cfg[i];
+        keys[i].key = i;
+    }
+    nkeys = n;
+    if (!manual && timer_init(&due, CLOCK_MONOTONIC, due_expired, NULL) != 0) {
+        gesture_close();
+        return -1;
+    }
+    return 0;
+}
+
+//// feed one raw edge
+void gesture_edge(const struct gpio_event* ev) {
+    struct gesture_key* k;
+
+    if (ev->key < 0 || ev->key >= nkeys) {
+        return;
+    }
+    // a deadline the timer hasn't run yet came before this edge
+    run_due(ev->timestamp_ns);
+    k = &keys[ev->key];
+    k->raw = (ev->edge == GPIO_EDGE_RISING);
+    if (k->changed_ns && ev->timestamp_ns < k->changed_ns +
+            k->cfg->debounce_ms * NSEC_PER_MSEC) {
+        // bounce, settle_expired() looks at raw once the window closes
+        rearm();
+        return;
+    }
+    if (k->raw != k->level) {
+        accept(k, k->raw, ev->timestamp_ns);
+    }
+    rearm();
+}
+
+//// run every deadline up to now_ns (CLOCK_MONOTONIC, or the replay's clock)
+void gesture_expire(uint64_t now_ns) {
+    run_due(now_ns);
+    rearm();
+}
+
+//// the earliest deadline of any key, 0 if there is none
+uint64_t gesture_next() {
+    uint64_t next = 0;
+    int i;
+
+    for (i = 0; i < nkeys; i++) {
+        if (keys[i].settle_at && (next == 0 || keys[i].settle_at < next)) {
+            next = keys[i].settle_at;
+        }
+        if (keys[i].hold_at && (next == 0 || keys[i].hold_at < next)) {
+            next = keys[i].hold_at;
+        }
+    }
+    return next;
+}
+
+//// from the next gesture_init on, deadlines run only in gesture_expire()
+void gesture_virtual() {
+    manual = 1;
+}
+
+void gesture_close() {
+    timer_close(&due);
+    nkeys = 0;
+}
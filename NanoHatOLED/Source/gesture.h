@@ -0,0 +1,62 @@
+#ifndef __GESTURE__H__
+#define __GESTURE__H__
+
+#include <stdint.h>
+#include "gpio.h"
+#include "timer.h"
+
+#define GESTURE_DEBOUNCE_MS 20
+#define GESTURE_LONG_MS     800
+#define GESTURE_REPEAT_MS   150
+#define GESTURE_DOUBLE_MS   300
+#define GESTURE_MAX_KEYS    16      /* over all gpio banks */
+
+//// per-key timing, a zero long_ms, repeat_ms or double_ms disables that gesture
+struct gesture_config {
+    unsigned int    debounce_ms;
+    unsigned int    long_ms;
+    unsigned int    repeat_ms;      /* after a long press, while held */
+    unsigned int    double_ms;      /* press to press */
+};
+
+//// kind is one of EVRING_KEY_*, timestamp_ns is CLOCK_MONOTONIC
+typedef void (*gesture_handler)(int key, int kind, uint64_t timestamp_ns,
+                                uint32_t value);
+
+/*
+ * Debouncing acts on the leading edge: the first edge after a quiet period
+ * is a transition right away, edges within debounce_ms of it are bounce.
+ * When the window closes the last level seen is compared with the accepted
+ * one, so a contact that settled the other way still yields its transition.
+ *
+ * Time moves only with the edges' timestamps and gesture_expire(): the
+ * settle and hold deadlines of all keys are run in time order, each with
+ * its own deadline as the event's timestamp, and an edge runs the
+ * deadlines up to its timestamp before it is looked at. In the daemon one
+ * timer calls gesture_expire() at the earliest deadline; after
+ * gesture_virtual() nothing does, and a replay (replay.c) drives the
+ * engine on a clock of its own, with the same events however fast it goes.
+ */
+struct gesture_key {
+    const struct gesture_config* cfg;
+    int             key;
+    int             raw;            /* level of the newest edge */
+    int             level;          /* debounced level, 1 = pressed */
+    uint64_t        changed_ns;     /* last accepted transition */
+    uint64_t        pressed_ns;
+    uint64_t        last_press_ns;  /* candidate first half of a double press */
+    uint32_t        repeats;
+    uint64_t        settle_at;      /* deadlines, 0: none */
+    uint64_t        hold_at;
+};
+
+extern int  gesture_init(const struct gesture_config* cfg, int nkeys,
+                         gesture_handler handler);
+extern void gesture_edge(const struct gpio_event* ev);
+extern void gesture_expire(uint64_t now_ns);
+extern uint64_t gesture_next();
+extern void gesture_virtual();
+extern void gesture_close();
+
+
+#endif
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "gpio.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+// ============================================================================
+// sysfs backend: one /sys/class/gpio/gpioN/value fd per line
+
+
+static void sysfs_write(const char* path, const char* value) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        // EBUSY on export: the line was exported already
+        if (write(fd, value, strlen(value)) < 0 && errno != EBUSY) {
+            log_msg(LOGLVL_DEBUG, "%s: %s\n", path, strerror(errno));
+        }
+        close(fd);
+    }
+}
+
+//// export one gpio and open its value fd
+static int sysfs_open_line(int gpio, const char* edge) {
+    char path[42];
+    char num[12];
+    int fd;
+
+    // export gpio to userspace
+    sprintf(num, "%d", gpio);
+    sysfs_write("/sys/class/gpio/export", num);
+
+    // set input direction
+    sprintf(path, "/sys/class/gpio/gpio%d/direction", gpio);
+    sysfs_write(path, "in");
+
+    sprintf(path, "/sys/class/gpio/gpio%d/edge", gpio);
+    sysfs_write(path, edge);
+
+    sprintf(path, "/sys/class/gpio/gpio%d/value", gpio);
+    fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        log2file("open of gpio %d returned %d: %s\n",
+                gpio, fd, strerror(errno));
+    }
+    return fd;
+}
+
+static void sysfs_close(struct gpio_bank* bank) {
+    char num[12];
+    int i;
+
+    for (i = 0; i < bank->nfds; i++) {
+        close(bank->fds[i]);
+        sprintf(num, "%d", bank->lines[i]);
+        sysfs_write("/sys/class/gpio/unexport", num);
+    }
+    bank->nfds = 0;
+}
+
+static int sysfs_open(struct gpio_bank* bank) {
+    const char* edge;
+    char num[12];
+    int i;
+
+    if (bank->edges == GPIO_EDGE_BOTH) {
+        edge = "both";
+    } else if (bank->edges == GPIO_EDGE_FALLING) {
+        edge = "falling";
+    } else {
+        edge = "rising";
+    }
+
+    for (i = 0; i < bank->nlines; i++) {
+        bank->fds[i] = sysfs_open_line(bank->lines[i], edge);
+        if (bank->fds[i] < 0) {
+            // give back the lines opened so far, and this one's export
+            sprintf(num, "%d", bank->lines[i]);
+            sysfs_write("/sys/class/gpio/unexport", num);
+            bank->nfds = i;
+            sysfs_close(bank);
+            return -1;
+        }
+    }
+    bank->nfds = bank->nlines;
+    return 0;
+}
+
+//// sysfs only reports the current level, so the edge is derived from it
+static int sysfs_read(struct gpio_bank* bank, int fd,
+                      struct gpio_event* ev, int max) {
+    char ch;
+    int i, level;
+
+    if (max < 1) {
+        return 0;
+    }
+    for (i = 0; i < bank->nfds; i++) {
+        if (bank->fds[i] == fd) {
+            break;
+        }
+    }
+    if (i == bank->nfds) {
+        return -1;
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    if (read(fd, &ch, 1) <= 0) {
+        return -1;
+    }
+    level = ch == '1';
+    // one notification per wakeup however many edges came in; the same
+    // level as last time means an even number of them went by unseen
+    if (level == bank->levels[i]) {
+        bank->overruns++;
+        bank->lost += 2;
+    }
+    bank->levels[i] = level;
+    ev->key = i;
+    ev->edge = level ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+    ev->timestamp_ns = monotonic_ns();
+    ev->seqno = 0;
+    return 1;
+}
+
+const struct gpio_backend gpio_backend_sysfs = {
+    "sysfs", sysfs_open, sysfs_read, sysfs_close
+};
+
+
+// ============================================================================
+// character device backend: all lines in one v2 line request fd, the kernel
+// queues edges with CLOCK_MONOTONIC timestamps so they can be read in batches
+
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+static int cdev_open(struct gpio_bank* bank) {
+    struct gpio_v2_line_request req;
+    int chipfd, i;
+
+    chipfd = open(bank->chip, O_RDWR | O_CLOEXEC);
+    if (chipfd < 0) {
+        log2file("open of %s returned %d: %s\n",
+                bank->chip, chipfd, strerror(errno));
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    for (i = 0; i < bank->nlines; i++) {
+        req.offsets[i] = bank->lines[i];
+    }
+    req.num_lines = bank->nlines;
+    req.event_buffer_size = GPIO_EVENT_BATCH * bank->nlines;
+    strncpy(req.consumer, "nanohat-oled", sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+    if (bank->edges & GPIO_EDGE_RISING) {
+        req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    }
+    if (bank->edges & GPIO_EDGE_FALLING) {
+        req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    }
+
+    if (ioctl(chipfd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+        log2file("line request on %s failed: %s\n",
+                bank->chip, strerror(errno));
+        close(chipfd);
+        return -1;
+    }
+    close(chipfd);
+
+    fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+    bank->fds[0] = req.fd;
+    bank->nfds = 1;
+    return 0;
+}
+
+static int cdev_read(struct gpio_bank* bank, int fd,
+                     struct gpio_event* ev, int max) {
+    struct gpio_v2_line_event buf[GPIO_EVENT_BATCH];
+    ssize_t len;
+    int i, k, n;
+
+    if (max > GPIO_EVENT_BATCH) {
+        max = GPIO_EVENT_BATCH;
+    }
+    len = read(fd, buf, sizeof(buf[0]) * max);
+    if (len < 0) {
+        return (errno == EAGAIN) ? 0 : -1;
+    }
+
+    n = 0;
+    for (i = 0; i < (int)(len / sizeof(buf[0])); i++) {
+        // the request numbers its events, a full kernel fifo drops some
+        if (bank->seqno != 0 && buf[i].seqno != bank->seqno + 1) {
+            bank->overruns++;
+            bank->lost += buf[i].seqno - bank->seqno - 1;
+        }
+        bank->seqno = buf[i].seqno;
+        for (k = 0; k < bank->nlines; k++) {
+            if ((int)buf[i].offset == bank->lines[k]) {
+                break;
+            }
+        }
+        if (k == bank->nlines) {
+            continue;
+        }
+        ev[n].key = k;
+        ev[n].edge = (buf[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ?
+                GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+        ev[n].timestamp_ns = buf[i].timestamp_ns;
+        ev[n].seqno = buf[i].seqno;
+        n++;
+    }
+    return n;
+}
+
+static void cdev_close(struct gpio_bank* bank) {
+    // releasing the request fd releases the lines
+    if (bank->nfds > 0) {
+        close(bank->fds[0]);
+    }
+    bank->nfds = 0;
+}
+
+#else
+
+static int cdev_open(struct gpio_bank* bank) {
+    log2file("gpio chardev v2 ABI not available at build time\n");
+    return -1;
+}
+
+static int cdev_read(struct gpio_bank* bank, int fd,
+                     struct gpio_event* ev, int max) {
+    return -1;
+}
+
+static void cdev_close(struct gpio_bank* bank) {
+}
+
+#endif
+
+const struct gpio_backend gpio_backend_cdev = {
+    "cdev", cdev_open, cdev_read, cdev_close
+};
+
+
+// ============================================================================
+
+
+//// look up a backend by its name, NULL if unknown
+const struct gpio_backend* gpio_find_backend(const char* name) {
+    if (!strcmp(name, gpio_backend_sysfs.name)) {
+        return &gpio_backend_sysfs;
+    }
+    if (!strcmp(name, gpio_backend_cdev.name)) {
+        return &gpio_backend_cdev;
+    }
+    return NULL;
+}
+
+//// open the bank with its backend, sysfs is the fallback for everything else
+int gpio_open(struct gpio_bank* bank) {
+    int i;
+
+    if (bank->nlines > GPIO_MAX_LINES) {
+        return -1;
+    }
+    bank->nfds = 0;
+    bank->seqno = 0;
+    bank->overruns = 0;
+    bank->lost = 0;
+    for (i = 0; i < GPIO_MAX_LINES; i++) {
+        bank->levels[i] = -1;
+    }
+    if (bank->backend->open(bank) == 0) {
+        log2file("gpio backend: %s\n", bank->backend->name);
+        return 0;
+    }
+    if (bank->backend == &gpio_backend_sysfs) {
+        return -1;
+    }
+
+    log2file("gpio backend %s failed, falling back to sysfs\n",
+            bank->backend->name);
+    bank->backend->close(bank);
+    bank->backend = &gpio_backend_sysfs;
+    if (bank->backend->open(bank) != 0) {
+        return -1;
+    }
+    log2file("gpio backend: %s\n", bank->backend->name);
+    return 0;
+}
+
+int gpio_owns_fd(const struct gpio_bank* bank, int fd) {
+    int i;
+    for (i = 0; i < bank->nfds; i++) {
+        if (bank->fds[i] == fd) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//// read up to max pending events for the fd, returns count or -1
+int gpio_read_events(struct gpio_bank* bank, int fd,
+                     struct gpio_event* ev, int max) {
+    return bank->backend->read(bank, fd, ev, max);
+}
+
+void gpio_close(struct gpio_bank* bank) {
+    bank->backend->close(bank);
+}
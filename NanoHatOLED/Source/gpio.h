@@ -0,0 +1,65 @@
+#ifndef __GPIO__H__
+#define __GPIO__H__
+
+#include <stdint.h>
+
+#define GPIO_MAX_LINES      8
+#define GPIO_EVENT_BATCH    16
+
+#define GPIO_EDGE_RISING    0x01
+#define GPIO_EDGE_FALLING   0x02
+#define GPIO_EDGE_BOTH      (GPIO_EDGE_RISING | GPIO_EDGE_FALLING)
+
+
+//// one edge on one line of a bank, timestamp is CLOCK_MONOTONIC
+struct gpio_event {
+    int         key;            /* index of the line in gpio_bank.lines */
+    int         edge;           /* GPIO_EDGE_RISING or GPIO_EDGE_FALLING */
+    uint64_t    timestamp_ns;
+    uint32_t    seqno;          /* per-bank sequence number, 0 if unknown */
+};
+
+struct gpio_bank;
+
+//// an input backend, see gpio_backend_sysfs and gpio_backend_cdev; read
+//// returns up to max events, 0 once nothing is pending
+struct gpio_backend {
+    const char* name;
+    int  (*open)(struct gpio_bank* bank);
+    int  (*read)(struct gpio_bank* bank, int fd, struct gpio_event* ev, int max);
+    void (*close)(struct gpio_bank* bank);
+};
+
+//// a set of lines on one gpiochip served by one backend
+struct gpio_bank {
+    const struct gpio_backend* backend;
+    const char* chip;           /* "/dev/gpiochipN", cdev backend only */
+    int         lines[GPIO_MAX_LINES];
+    int         nlines;
+    int         edges;          /* GPIO_EDGE_* mask */
+
+    /* filled by backend->open() */
+    int         fds[GPIO_MAX_LINES];
+    int         nfds;
+    uint32_t    seqno;          /* of the last event read, cdev */
+    int         levels[GPIO_MAX_LINES];     /* last level read, sysfs, -1 unknown */
+
+    /* edges the kernel dropped: cdev sees gaps in the sequence numbers,
+     * sysfs a level that didn't change (at least two edges merged) */
+    uint32_t    overruns;       /* times edges went missing */
+    uint32_t    lost;           /* edges missing in all */
+};
+
+extern const struct gpio_backend gpio_backend_sysfs;
+extern const struct gpio_backend gpio_backend_cdev;
+
+extern const struct gpio_backend* gpio_find_backend(const char* name);
+
+extern int  gpio_open(struct gpio_bank* bank);
+extern int  gpio_owns_fd(const struct gpio_bank* bank, int fd);
+extern int  gpio_read_events(struct gpio_bank* bank, int fd,
+                             struct gpio_event* ev, int max);
+extern void gpio_close(struct gpio_bank* bank);
+
+
+#endif
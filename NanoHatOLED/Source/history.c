@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "history.h"
+#include "timer.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static struct history_header* ring = NULL;
+static size_t ring_size = 0;
+static unsigned int period_ms = HISTORY_PERIOD_MS;
+static unsigned int batch = HISTORY_BATCH;
+static struct history_sample pending[HISTORY_BATCH_MAX];
+static unsigned int npending = 0;
+
+// running sums of the metrics samples in the current period
+static uint64_t period_start = 0;
+static uint64_t sum_cpu, sum_mem, sum_disk;
+static int64_t sum_temp;
+static unsigned int nsamples, ntemps;
+
+
+static uint16_t permille(uint64_t part, uint64_t whole) {
+    return whole ? (uint16_t)(part * 1000 / whole) : 0;
+}
+
+//// the i-th newest sample (0 is the newest), staged ones included
+static const struct history_sample* nth_newest(unsigned int i) {
+    uint64_t count;
+
+    if (i < npending) {
+        return &pending[npending - 1 - i];
+    }
+    i -= npending;
+    count = ring ? ring->count : 0;
+    if (i >= count || i >= ring->capacity) {
+        return NULL;
+    }
+    return &ring->samples[(count - 1 - i) % ring->capacity];
+}
+
+static void append(const struct history_sample* s) {
+    pending[npending++] = *s;
+    if (npending >= batch) {
+        history_flush();
+    }
+}
+
+
+// ============================================================================
+
+
+//// map path as a ring of capacity samples; an existing ring of the same
+//// layout is kept, so the history survives restarts
+int history_open(const char* path, unsigned int capacity,
+                 unsigned int period, unsigned int per_batch) {
+    struct history_header old;
+    ssize_t n;
+    int fd;
+
+    history_close();
+    if (capacity == 0) {
+        return -1;
+    }
+    period_ms = period ? period : HISTORY_PERIOD_MS;
+    batch = per_batch == 0 ? 1 : per_batch > HISTORY_BATCH_MAX ? HISTORY_BATCH_MAX : per_batch;
+    ring_size = sizeof(*ring) + (size_t)capacity * sizeof(struct history_sample);
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log2file("history %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    n = pread(fd, &old, sizeof(old), 0);
+    if (n != sizeof(old) || old.magic != HISTORY_MAGIC || old.version != HISTORY_VERSION ||
+            old.sample_size != sizeof(struct history_sample) || old.capacity != capacity) {
+        if (n > 0) {
+            log2file("history %s has another layout, starting afresh\n", path);
+        }
+        old.magic = 0;
+        if (ftruncate(fd, 0) != 0) {
+            log2file("history %s: %s\n", path, strerror(errno));
+        }
+    }
+    if (ftruncate(fd, ring_size) != 0) {
+        log2file("history %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        log2file("mmap %s failed: %s\n", path, strerror(errno));
+        ring = NULL;
+        return -1;
+    }
+    if (old.magic != HISTORY_MAGIC) {
+        ring->version = HISTORY_VERSION;
+        ring->sample_size = sizeof(struct history_sample);
+        ring->capacity = capacity;
+        ring->count = 0;
+        __atomic_store_n(&ring->magic, HISTORY_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        log_msg(LOGLVL_INFO, "history %s: %llu samples kept\n", path,
+                (unsigned long long)(ring->count < capacity ? ring->count : capacity));
+    }
+    ring->period_ms = period_ms;
+    period_start = 0;
+    setenv("NANOHAT_HISTORY", path, 1);
+    return 0;
+}
+
+//// fold one metrics sample in, a ring sample goes out once per period
+void history_add(const struct metrics* m) {
+    struct history_sample s;
+
+    if (ring == NULL) {
+        return;
+    }
+    if (period_start == 0) {
+        period_start = m->timestamp_ns;
+    }
+    sum_cpu += m->cpu_permille;
+    sum_mem += permille(m->mem_total_kb - m->mem_available_kb, m->mem_total_kb);
+    sum_disk += permille(m->disk_used_kb, m->disk_total_kb);
+    if (m->temp_mdeg != METRICS_NO_TEMP) {
+        sum_temp += m->temp_mdeg / 100;
+        ntemps++;
+    }
+    nsamples++;
+    if (m->timestamp_ns - period_start < (uint64_t)period_ms * NSEC_PER_MSEC) {
+        return;
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.time = clock_ns(CLOCK_REALTIME) / NSEC_PER_SEC;
+    s.cpu_permille = sum_cpu / nsamples;
+    s.mem_permille = sum_mem / nsamples;
+    s.disk_permille = sum_disk / nsamples;
+    s.temp_ddeg = ntemps ? (int16_t)(sum_temp / ntemps) : HISTORY_NO_TEMP;
+    append(&s);
+
+    period_start = m->timestamp_ns;
+    sum_cpu = sum_mem = sum_disk = 0;
+    sum_temp = 0;
+    nsamples = ntemps = 0;
+}
+
+//// up to n values of a series, oldest first, returns how many; a missing
+//// temperature is HISTORY_NO_TEMP
+int history_series(int series, int n, int32_t* out) {
+    const struct history_sample* s;
+    int i, count = 0;
+
+    while (count < n && nth_newest(count) != NULL) {
+        count++;
+    }
+    for (i = 0; i < count; i++) {
+        s = nth_newest(count - 1 - i);
+        switch (series) {
+        case HISTORY_CPU:   out[i] = s->cpu_permille; break;
+        case HISTORY_MEM:   out[i] = s->mem_permille; break;
+        case HISTORY_TEMP:  out[i] = s->temp_ddeg; break;
+        default:            out[i] = s->disk_permille; break;
+        }
+    }
+    return count;
+}
+
+//// samples ever appended, staged ones included
+uint64_t history_count() {
+    return (ring ? ring->count : 0) + npending;
+}
+
+//// copy the staged samples into the file, readers see count move last
+void history_flush() {
+    unsigned int i;
+    uint64_t count;
+
+    if (ring == NULL || npending == 0) {
+        return;
+    }
+    count = ring->count;
+    for (i = 0; i < npending; i++) {
+        ring->samples[(count + i) % ring->capacity] = pending[i];
+    }
+    __atomic_store_n(&ring->count, count + npending, __ATOMIC_RELEASE);
+    npending = 0;
+    // one batch dirties its pages once, the kernel writes them back together
+    msync(ring, ring_size, MS_ASYNC);
+}
+
+void history_close() {
+    if (ring == NULL) {
+        return;
+    }
+    history_flush();
+    munmap(ring, ring_size);
+    ring = NULL;
+}
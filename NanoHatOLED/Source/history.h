@@ -0,0 +1,62 @@
+#ifndef __HISTORY__H__
+#define __HISTORY__H__
+
+#include <stdint.h>
+#include "metrics.h"
+
+/*
+ * Metrics history in a fixed-size ring file (history_path in the config,
+ * /run by default, a path on flash keeps it across reboots). Every metrics
+ * sample is folded into a running mean and one fixed-width sample goes into
+ * the ring per history_ms. Samples are staged in memory and copied into the
+ * mapped file history_batch at a time, so a batch dirties its pages once; a
+ * reader of the file may be up to one batch behind the daemon.
+ *
+ * The file is reused when the daemon starts again with the same layout and
+ * capacity, otherwise it is started afresh.
+ *
+ *   0   magic   4   version   8   sample size   12  capacity   16  count
+ *   24  period_ms   64  samples, the newest at (count - 1) % capacity
+ */
+
+#define HISTORY_FILE        "/run/nanohat-oled-history"
+#define HISTORY_MAGIC       0x5348484e      /* "NHHS" */
+#define HISTORY_VERSION     1
+#define HISTORY_SAMPLES     1024
+#define HISTORY_PERIOD_MS   10000
+#define HISTORY_BATCH       6
+#define HISTORY_BATCH_MAX   64
+#define HISTORY_NO_TEMP     INT16_MIN
+
+enum { HISTORY_CPU, HISTORY_MEM, HISTORY_TEMP, HISTORY_DISK, HISTORY_SERIES };
+
+struct history_sample {
+    uint32_t    time;               /* CLOCK_REALTIME seconds at the end */
+    uint16_t    cpu_permille;       /* means over the period */
+    uint16_t    mem_permille;       /* used share of MemTotal */
+    int16_t     temp_ddeg;          /* 0.1 degC, HISTORY_NO_TEMP without a sensor */
+    uint16_t    disk_permille;      /* used share of / */
+    uint32_t    pad;
+};
+
+struct history_header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    sample_size;
+    uint32_t    capacity;
+    uint64_t    count;              /* samples ever appended */
+    uint32_t    period_ms;
+    uint8_t     pad[36];
+    struct history_sample samples[];
+};
+
+extern int  history_open(const char* path, unsigned int capacity,
+                         unsigned int period_ms, unsigned int batch);
+extern void history_add(const struct metrics* m);
+extern int  history_series(int series, int n, int32_t* out);
+extern uint64_t history_count();
+extern void history_flush();
+extern void history_close();
+
+
+#endif
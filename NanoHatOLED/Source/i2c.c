@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include "i2c.h"
+#include "stats.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static int rdwr_xfer(struct i2c_bus* bus, struct i2c_msg* msgs, int n) {
+    struct i2c_rdwr_ioctl_data data;
+
+    data.msgs = msgs;
+    data.nmsgs = n;
+    return ioctl(bus->fd, I2C_RDWR, &data) == n ? 0 : -1;
+}
+
+//// adapters without I2C_FUNC_I2C: one SMBus block write per message, the
+//// first payload byte (the control byte) goes out as the SMBus command
+static int smbus_xfer(struct i2c_bus* bus, struct i2c_msg* msgs, int n) {
+    struct i2c_smbus_ioctl_data args;
+    union i2c_smbus_data data;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (msgs[i].len < 1 || msgs[i].len - 1 > I2C_SMBUS_BLOCK_MAX) {
+            errno = EINVAL;
+            return -1;
+        }
+        data.block[0] = msgs[i].len - 1;
+        memcpy(&data.block[1], msgs[i].buf + 1, msgs[i].len - 1);
+        args.read_write = I2C_SMBUS_WRITE;
+        args.command = msgs[i].buf[0];
+        args.size = I2C_SMBUS_I2C_BLOCK_DATA;
+        args.data = &data;
+        if (ioctl(bus->fd, I2C_SMBUS, &args) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//// bus number from /dev/i2c-N, -1 if the path doesn't say
+static int bus_number(const char* path) {
+    const char* p = strrchr(path, '-');
+    int n;
+
+    if (p == NULL || sscanf(p + 1, "%d", &n) != 1) {
+        return -1;
+    }
+    return n;
+}
+
+//// adapter clock from the device tree, 0 if unknown
+static int dt_clock_khz(int n) {
+    char node[96];
+    unsigned char be[4];
+    int fd;
+
+    if (n < 0) {
+        return 0;
+    }
+    snprintf(node, sizeof(node),
+            "/sys/class/i2c-dev/i2c-%d/device/of_node/clock-frequency", n);
+    fd = open(node, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    n = read(fd, be, 4);
+    close(fd);
+    if (n != 4) {
+        return 0;
+    }
+    return ((be[0] << 24) | (be[1] << 16) | (be[2] << 8) | be[3]) / 1000;
+}
+
+//// the clock itself is fixed by the device tree (clock-frequency of the
+//// adapter node) and can't be set from here; what can be done is to size
+//// the kernel's transfer timeout for it
+static void set_clock(struct i2c_bus* bus, int khz) {
+    long ms;
+
+    bus->clock_khz = khz;
+    // 9 bit times per byte for a full buffer, doubled, in 10 ms units
+    ms = (long)I2C_BUF_SIZE * 9 / khz;
+    ioctl(bus->fd, I2C_TIMEOUT, (unsigned long)(ms * 2 / 10 + 1));
+}
+
+
+// ============================================================================
+
+
+int i2c_open(struct i2c_bus* bus, const char* path) {
+    unsigned long funcs = 0;
+    int khz;
+
+    memset(bus, 0, sizeof(*bus));
+    bus->addr = -1;
+    bus->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (bus->fd < 0) {
+        log2file("open of %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (ioctl(bus->fd, I2C_FUNCS, &funcs) < 0) {
+        funcs = I2C_FUNC_I2C;
+    }
+    if (funcs & I2C_FUNC_I2C) {
+        bus->xfer = rdwr_xfer;
+        bus->max_msg = I2C_BUF_SIZE;
+    } else if (funcs & I2C_FUNC_SMBUS_WRITE_I2C_BLOCK) {
+        bus->xfer = smbus_xfer;
+        bus->smbus_only = 1;
+        bus->max_msg = I2C_SMBUS_BLOCK_MAX + 1;
+    } else {
+        log2file("%s supports neither I2C nor SMBus block writes\n", path);
+        i2c_close(bus);
+        return -1;
+    }
+
+    bus->nr = bus_number(path);
+    khz = dt_clock_khz(bus->nr);
+    if (khz == 0) {
+        log_msg(LOGLVL_INFO, "%s: no clock-frequency in the device tree, "
+                "assuming %d kHz\n", path, I2C_DEFAULT_KHZ);
+        khz = I2C_DEFAULT_KHZ;
+    }
+    set_clock(bus, khz);
+    return 0;
+}
+
+int i2c_set_address(struct i2c_bus* bus, int addr) {
+    // I2C_RDWR carries the address per message, SMBus needs the slave set
+    if (bus->smbus_only && ioctl(bus->fd, I2C_SLAVE, addr) < 0) {
+        return -1;
+    }
+    bus->addr = addr;
+    return 0;
+}
+
+//// find the largest message the adapter takes, using runs of a harmless
+//// command byte (nop) so probing has no visible effect
+int i2c_probe_max_msg(struct i2c_bus* bus, uint8_t ctrl, uint8_t nop) {
+    static const int sizes[] = { 1025, 257, 129, 65, 33, 17, 9 };
+    unsigned int i;
+    int n;
+
+    if (bus->smbus_only) {
+        return bus->max_msg;
+    }
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint8_t probe[1025];
+        struct i2c_msg msg;
+
+        n = sizes[i];
+        probe[0] = ctrl;
+        memset(probe + 1, nop, n - 1);
+        msg.addr = bus->addr;
+        msg.flags = 0;
+        msg.len = n;
+        msg.buf = probe;
+        if (bus->xfer(bus, &msg, 1) == 0) {
+            bus->max_msg = n;
+            return n;
+        }
+        if (errno != EOPNOTSUPP && errno != EINVAL && errno != EMSGSIZE) {
+            // a NAK or bus error is not about the size
+            return -1;
+        }
+    }
+    return -1;
+}
+
+//// append ctrl + data as one or more messages (split at max_msg)
+int i2c_queue(struct i2c_bus* bus, uint8_t ctrl, const uint8_t* data, int len) {
+    int chunk;
+
+    do {
+        chunk = len;
+        if (chunk > bus->max_msg - 1) {
+            chunk = bus->max_msg - 1;
+        }
+        if (bus->nmsgs == I2C_MAX_MSGS * 2 || bus->used + chunk + 1 > I2C_BUF_SIZE) {
+            log2file("i2c frame too large\n");
+            return -1;
+        }
+        uint8_t* p = &bus->buf[bus->used];
+        p[0] = ctrl;
+        memcpy(p + 1, data, chunk);
+
+        bus->msgs[bus->nmsgs].addr = bus->addr;
+        bus->msgs[bus->nmsgs].flags = 0;
+        bus->msgs[bus->nmsgs].len = chunk + 1;
+        bus->msgs[bus->nmsgs].buf = p;
+        bus->nmsgs++;
+        bus->used += chunk + 1;
+        data += chunk;
+        len -= chunk;
+    } while (len > 0);
+    return 0;
+}
+
+//// close the current group of messages
+void i2c_group(struct i2c_bus* bus) {
+    int start = bus->ngroups ? bus->groups[bus->ngroups - 1] : 0;
+
+    if (bus->nmsgs > start && bus->ngroups < I2C_MAX_GROUPS) {
+        bus->groups[bus->ngroups++] = bus->nmsgs;
+    }
+}
+
+//// send everything queued, returns 0 or -1 once a batch exhausted its retries
+int i2c_commit(struct i2c_bus* bus) {
+    int g = 0, n, start = 0, end, attempt, ret = 0;
+
+    i2c_group(bus);
+    while (start < bus->nmsgs) {
+        // as many whole groups as fit one ioctl and the batch limit
+        end = start;
+        for (n = 0; g < bus->ngroups && n < I2C_BATCH_GROUPS &&
+                bus->groups[g] - start <= I2C_MAX_MSGS; n++) {
+            end = bus->groups[g++];
+        }
+        if (end == start) {
+            // a group larger than one ioctl, or untracked messages
+            end = (g < bus->ngroups) ? bus->groups[g] : bus->nmsgs;
+            if (end - start > I2C_MAX_MSGS) {
+                end = start + I2C_MAX_MSGS;
+            } else if (g < bus->ngroups) {
+                g++;
+            }
+        }
+
+        for (attempt = 0; attempt <= I2C_NAK_RETRIES; attempt++) {
+            if (bus->xfer(bus, &bus->msgs[start], end - start) == 0) {
+                break;
+            }
+            bus->errors++;
+            stats_add(STAT_I2C_ERRORS, 1);
+            if (attempt < I2C_NAK_RETRIES) {
+                bus->retries++;
+            }
+        }
+        if (attempt > I2C_NAK_RETRIES) {
+            log2file("i2c transfer failed: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+        bus->transactions++;
+        stats_add(STAT_I2C_TRANSACTIONS, 1);
+        for (; start < end; start++) {
+            bus->bytes += bus->msgs[start].len;
+            stats_add(STAT_I2C_BYTES, bus->msgs[start].len);
+        }
+    }
+    i2c_reset(bus);
+    return ret;
+}
+
+//// drop whatever is queued
+void i2c_reset(struct i2c_bus* bus) {
+    bus->nmsgs = 0;
+    bus->ngroups = 0;
+    bus->used = 0;
+}
+
+void i2c_close(struct i2c_bus* bus) {
+    if (bus->fd >= 0) {
+        close(bus->fd);
+        bus->fd = -1;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef __I2C__H__
+#define __I2C__H__
+
+#include <stdint.h>
+#include <linux/i2c.h>
+
+#define I2C_MAX_MSGS        42      /* I2C_RDWR_IOCTL_MAX_MSGS */
+#define I2C_BUF_SIZE        2048    /* payload of one frame incl. control bytes */
+#define I2C_MAX_GROUPS      32
+#define I2C_BATCH_GROUPS    4       /* groups per ioctl, bounds what a retry resends */
+#define I2C_NAK_RETRIES     3
+#define I2C_DEFAULT_KHZ     400
+
+struct i2c_bus;
+typedef int (*i2c_xfer_fn)(struct i2c_bus* bus, struct i2c_msg* msgs, int n);
+
+/*
+ * Messages are queued per frame and sent with as few I2C_RDWR ioctls as the
+ * adapter allows. A group is a run of messages that only makes sense as a
+ * whole (e.g. an address window and its data) and is the unit of a retry:
+ * after a NAK only the failed batch of groups is sent again, not the frame.
+ */
+struct i2c_bus {
+    int             fd;
+    int             nr;             /* adapter number, -1 if unknown */
+    int             addr;
+    int             smbus_only;     /* adapter lacks plain I2C, 32 byte SMBus blocks */
+    int             max_msg;        /* largest payload accepted in one message */
+    int             clock_khz;
+    i2c_xfer_fn     xfer;
+
+    struct i2c_msg  msgs[I2C_MAX_MSGS * 2];
+    int             nmsgs;
+    int             groups[I2C_MAX_GROUPS + 1];    /* msg index where a group ends */
+    int             ngroups;
+    uint8_t         buf[I2C_BUF_SIZE];
+    int             used;
+
+    unsigned int    transactions;
+    unsigned int    bytes;
+    unsigned int    errors;
+    unsigned int    retries;
+};
+
+extern int  i2c_open(struct i2c_bus* bus, const char* path);
+extern int  i2c_set_address(struct i2c_bus* bus, int addr);
+extern int  i2c_probe_max_msg(struct i2c_bus* bus, uint8_t ctrl, uint8_t nop);
+extern int  i2c_queue(struct i2c_bus* bus, uint8_t ctrl, const uint8_t* data, int len);
+extern void i2c_group(struct i2c_bus* bus);
+extern int  i2c_commit(struct i2c_bus* bus);
+extern void i2c_reset(struct i2c_bus* bus);
+extern void i2c_close(struct i2c_bus* bus);
+
+
+#endif
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "layout.h"
+#include "draw.h"
+#include "history.h"
+#include "tz.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+struct binding {
+    const char*     name;
+    int             len;        /* longest text the value formats to */
+};
+
+static const struct binding bindings[LAYOUT_BINDINGS] = {
+    [LAYOUT_CPU]         = { "cpu",         6 },    /* 100.0% */
+    [LAYOUT_MEM]         = { "mem",         6 },
+    [LAYOUT_DISK]        = { "disk",        6 },
+    [LAYOUT_TEMP]        = { "temp",        6 },    /* 105.5C */
+    [LAYOUT_TEMP_STATUS] = { "temp_status", 4 },
+    [LAYOUT_MEM_USED]    = { "mem_used",    7 },    /* 16384MB */
+    [LAYOUT_MEM_TOTAL]   = { "mem_total",   7 },
+    [LAYOUT_DISK_USED]   = { "disk_used",   6 },    /* 1024GB */
+    [LAYOUT_DISK_TOTAL]  = { "disk_total",  6 },
+    [LAYOUT_NET_RX]      = { "net_rx",      9 },
+    [LAYOUT_NET_TX]      = { "net_tx",      9 },
+};
+
+static const char* series_names[HISTORY_SERIES] = {
+    [HISTORY_CPU] = "cpu", [HISTORY_MEM] = "mem", [HISTORY_TEMP] = "temp", [HISTORY_DISK] = "disk"
+};
+
+static const char* clock_names[] = { "time", "date", "zone" };
+static const int clock_lens[] = { 8, 16, 6 };
+
+static const char* status_names[] = { "", "COOL", "WARM", "HOT!" };
+
+static struct layout_op ops[LAYOUT_MAX_OPS];
+static int nops = 0;
+static struct layout_screen screens[LAYOUT_MAX_SCREENS];
+static int nscreens = 0;
+static unsigned int generation = 0;
+static char source[128];
+static struct timespec source_mtime;
+static off_t source_size = -1;
+
+
+static int lookup(const char* name, const char* const* names, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (names[i] != NULL && strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int find_binding(const char* name) {
+    int i;
+
+    for (i = 0; i < LAYOUT_BINDINGS; i++) {
+        if (strcmp(name, bindings[i].name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//// the text between the first and the last '"' of line, 0 if there is none
+static int quoted(const char* line, char* out) {
+    const char* open = strchr(line, '"');
+    const char* close = strrchr(line, '"');
+    int len;
+
+    if (open == NULL || close == open) {
+        out[0] = '\0';
+        return 0;
+    }
+    len = close - open - 1;
+    if (len > TEXT_CACHE_LEN - 1) {
+        len = TEXT_CACHE_LEN - 1;
+    }
+    memcpy(out, open + 1, len);
+    out[len] = '\0';
+    return 1;
+}
+
+//// fit the box on the panel, a widget off it is dropped
+static int clip(struct layout_op* op) {
+    if (op->x < 0 || op->y < 0 || op->x >= FB_WIDTH || op->y >= FB_HEIGHT ||
+            op->w <= 0 || op->h <= 0) {
+        return -1;
+    }
+    if (op->x + op->w > FB_WIDTH) {
+        op->w = FB_WIDTH - op->x;
+    }
+    if (op->y + op->h > FB_HEIGHT) {
+        op->h = FB_HEIGHT - op->y;
+    }
+    return 0;
+}
+
+//// a widget for text advance columns per character, the box one line high
+static int text_box(struct layout_op* op, int size, int len) {
+    op->font = font_by_height(size);
+    if (op->font == NULL) {
+        return -1;
+    }
+    op->vx = op->x + strlen(op->text) * op->font->advance;
+    op->w = op->vx - op->x + len * op->font->advance;
+    op->h = op->font->height;
+    return clip(op);
+}
+
+static int parse_widget(char* line, struct layout_op* op) {
+    char kind[8], name[16], zone[TZ_NAME_MAX];
+    int x, y, a, b, n;
+
+    memset(op, 0, sizeof(*op));
+    op->zone = -1;
+    if (sscanf(line, "%7s", kind) != 1) {
+        return -1;
+    }
+    if (strcmp(kind, "text") == 0) {
+        if (sscanf(line, "%*s %d %d %d", &x, &y, &a) != 3 || !quoted(line, op->text)) {
+            return -1;
+        }
+        op->kind = LAYOUT_TEXT;
+        op->x = x;
+        op->y = y;
+        return text_box(op, a, 0);
+    }
+    if (strcmp(kind, "value") == 0) {
+        if (sscanf(line, "%*s %d %d %d %15s", &x, &y, &a, name) != 4 ||
+                (n = find_binding(name)) < 0) {
+            return -1;
+        }
+        quoted(line, op->text);
+        op->kind = LAYOUT_VALUE;
+        op->bind = n;
+        op->x = x;
+        op->y = y;
+        return text_box(op, a, bindings[n].len);
+    }
+    if (strcmp(kind, "bar") == 0 || strcmp(kind, "spark") == 0) {
+        if (sscanf(line, "%*s %d %d %d %d %15s", &x, &y, &a, &b, name) != 5) {
+            return -1;
+        }
+        if (kind[0] == 'b') {
+            op->kind = LAYOUT_BAR;
+            n = find_binding(name);
+            if (n < 0 || n > LAYOUT_TEMP) {
+                return -1;
+            }
+        } else {
+            op->kind = LAYOUT_SPARK;
+            n = lookup(name, series_names, HISTORY_SERIES);
+            if (n < 0) {
+                return -1;
+            }
+        }
+        op->bind = n;
+        op->x = x;
+        op->y = y;
+        op->w = a;
+        op->h = b;
+        return clip(op);
+    }
+    if (strcmp(kind, "clock") == 0) {
+        n = sscanf(line, "%*s %d %d %d %15s %47s", &x, &y, &a, name, zone);
+        if (n < 4 || (b = lookup(name, clock_names, 3)) < 0) {
+            return -1;
+        }
+        op->kind = LAYOUT_CLOCK;
+        op->bind = b;
+        op->x = x;
+        op->y = y;
+        if (n == 5) {
+            op->zone = tz_find(zone);
+        }
+        return text_box(op, a, clock_lens[b]);
+    }
+    return -1;
+}
+
+static int parse_line(char* line, const char* path, int lineno) {
+    struct layout_screen* s;
+    char name[LAYOUT_NAME_MAX];
+
+    if (strncmp(line, "screen", 6) == 0 && (line[6] == ' ' || line[6] == '\t')) {
+        if (nscreens == LAYOUT_MAX_SCREENS || sscanf(line + 6, "%15s", name) != 1) {
+            return -1;
+        }
+        s = &screens[nscreens++];
+        snprintf(s->name, sizeof(s->name), "%s", name);
+        s->first = nops;
+        s->count = 0;
+        return 0;
+    }
+    if (nscreens == 0) {
+        return -1;          // a widget before the first screen
+    }
+    s = &screens[nscreens - 1];
+    if (nops == LAYOUT_MAX_OPS || s->count == LAYOUT_SCREEN_OPS) {
+        log2file("layout %s:%d: screen %s is full\n", path, lineno, s->name);
+        return 0;
+    }
+    if (parse_widget(line, &ops[nops]) != 0) {
+        return -1;
+    }
+    nops++;
+    s->count++;
+    return 0;
+}
+
+static int changed_on_disk() {
+    struct stat st;
+
+    if (stat(source, &st) != 0) {
+        return source_size >= 0;
+    }
+    return st.st_size != source_size || st.st_mtim.tv_sec != source_mtime.tv_sec ||
+            st.st_mtim.tv_nsec != source_mtime.tv_nsec;
+}
+
+
+// ============================================================================
+
+
+//// compile the screens in path, replacing the ones loaded before; returns
+//// how many there are, -1 if the file can't be read (there are none then)
+int layout_load(const char* path) {
+    static char text[LAYOUT_FILE_MAX + 1];
+    struct stat st;
+    char *line, *next, *p;
+    ssize_t n;
+    size_t len = 0;
+    int fd, lineno = 0;
+
+    if (path != source) {
+        snprintf(source, sizeof(source), "%s", path);
+    }
+    nops = 0;
+    nscreens = 0;
+    generation++;
+    source_size = -1;
+    fd = open(source, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            log2file("layout %s: %s\n", source, strerror(errno));
+        }
+        return -1;
+    }
+    if (fstat(fd, &st) == 0) {
+        source_mtime = st.st_mtim;
+        source_size = st.st_size;
+    }
+    while (len < LAYOUT_FILE_MAX && (n = read(fd, text + len, LAYOUT_FILE_MAX - len)) > 0) {
+        len += n;
+    }
+    close(fd);
+    if (len == LAYOUT_FILE_MAX) {
+        log2file("layout %s: only the first %d bytes are read\n", source, LAYOUT_FILE_MAX);
+    }
+    text[len] = '\0';
+
+    for (line = text; *line; line = next) {
+        lineno++;
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        } else {
+            next = line + strlen(line);
+        }
+        // a '#' in a quoted label is part of it
+        if ((p = strchr(line, '#')) != NULL && (strchr(line, '"') == NULL || p < strchr(line, '"'))) {
+            *p = '\0';
+        }
+        for (p = line; *p == ' ' || *p == '\t'; p++) {
+        }
+        if (*p == '\0') {
+            continue;
+        }
+        if (parse_line(p, source, lineno) != 0) {
+            log2file("layout %s:%d: bad entry\n", source, lineno);
+        }
+    }
+    log_msg(LOGLVL_INFO, "layout %s: %d screens, %d widgets\n", source, nscreens, nops);
+    return nscreens;
+}
+
+//// the screen called name, the file is compiled again first if it changed
+//// since; -1 if there is no such screen
+int layout_find(const char* name) {
+    int i;
+
+    if (source[0] != '\0' && changed_on_disk()) {
+        layout_load(source);
+    }
+    for (i = 0; i < nscreens; i++) {
+        if (strcmp(screens[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const struct layout_op* layout_ops(int screen, int* count) {
+    if (screen < 0 || screen >= nscreens) {
+        *count = 0;
+        return NULL;
+    }
+    *count = screens[screen].count;
+    return &ops[screens[screen].first];
+}
+
+//// bumped by every load, screen numbers from before it are void
+unsigned int layout_generation() {
+    return generation;
+}
+
+static int64_t share(uint64_t part, uint64_t whole) {
+    return whole ? (int64_t)(part * 1000 / whole) : 0;
+}
+
+//// what op shows now, in its printed precision: op is redrawn when it changes
+int64_t layout_key(const struct layout_op* op, const struct metrics* m, int zone, int64_t now) {
+    struct tz_local l;
+    int64_t v, inner;
+
+    if (op->kind == LAYOUT_TEXT) {
+        return 0;
+    }
+    if (op->kind == LAYOUT_SPARK) {
+        return (int64_t)history_count();
+    }
+    if (op->kind == LAYOUT_CLOCK) {
+        if (op->bind == DRAW_CLOCK_TIME) {
+            return now;
+        }
+        tz_localtime(op->zone >= 0 ? op->zone : zone, now, &l);
+        if (op->bind == DRAW_CLOCK_DATE) {
+            return l.year * 10000 + l.month * 100 + l.day;
+        }
+        return l.utoff;
+    }
+
+    switch (op->bind) {
+    case LAYOUT_CPU:        v = m->cpu_permille; break;
+    case LAYOUT_MEM:        v = share(m->mem_total_kb - m->mem_available_kb, m->mem_total_kb); break;
+    case LAYOUT_DISK:       v = share(m->disk_used_kb, m->disk_used_kb + m->disk_avail_kb); break;
+    case LAYOUT_TEMP:
+        v = m->temp_mdeg == METRICS_NO_TEMP ? INT64_MIN : m->temp_mdeg / 100;
+        break;
+    case LAYOUT_TEMP_STATUS:
+        v = m->temp_mdeg == METRICS_NO_TEMP ? 0 : m->temp_mdeg < 50000 ? 1 : m->temp_mdeg < 70000 ? 2 : 3;
+        break;
+    case LAYOUT_MEM_USED:   v = (m->mem_total_kb - m->mem_available_kb) / 1024; break;
+    case LAYOUT_MEM_TOTAL:  v = m->mem_total_kb / 1024; break;
+    case LAYOUT_DISK_USED:  v = m->disk_used_kb / (1024 * 1024); break;
+    case LAYOUT_DISK_TOTAL: v = m->disk_total_kb / (1024 * 1024); break;
+    case LAYOUT_NET_RX:     v = m->net_rx_bytes >> 20; break;
+    default:                v = m->net_tx_bytes >> 20; break;
+    }
+    if (op->kind == LAYOUT_BAR) {
+        // the filled columns inside the outline, degrees span 0-100
+        if (v == INT64_MIN) {
+            return 0;
+        }
+        inner = op->w - 2;
+        v = v < 0 ? 0 : v > 1000 ? 1000 : v;
+        return v * inner / 1000;
+    }
+    return v;
+}
+
+//// the text of a value for its key
+void layout_format(const struct layout_op* op, int64_t key, char* out, int size) {
+    int64_t a = key < 0 ? -key : key;
+
+    switch (op->bind) {
+    case LAYOUT_CPU:
+    case LAYOUT_MEM:
+    case LAYOUT_DISK:
+        snprintf(out, size, "%d.%d%%", (int)(key / 10), (int)(key % 10));
+        break;
+    case LAYOUT_TEMP:
+        if (key == INT64_MIN) {
+            snprintf(out, size, "--");
+        } else {
+            snprintf(out, size, "%s%d.%dC", key < 0 ? "-" : "", (int)(a / 10), (int)(a % 10));
+        }
+        break;
+    case LAYOUT_TEMP_STATUS:
+        snprintf(out, size, "%s", status_names[key & 3]);
+        break;
+    case LAYOUT_DISK_USED:
+    case LAYOUT_DISK_TOTAL:
+        snprintf(out, size, "%lldGB", (long long)key);
+        break;
+    default:
+        snprintf(out, size, "%lldMB", (long long)key);
+        break;
+    }
+}
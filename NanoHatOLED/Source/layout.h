@@ -0,0 +1,74 @@
+#ifndef __LAYOUT__H__
+#define __LAYOUT__H__
+
+#include <stdint.h>
+#include "font.h"
+#include "metrics.h"
+
+/*
+ * Screen layouts drawn by the daemon itself. A layout file (layout_path in
+ * the config) describes named screens, one widget per line, '#' starts a
+ * comment; x y are the top left corner, size is the font height, 8 or 16:
+ *
+ *   screen system
+ *   text   x y size "label"
+ *   value  x y size binding ["label"]     a metric, formatted by the daemon
+ *   bar    x y w h binding                a percentage (or 0-100 degC)
+ *   spark  x y w h series                 cpu, mem, temp or disk history
+ *   clock  x y size time|date|zone [zone]
+ *
+ * Bindings: cpu mem disk temp (percent, degC), temp_status (COOL, WARM,
+ * HOT!), mem_used mem_total net_rx net_tx (MB), disk_used disk_total (GB).
+ * A clock without a zone shows the one the view selected the screen with.
+ *
+ * The file is compiled once, when the daemon starts, its config changes or
+ * a view selects a screen after the file was edited, into one flat array
+ * of widget ops with their boxes and glyph positions worked out. On every
+ * metrics sample and wall clock second each widget of a selected screen
+ * computes a key from what it shows (the value in its printed precision, a
+ * bar's filled width, the history count, the second); only widgets whose
+ * key changed are cleared and drawn again, so the commit that follows
+ * differs from the panel's contents in those boxes alone.
+ */
+
+#define LAYOUT_FILE         "/etc/nanohat-oled.layout"
+#define LAYOUT_MAX_SCREENS  8
+#define LAYOUT_MAX_OPS      128     /* widgets of all screens */
+#define LAYOUT_SCREEN_OPS   32      /* widgets of one screen */
+#define LAYOUT_NAME_MAX     16
+#define LAYOUT_FILE_MAX     8192
+
+enum { LAYOUT_TEXT, LAYOUT_VALUE, LAYOUT_BAR, LAYOUT_SPARK, LAYOUT_CLOCK };
+
+enum {
+    LAYOUT_CPU, LAYOUT_MEM, LAYOUT_DISK, LAYOUT_TEMP, LAYOUT_TEMP_STATUS,
+    LAYOUT_MEM_USED, LAYOUT_MEM_TOTAL, LAYOUT_DISK_USED, LAYOUT_DISK_TOTAL,
+    LAYOUT_NET_RX, LAYOUT_NET_TX, LAYOUT_BINDINGS
+};
+
+struct layout_op {
+    uint8_t             kind;
+    uint8_t             bind;       /* LAYOUT_*, HISTORY_* or DRAW_CLOCK_* */
+    int16_t             x, y, w, h; /* box, cleared when the widget is redrawn */
+    int16_t             vx;         /* first glyph of a value, after its label */
+    const struct font*  font;
+    int                 zone;       /* of a clock, -1: the screen's */
+    char                text[TEXT_CACHE_LEN];   /* text, a value's label */
+};
+
+struct layout_screen {
+    char                name[LAYOUT_NAME_MAX];
+    int                 first;      /* into the op array */
+    int                 count;
+};
+
+extern int  layout_load(const char* path);
+extern int  layout_find(const char* name);
+extern const struct layout_op* layout_ops(int screen, int* count);
+extern unsigned int layout_generation();
+extern int64_t layout_key(const struct layout_op* op, const struct metrics* m,
+                          int zone, int64_t now);
+extern void layout_format(const struct layout_op* op, int64_t key, char* out, int size);
+
+
+#endif
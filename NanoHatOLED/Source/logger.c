@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "daemonize.h"
+#include "rtsched.h"
+#include "logger.h"
+
+/*
+ * Lines are formatted by the caller into a preallocated ring and written by
+ * a background thread through one persistent fd. Callers only hold the lock
+ * for a memcpy; when the ring is full the line is dropped and counted. The
+ * lock inherits priority, so a real-time caller never waits on a flusher
+ * that an ordinary thread preempted.
+ */
+
+
+// ============================================================================
+
+
+static char ring[LOG_RING_SIZE];
+static size_t ring_head = 0;        /* total bytes ever queued */
+static size_t ring_tail = 0;        /* total bytes ever written */
+static unsigned int dropped = 0;
+static int pending = 0;
+static int running = 0;
+
+static pthread_mutex_t lock;       /* PTHREAD_PRIO_INHERIT, set up by log_start() */
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t flusher;
+
+static const char* log_path = LOG_FILE_NAME;
+static size_t log_max = LOG_MAX_SIZE;
+static size_t log_size = 0;
+static int log_fd = -1;
+static volatile int log_level = DEBUG ? LOGLVL_DEBUG : LOGLVL_WARN;
+
+
+// ============================================================================
+
+
+static int open_log() {
+    struct stat st;
+
+    log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
+        return -1;
+    }
+    log_size = (fstat(log_fd, &st) == 0) ? (size_t)st.st_size : 0;
+    return 0;
+}
+
+//// keep one old generation, LOG_FILE_NAME.1
+static void rotate_log() {
+    char old[256];
+
+    snprintf(old, sizeof(old), "%s.1", log_path);
+    close(log_fd);
+    rename(log_path, old);
+    open_log();
+}
+
+static void write_out(const char* buf, size_t len) {
+    ssize_t n;
+
+    if (log_fd < 0 && open_log() != 0) {
+        return;
+    }
+    while (len > 0) {
+        n = write(log_fd, buf, len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        buf += n;
+        len -= n;
+        log_size += n;
+    }
+    if (log_max > 0 && log_size >= log_max) {
+        rotate_log();
+    }
+}
+
+//// write everything queued so far, called without the lock held
+static void flush_ring() {
+    char note[48];
+    size_t head, tail, off, len;
+    unsigned int lost;
+
+    pthread_mutex_lock(&lock);
+    head = ring_head;
+    tail = ring_tail;
+    lost = dropped;
+    dropped = 0;
+    pending = 0;
+    pthread_mutex_unlock(&lock);
+
+    while (tail != head) {
+        off = tail % LOG_RING_SIZE;
+        len = head - tail;
+        if (len > LOG_RING_SIZE - off) {
+            len = LOG_RING_SIZE - off;
+        }
+        write_out(ring + off, len);
+        tail += len;
+    }
+    if (lost > 0) {
+        len = snprintf(note, sizeof(note), "%u log lines dropped\n", lost);
+        write_out(note, len);
+    }
+
+    pthread_mutex_lock(&lock);
+    ring_tail = tail;
+    pthread_mutex_unlock(&lock);
+}
+
+//// the flush thread sleeps until the first line after a flush arrives, then
+//// waits LOG_FLUSH_DELAY so bursts go out in one write
+static void* flush_thread(void* arg) {
+    struct timespec delay = { 0, LOG_FLUSH_DELAY * 1000000L };
+
+    rtsched_thread(RTSCHED_BACKGROUND);
+    pthread_mutex_lock(&lock);
+    while (running) {
+        while (running && !pending) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+        nanosleep(&delay, NULL);
+        flush_ring();
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static void queue_line(const char* buf, size_t len) {
+    size_t off, first;
+
+    pthread_mutex_lock(&lock);
+    if (ring_head - ring_tail + len > LOG_RING_SIZE) {
+        dropped++;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    off = ring_head % LOG_RING_SIZE;
+    first = LOG_RING_SIZE - off;
+    if (first >= len) {
+        memcpy(ring + off, buf, len);
+    } else {
+        memcpy(ring + off, buf, first);
+        memcpy(ring, buf + first, len - first);
+    }
+    ring_head += len;
+    if (!pending) {
+        pending = 1;
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void _log2file(int level, const char* fmt, va_list vl) {
+    static const char tags[] = "EWID";
+    char line[LOG_LINE_MAX];
+    struct timespec ts;
+    int len, n;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    len = snprintf(line, sizeof(line), "%ld.%03ld %c ",
+            (long)ts.tv_sec, ts.tv_nsec / 1000000L, tags[level]);
+    n = vsnprintf(line + len, sizeof(line) - len, fmt, vl);
+    if (n < 0) {
+        return;
+    }
+    len += n;
+    if (len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+
+    if (running) {
+        queue_line(line, len);
+    } else {
+        // before log_start() (e.g. while daemonizing) write synchronously
+        write_out(line, len);
+        close(log_fd);
+        log_fd = -1;
+    }
+}
+
+
+// ============================================================================
+
+
+//// open the log and start the flush thread, call after daemonize()
+//// max_size 0 disables rotation
+int log_start(const char* path, size_t max_size) {
+    pthread_mutexattr_t mattr;
+    pthread_attr_t attr;
+    sigset_t all, old;
+    int ret;
+
+    if (running) {
+        return 0;
+    }
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    log_path = path;
+    log_max = max_size;
+    if (open_log() != 0) {
+        return -1;
+    }
+    running = 1;
+    // signals stay with the loop thread, SIGCHLD in particular (supervise.c)
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    rtsched_attr(&attr);
+    ret = pthread_create(&flusher, &attr, flush_thread, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        running = 0;
+        return -1;
+    }
+    atexit(log_stop);
+    return 0;
+}
+
+//// stop the flush thread and write out what's left
+void log_stop() {
+    if (!running) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    running = 0;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(flusher, NULL);
+    flush_ring();
+}
+
+//// async-signal-safe, may be called from a signal handler
+void log_set_level(int level) {
+    if (level < LOGLVL_ERROR) {
+        level = LOGLVL_ERROR;
+    }
+    if (level > LOGLVL_DEBUG) {
+        level = LOGLVL_DEBUG;
+    }
+    log_level = level;
+}
+
+int log_get_level() {
+    return log_level;
+}
+
+void log_msg(int level, const char *fmt, ...) {
+    if (level <= log_level) {
+        va_list vl;
+        va_start(vl, fmt);
+        _log2file(level, fmt, vl);
+        va_end(vl);
+    }
+}
+
+void log2file(const char *fmt, ...) {
+    if (LOGLVL_INFO <= log_level) {
+        va_list vl;
+        va_start(vl, fmt);
+        _log2file(LOGLVL_INFO, fmt, vl);
+        va_end(vl);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef __LOGGER__H__
+#define __LOGGER__H__
+
+#include <stddef.h>
+
+#define LOGLVL_ERROR    0
+#define LOGLVL_WARN     1
+#define LOGLVL_INFO     2
+#define LOGLVL_DEBUG    3
+
+#define LOG_RING_SIZE   16384       /* bytes buffered in memory */
+#define LOG_LINE_MAX    256
+#define LOG_MAX_SIZE    (256*1024)  /* rotate to LOG_FILE_NAME.1 beyond this */
+#define LOG_FLUSH_DELAY 200         /* ms to gather lines before a write */
+
+extern int  log_start(const char* path, size_t max_size);
+extern void log_stop();
+extern void log_set_level(int level);
+extern int  log_get_level();
+extern void log_msg(int level, const char *fmt, ...);
+extern void log2file(const char *fmt, ...);
+
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include "loop.h"
+#include "stats.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static int epfd = -1;
+static volatile int running = 0;
+
+
+// ============================================================================
+
+
+int loop_init() {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        log2file("error creating epoll: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int loop_add(struct loop_source* src, uint32_t events) {
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = src;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, src->fd, &ev) != 0) {
+        log2file("epoll_ctl add fd %d: %s\n", src->fd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int loop_mod(struct loop_source* src, uint32_t events) {
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = src;
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, src->fd, &ev) != 0) {
+        log2file("epoll_ctl mod fd %d: %s\n", src->fd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//// remove a source, call before closing its fd if the fd may be shared
+void loop_del(struct loop_source* src) {
+    if (src->fd >= 0) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, src->fd, NULL);
+    }
+}
+
+//// dispatch until loop_stop(), there is no timeout: anything periodic has
+//// to be a timerfd source (see timer.c) so an idle daemon never wakes up
+void loop_run() {
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    struct loop_source* src;
+    int i, n;
+
+    running = 1;
+    while (running) {
+        n = epoll_wait(epfd, events, LOOP_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log2file("epoll_wait: %s\n", strerror(errno));
+            break;
+        }
+        stats_add(STAT_WAKEUPS, 1);
+        for (i = 0; i < n; ++i) {
+            src = events[i].data.ptr;
+            src->handler(src, events[i].events);
+        }
+    }
+}
+
+//// async-signal-safe
+void loop_stop() {
+    running = 0;
+}
+
+void loop_close() {
+    if (epfd >= 0) {
+        close(epfd);
+        epfd = -1;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef __LOOP__H__
+#define __LOOP__H__
+
+#include <stdint.h>
+
+#define LOOP_MAX_EVENTS 16
+
+struct loop_source;
+typedef void (*loop_handler)(struct loop_source* src, uint32_t events);
+
+//// one fd in the daemon's epoll set, embed it in whatever owns the fd
+struct loop_source {
+    int             fd;
+    loop_handler    handler;
+    void*           ctx;
+};
+
+extern int  loop_init();
+extern int  loop_add(struct loop_source* src, uint32_t events);
+extern int  loop_mod(struct loop_source* src, uint32_t events);
+extern void loop_del(struct loop_source* src);
+extern void loop_run();
+extern void loop_stop();
+extern void loop_close();
+
+
+#endif
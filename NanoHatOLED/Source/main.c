@@ -8,32 +8,79 @@
 #include <sys/types.h>
 #include <signal.h>
 #include <time.h>
-#include <pthread.h>
-#include <dirent.h>
 #include "daemonize.h"
+#include "gpio.h"
+#include "evring.h"
+#include "view.h"
+#include "supervise.h"
+#include "loop.h"
+#include "timer.h"
+#include "render.h"
+#include "draw.h"
+#include "layout.h"
+#include "metrics.h"
+#include "history.h"
+#include "gesture.h"
+#include "sched.h"
+#include "timesync.h"
+#include "devwait.h"
+#include "config.h"
+#include "notify.h"
+#include "stats.h"
+#include "power.h"
+#include "arena.h"
+#include "rtsched.h"
+#ifdef WITH_EMBEDDED_PYTHON
+#include "pyembed.h"
+#endif
+#include "logger.h"
 
 
 // ============================================================================
 
 
-extern void log2file(const char *fmt, ...);
-
-
 int get_work_path(char* buff, int maxlen);
 
-int init_gpio(int gpio, char* edge);
-void release_gpio(int gpio);
-
-int load_python_view();
-void send_signal_to_python_process(int signal);
+static void dispatch_key_event(const struct gpio_event* ev);
+static void dispatch_gesture(int key, int kind, uint64_t timestamp_ns, uint32_t value);
+static void dispatch_frame(uint32_t reasons, uint64_t timestamp_ns);
+static int  parse_debounce(const char* arg);
+static void load_devices(const struct config* cfg);
+static void apply_timing(const struct config* cfg);
+static void config_changed(const struct config* cfg, const struct config* old);
+static void power_changed(int awake);
+static int  open_panels();
+static int  open_banks();
+static void close_banks();
+#ifdef WITH_EMBEDDED_PYTHON
+static int  start_embedded(const char* script);
+#endif
+static void toggle_debug(int sig);
+static void keys_ready(struct loop_source* src, uint32_t events);
 
 
 // ============================================================================
 
 
-static int gpio_d0=0, gpio_d1=2, gpio_d2=3;
-static int epfd=-1;
-static int fd_d0=-1, fd_d1=-1, fd_d2=-1;
+//// one gpio bank of the device table and its fds in the loop
+struct key_bank {
+    struct gpio_bank    bank;
+    int                 base;       /* key number of the bank's first line */
+    struct loop_source  sources[GPIO_MAX_LINES];
+};
+
+static const struct devtab_bank default_bank = { GPIO_CHIP, { 0, 2, 3 }, 3 };
+static const struct gpio_backend* gpio = NULL;
+static int native_render = 0;
+static const char* oled_bus = OLED_I2C_BUS;
+static int debounce_given = 0;      /* -d wins over the config file */
+static const char* ntp_given = NULL;
+static struct devtab devices;
+static struct key_bank banks[DEVTAB_MAX_BANKS];
+static int nbanks = 0;
+static int nkeys = 0;
+static struct gesture_config key_config[GESTURE_MAX_KEYS];
+static const int key_signals[] = { SIGUSR1, SIGUSR2, SIGALRM };
 
 
 // ============================================================================
@@ -41,324 +88,481 @@ static int fd_d0=-1, fd_d1=-1, fd_d2=-1;
 
 int main(int argc, char* argv[]) {
     char workpath[255];
-    struct epoll_event ev_d0, ev_d1, ev_d2;
-    struct epoll_event events[10];
-    unsigned int value = 0;
-    unsigned int k1 = 0,k2 = 0,k3 = 0;
-    int i, n;
-    char ch;
+    const char* backend = GPIO_BACKEND;
+    unsigned int watchdog_ms = SUPERVISE_WATCHDOG_MS;
+    const char* embed = NULL;
+    const char* conf_path = CONFIG_FILE;
+    const struct config* cfg;
+    const char* waits[DEVTAB_MAX_BANKS + RENDER_MAX_PANELS];
+    int i, nwaits = 0, opt;
+
+    while ((opt = getopt(argc, argv, "g:l:ri:d:w:e:t:D:")) != -1) {
+        switch (opt) {
+        case 'g':
+            backend = optarg;
+            break;
+        case 'l':
+            log_set_level(atoi(optarg));
+            break;
+        case 'r':
+            native_render = 1;
+            break;
+        case 'i':
+            oled_bus = optarg;
+            break;
+        case 'e':
+            embed = optarg;
+            break;
+        case 't':
+            ntp_given = optarg;
+            break;
+        case 'D':
+            conf_path = optarg;
+            break;
+        case 'w':
+            watchdog_ms = atoi(optarg) * 1000;
+            break;
+        case 'd':
+            if (parse_debounce(optarg) != 0) {
+                fprintf(stderr, "bad debounce list: %s\n", optarg);
+                exit(2);
+            }
+            debounce_given = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-g cdev|sysfs] [-l 0-3] [-r] [-i /dev/i2c-N] "
+                    "[-d ms[,ms...]] [-w seconds] [-e view.py] [-t ntp-server] [-D config]\n", argv[0]);
+            exit(2);
+        }
+    }
+    gpio = gpio_find_backend(backend);
+    if (gpio == NULL) {
+        fprintf(stderr, "unknown gpio backend: %s\n", backend);
+        exit(2);
+    }
 
     if (isAlreadyRunning() == 1) {
         exit(3);
     }
-    daemonize("nanohat-oled");
+    // under systemd (Type=notify) the started pid stays the main pid
+    daemonize("nanohat-oled", getenv("NOTIFY_SOCKET") != NULL);
+    log_start(LOG_FILE_NAME, LOG_MAX_SIZE);
+    signal(SIGUSR1, toggle_debug);
+    // a view that went away shows up as EPIPE on its pipe and sockets
+    signal(SIGPIPE, SIG_IGN);
 
     int ret = get_work_path(workpath, sizeof(workpath));
     if (ret != 0) {
         log2file("get_work_path ret error\n");
         return 1;
     }
-    sleep(3);
 
-    epfd = epoll_create(1);
-    if (epfd < 0) {
-        log2file("error creating epoll\n");
+    if (loop_init() != 0) {
         return 1;
     }
-
-    fd_d0 = init_gpio(gpio_d0, "rising");
-    if (fd_d0 < 0) {
-        log2file("error opening gpio sysfs entries\n");
-        return 1;
+    config_open(conf_path, config_changed);
+    cfg = config_get();
+    if (arena_init((size_t)cfg->arena_kb * 1024) != 0) {
+        log2file("no arena, allocating from the heap\n");
     }
+    load_devices(cfg);
+    apply_timing(cfg);
+    view_command(cfg->python, cfg->script);
 
-    fd_d1 = init_gpio(gpio_d1, "rising");
-    if (fd_d1  < 0) {
-        log2file("error opening gpio sysfs entries\n");
-        return 1;
+    // early in boot the gpio and i2c drivers may still be probing
+    if (gpio != &gpio_backend_cdev) {
+        waits[nwaits++] = "/sys/class/gpio/export";
+    }
+    for (i = 0; i < devices.nbanks && gpio == &gpio_backend_cdev; i++) {
+        waits[nwaits++] = devices.banks[i].chip;
     }
+    for (i = 0; i < devices.npanels; i++) {
+        waits[nwaits++] = devices.panels[i].bus;
+    }
+    devwait(waits, nwaits, DEVICE_WAIT_MS);
 
-    fd_d2 = init_gpio(gpio_d2, "rising");
-    if (fd_d2 < 0) {
-        log2file("error opening gpio sysfs entries\n");
-        return 1;
+    if (stats_open(STATS_SOCKET) != 0) {
+        log2file("stats socket unavailable\n");
     }
 
-    ev_d0.events = EPOLLET;
-    ev_d1.events = EPOLLET;
-    ev_d2.events = EPOLLET;
-    ev_d0.data.fd = fd_d0;
-    ev_d1.data.fd = fd_d1;
-    ev_d2.data.fd = fd_d2;
+    if (evring_create(EVRING_NAME, EVRING_SIZE) != 0) {
+        log2file("event ring unavailable, using signals only\n");
+    }
+    if (metrics_open(METRICS_NAME, cfg->metrics_ms) != 0) {
+        log2file("metrics collector unavailable\n");
+    }
+    if (history_open(cfg->history_path, cfg->history_samples, cfg->history_ms,
+            cfg->history_batch) != 0) {
+        log2file("no metrics history\n");
+    }
+    if (timesync_open(ntp_given ? ntp_given : cfg->ntp_server, TIMESYNC_SOCKET) != 0) {
+        log2file("time sync requests unavailable\n");
+    }
 
-    n = epoll_ctl(epfd, EPOLL_CTL_ADD, fd_d0, &ev_d0);
-    if (n != 0) {
-        log2file("epoll_ctl returned %d: %s\n", n, strerror(errno));
-        return 1;
+    if (devices.npanels > 0) {
+        if (open_panels() > 0 && draw_open(DRAW_SOCKET) == 0) {
+            setenv("NANOHAT_DRAW_SOCKET", DRAW_SOCKET, 1);
+            layout_load(cfg->layout_path);
+            if (power_open(cfg, power_changed) != 0) {
+                log2file("display power management unavailable\n");
+                render_contrast(cfg->brightness);
+            }
+        } else {
+            log2file("native renderer unavailable\n");
+            render_close();
+        }
     }
 
-    n = epoll_ctl(epfd, EPOLL_CTL_ADD, fd_d1, &ev_d1);
-    if (n != 0) {
-        log2file("epoll_ctl returned %d: %s\n", n, strerror(errno));
+    if (open_banks() == 0) {
         return 1;
     }
-
-    n = epoll_ctl(epfd, EPOLL_CTL_ADD, fd_d2, &ev_d2);
-    if (n != 0) {
-        log2file("epoll_ctl returned %d: %s\n", n, strerror(errno));
+    if (gesture_init(key_config, nkeys, dispatch_gesture) != 0) {
         return 1;
     }
+    if (sched_init(dispatch_frame) != 0) {
+        log2file("frame scheduler unavailable, views redraw on their own\n");
+    }
 
-    load_python_view(workpath);
-    while (1) {
-        n = epoll_wait(epfd, events, 10, 15);
-
-        for (i = 0; i < n; ++i) {
-            if (events[i].data.fd == ev_d0.data.fd) {
-                lseek(fd_d0, 0, SEEK_SET);
-                if (read(fd_d0, &ch, 1)>0) {
-                    log2file("k1 events: %c\n", ch);
-
-                    if (ch == '1') {
-                        send_signal_to_python_process(SIGUSR1);
-                    }
-                }
-            } else if (events[i].data.fd == ev_d1.data.fd) {
-                lseek(fd_d1, 0, SEEK_SET);
-                if (read(fd_d1, &ch, 1)>0) {
-                    log2file("k2 events: %c\n", ch);
-
-                    if (ch == '1') {
-                        send_signal_to_python_process(SIGUSR2);
-                    }
-                }
-            } else if (events[i].data.fd == ev_d2.data.fd) {
-                lseek(fd_d2, 0, SEEK_SET);
-                if (read(fd_d2, &ch, 1)>0) {
-                    log2file("k3 events: %c\n", ch);
-                    if (ch == '1') {
-                        send_signal_to_python_process(SIGALRM);
-                    }
-                }
-            }
-        }
+#ifdef WITH_EMBEDDED_PYTHON
+    if (embed != NULL && start_embedded(embed) != 0) {
+        log2file("embedded view failed, running %s as a process\n", cfg->script);
+        embed = NULL;
+    }
+#else
+    if (embed != NULL) {
+        log2file("built without embedded python, ignoring -e\n");
+        embed = NULL;
+    }
+#endif
+    if (embed == NULL && supervise_start(workpath, watchdog_ms) != 0) {
+        log2file("can't supervise the python view\n");
+        return 1;
     }
 
+    notify_supervisor("READY=1");
+    rtsched_apply(cfg->cpu_mask, cfg->rt_priority, cfg->lock_memory);
+    arena_seal();
+    loop_run();
     return 0;
 }
 
 
-//// search /proc/self/exe and get process work path
-int get_work_path(char* buff, int maxlen) {
-    ssize_t len = readlink("/proc/self/exe", buff, maxlen);
-    if (len == -1 || len == maxlen) {
-        return -1;
+//// the config's device table, or the single bank (and with -r panel) of old
+static void load_devices(const struct config* cfg) {
+    memcpy(&devices, &cfg->devices, sizeof(devices));
+    if (devices.nbanks == 0) {
+        devices.banks[devices.nbanks++] = default_bank;
     }
-    buff[len] = '\0';
-
-    char *pos = strrchr(buff, '/');
-    if (pos != 0) {
-       *pos = '\0';
+    if (devices.npanels == 0 && native_render) {
+        snprintf(devices.panels[0].bus, DEVTAB_PATH_MAX, "%s", oled_bus);
+        devices.npanels = 1;
     }
-    return 0;
 }
 
+//// key timing from the config, debounce only if -d didn't set it
+static void apply_timing(const struct config* cfg) {
+    int i;
 
-//// initialize gpio fd
-int init_gpio(int gpio, char* edge) {
-    char path[42];
-    FILE *fp;
-    int fd;
-
-    // export gpio to userspace
-    fp = fopen("/sys/class/gpio/export", "w");
-    if (fp) {
-        fprintf(fp, "%d\n", gpio);
-        fclose(fp);
+    for (i = 0; i < GESTURE_MAX_KEYS; i++) {
+        if (!debounce_given) {
+            key_config[i].debounce_ms = cfg->debounce_ms[i];
+        }
+        key_config[i].long_ms = cfg->long_ms;
+        key_config[i].repeat_ms = cfg->repeat_ms;
+        key_config[i].double_ms = cfg->double_ms;
     }
+}
 
-    // set output direction
-    sprintf(path, "/sys/class/gpio/gpio%d/direction", gpio);
-    fp = fopen(path, "w");
-    if (fp) {
-        fprintf(fp, "%s\n", "in");
-        fclose(fp);
+//// the config file changed: apply what can be applied while running
+static void config_changed(const struct config* cfg, const struct config* old) {
+    // the gesture engine reads key_config on every edge
+    apply_timing(cfg);
+    if (cfg->metrics_ms != old->metrics_ms) {
+        metrics_period(cfg->metrics_ms);
     }
-
-    // falling edge
-    sprintf(path, "/sys/class/gpio/gpio%d/edge", gpio);
-    fp = fopen(path, "w");
-    if (fp) {
-        fprintf(fp, "%s\n", edge);
-        fclose(fp);
+    if (strcmp(cfg->history_path, old->history_path) != 0 ||
+            cfg->history_samples != old->history_samples ||
+            cfg->history_ms != old->history_ms || cfg->history_batch != old->history_batch) {
+        history_open(cfg->history_path, cfg->history_samples, cfg->history_ms,
+                cfg->history_batch);
     }
-
-    sprintf(path, "/sys/class/gpio/gpio%d/value", gpio);
-    fd = open(path, O_RDWR | O_NONBLOCK);
-    if (fd < 0) {
-        log2file("open of gpio %d returned %d: %s\n",
-                gpio, fd, strerror(errno));
+    power_configure(cfg);
+    if (strcmp(cfg->layout_path, old->layout_path) != 0) {
+        layout_load(cfg->layout_path);
+    }
+    if (ntp_given == NULL) {
+        timesync_server(cfg->ntp_server);
+    }
+    if (strcmp(cfg->python, old->python) != 0 || strcmp(cfg->script, old->script) != 0) {
+        view_command(cfg->python, cfg->script);
+        log2file("view command %s %s from the next view start on\n", cfg->python, cfg->script);
+    }
+    if (memcmp(cfg->devices.panels, old->devices.panels, sizeof(cfg->devices.panels)) != 0 ||
+            cfg->devices.npanels != old->devices.npanels) {
+        log2file("panel changes take effect at the next daemon start\n");
+    }
+    if (memcmp(cfg->devices.banks, old->devices.banks, sizeof(cfg->devices.banks)) != 0 ||
+            cfg->devices.nbanks != old->devices.nbanks) {
+        close_banks();
+        gesture_close();
+        load_devices(cfg);
+        if (open_banks() == 0) {
+            log2file("no key bank could be opened\n");
+        }
+        gesture_init(key_config, nkeys, dispatch_gesture);
+        log2file("%d keys on %d banks\n", nkeys, nbanks);
     }
-
-    return fd;
 }
 
-//// close gpio and fd
-void release_gpio(int gpio) {
-    FILE* fp = fopen("/sys/class/gpio/unexport", "w");
-    if (fp) {
-        fprintf(fp, "%d\n", gpio);
-        fclose(fp);
+//// the panels went dark or woke up: stop or restart everything that makes
+//// frames, a woken view redraws at once
+static void power_changed(int awake) {
+    int suspend = !awake;
+
+    sched_suspend(suspend);
+    metrics_suspend(suspend);
+    timesync_suspend(suspend);
+    draw_suspend(suspend);
+    supervise_suspend(suspend);
+#ifdef WITH_EMBEDDED_PYTHON
+    pyembed_suspend(suspend);
+#endif
+    if (awake) {
+        dispatch_frame(SCHED_CLOCK | SCHED_METRICS | SCHED_KEYS, clock_ns(CLOCK_MONOTONIC));
     }
 }
 
+//// returns the number of panels that came up
+static int open_panels() {
+    int i;
 
-//// according signal to handle gpio fd
-//// NOTE: just a demo, but NOT use the function in this main.c
-void sig_handler(int sig)
-{
-    if(sig == SIGINT){
-        if (epfd>=0) {
-            close(epfd);
+    for (i = 0; i < devices.npanels; i++) {
+        if (render_init(devices.panels[i].bus, devices.panels[i].addr) < 0) {
+            log2file("panel on %s unavailable\n", devices.panels[i].bus);
         }
-        if (fd_d0>=0) {
-            close(fd_d0);
-            release_gpio(gpio_d0);
+    }
+    return render_active();
+}
+
+//// open every key bank and add its fds to the loop, keys are numbered in
+//// table order; returns the number of banks open
+static int open_banks() {
+    const struct gpio_backend* backend = gpio;
+    const struct devtab_bank* d;
+    struct key_bank* kb;
+    int i, j;
+
+    for (i = 0; i < devices.nbanks; i++) {
+        d = &devices.banks[i];
+        kb = &banks[nbanks];
+        if (nkeys + d->nlines > GESTURE_MAX_KEYS) {
+            log2file("more than %d keys, %s ignored\n", GESTURE_MAX_KEYS, d->chip);
+            continue;
         }
-        if (fd_d1>=0) {
-            close(fd_d1);
-            release_gpio(gpio_d1);
+        memset(kb, 0, sizeof(*kb));
+        kb->bank.backend = backend;
+        kb->bank.chip = d->chip;
+        memcpy(kb->bank.lines, d->lines, sizeof(d->lines));
+        kb->bank.nlines = d->nlines;
+        kb->bank.edges = GPIO_EDGE_BOTH;
+        if (gpio_open(&kb->bank) != 0) {
+            log2file("error opening gpio %s entries on %s\n", backend->name, d->chip);
+            continue;
         }
-        if (fd_d2>=0) {
-            close(fd_d2);
-            release_gpio(gpio_d2);
+        kb->base = nkeys;
+        for (j = 0; j < kb->bank.nfds; j++) {
+            kb->sources[j].fd = kb->bank.fds[j];
+            kb->sources[j].handler = keys_ready;
+            kb->sources[j].ctx = kb;
+            // sysfs signals edges as POLLPRI/POLLERR, the chardev as POLLIN
+            loop_add(&kb->sources[j], kb->bank.backend == &gpio_backend_sysfs ?
+                    EPOLLPRI | EPOLLET : EPOLLIN);
         }
-        log2file("ctrl+c has been keydown\n");
-        exit(0);
+        nkeys += d->nlines;
+        nbanks++;
     }
+    return nbanks;
 }
 
+static void close_banks() {
+    int i, j;
 
-// ============================================================================
+    for (i = 0; i < nbanks; i++) {
+        for (j = 0; j < banks[i].bank.nfds; j++) {
+            loop_del(&banks[i].sources[j]);
+        }
+        gpio_close(&banks[i].bank);
+    }
+    nbanks = 0;
+    nkeys = 0;
+}
 
+//// a gpio fd has pending edges: read batches until none is left, so a
+//// burst that arrived while the loop was busy is handled in this wakeup
+static void keys_ready(struct loop_source* src, uint32_t events) {
+    struct key_bank* kb = src->ctx;
+    struct gpio_event gev[GPIO_EVENT_BATCH];
+    uint32_t overruns = kb->bank.overruns, lost = kb->bank.lost;
+    int j, count;
+
+    do {
+        count = gpio_read_events(&kb->bank, src->fd, gev, GPIO_EVENT_BATCH);
+        for (j = 0; j < count; j++) {
+            gev[j].key += kb->base;
+            stats_edge(gev[j].key);
+            dispatch_key_event(&gev[j]);
+        }
+    } while (count == GPIO_EVENT_BATCH);
 
-//// pthread preparation
-pthread_t view_thread_id = 0;
-void* threadfunc(char* arg) {
-    pthread_detach(pthread_self());
-    if (arg) {
-        char* cmd = arg;
-        system(cmd);
-        free(arg);
+    if (kb->bank.overruns != overruns) {
+        stats_add(STAT_GPIO_OVERRUNS, kb->bank.overruns - overruns);
+        stats_add(STAT_GPIO_LOST, kb->bank.lost - lost);
+        log_msg(LOGLVL_DEBUG, "%s: %u edges lost\n", kb->bank.chip, kb->bank.lost - lost);
     }
 }
 
-//// threading python view
-int load_python_view(char *workpath) {
-    int ret;
-    char* cmd = (char*)malloc(255);
-    sprintf(cmd, "cd %s/BakeBit/Software/Python && python3 %s 2>&1 | tee /tmp/nanoled-python.log", workpath, PYTHON3_SCRIPT);
-    ret = pthread_create(&view_thread_id, NULL, (void*)threadfunc, cmd);
-    if(ret) {
-        log2file("create pthread error \n");
-        return 1;
+//// one raw key edge, the gesture engine debounces it
+static void dispatch_key_event(const struct gpio_event* ev) {
+    log_msg(LOGLVL_DEBUG, "k%d events: %c @%llu\n", ev->key + 1,
+            ev->edge == GPIO_EDGE_RISING ? '1' : '0',
+            (unsigned long long)ev->timestamp_ns);
+    gesture_edge(ev);
+}
+
+//// forward one debounced key event to the view
+//// views that mapped the event ring get every event, the others get a
+//// signal per press like before
+static void dispatch_gesture(int key, int kind, uint64_t timestamp_ns, uint32_t value) {
+    log_msg(LOGLVL_DEBUG, "k%d gesture %d (%u)\n", key + 1, kind, value);
+    if (power_key(key, kind, timestamp_ns)) {
+        return;     // it woke the panels
     }
-    return 0;
+    stats_add(STAT_EVENTS, 1);
+    if (kind == EVRING_KEY_DOWN) {
+        stats_press(timestamp_ns);
+    }
+
+#ifdef WITH_EMBEDDED_PYTHON
+    if (pyembed_active()) {
+        pyembed_key(key, kind, timestamp_ns, value);
+        sched_notify(SCHED_KEYS);
+        return;
+    }
+#endif
+    if (evring_attached()) {
+        evring_push(key, kind, timestamp_ns, value);
+    } else if (kind == EVRING_KEY_DOWN && key < 3) {
+        view_signal(key_signals[key]);
+    }
+    sched_notify(SCHED_KEYS);
 }
 
+//// the view's screen depends on something that changed, have it redraw
+static void dispatch_frame(uint32_t reasons, uint64_t timestamp_ns) {
+#ifdef WITH_EMBEDDED_PYTHON
+    if (pyembed_active()) {
+        pyembed_key(0, EVRING_FRAME, timestamp_ns, reasons);
+        return;
+    }
+#endif
+    evring_push(0, EVRING_FRAME, timestamp_ns, reasons);
+}
 
-// ============================================================================
+//// -d 20,20,50: debounce window per key in ms, the last one repeats
+static int parse_debounce(const char* arg) {
+    unsigned int i, ms = 0;
+    char* end;
 
+    for (i = 0; i < sizeof(key_config) / sizeof(key_config[0]); i++) {
+        if (*arg) {
+            ms = strtoul(arg, &end, 10);
+            if (end == arg || (*end && *end != ',') || ms > 1000) {
+                return -1;
+            }
+            arg = *end ? end + 1 : end;
+        }
+        key_config[i].debounce_ms = ms;
+    }
+    return 0;
+}
 
-//// find and get the pid in /proc by process name with exact match.
-int find_pid_by_name( char* ProcName, int* foundpid) {
-    DIR             *dir;
-    struct dirent   *d;
-    int             pid, i;
-    char            *s;
-    int             pnlen;
 
-    i = 0;
-    foundpid[0] = 0;
-    pnlen = strlen(ProcName);
+#ifdef WITH_EMBEDDED_PYTHON
+//// -e path/to/view.py: import the view into the daemon instead of spawning it
+static int start_embedded(const char* script) {
+    char dir[255], module[64];
+    const char* slash = strrchr(script, '/');
+    const char* name = slash ? slash + 1 : script;
+    int len;
 
-    /* Open the /proc directory. */
-    dir = opendir("/proc");
-    if (!dir)
-    {
-        log2file("cannot open /proc");
-        return -1;
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - script), script);
     }
+    len = strlen(name);
+    if (len > 3 && strcmp(name + len - 3, ".py") == 0) {
+        len -= 3;
+    }
+    snprintf(module, sizeof(module), "%.*s", len, name);
+    return pyembed_start(dir, module);
+}
+#endif
 
-    /* Walk through the directory. */
-    while ((d = readdir(dir)) != NULL) {
 
-        char exe [PATH_MAX+1];
-        char path[PATH_MAX+1];
-        int len;
-        int namelen;
+//// SIGUSR1 switches debug logging on and off at runtime
+static void toggle_debug(int sig) {
+    static int saved = LOGLVL_INFO;
+    int level = log_get_level();
 
-        /* See if this is a process */
-        if ((pid = atoi(d->d_name)) == 0) {
-            continue;
-        }
-
-        snprintf(exe, sizeof(exe), "/proc/%s/exe", d->d_name);
-        if ((len = readlink(exe, path, PATH_MAX)) < 0) {
-            continue;
-        }
-        path[len] = '\0';
+    if (level == LOGLVL_DEBUG) {
+        log_set_level(saved);
+    } else {
+        saved = level;
+        log_set_level(LOGLVL_DEBUG);
+    }
+}
 
-        /* Find ProcName */
-        s = strrchr(path, '/');
-        if (s == NULL) {
-            continue;
-        }
-        s++;
 
-        /* we don't need small name len */
-        namelen = strlen(s);
-        if (namelen < pnlen) {
-            continue;
-        }
+//// search /proc/self/exe and get process work path
+int get_work_path(char* buff, int maxlen) {
+    ssize_t len = readlink("/proc/self/exe", buff, maxlen);
+    if (len == -1 || len == maxlen) {
+        return -1;
+    }
+    buff[len] = '\0';
 
-        if (!strncmp(ProcName, s, pnlen)) {
-            /* to avoid subname like search proc tao but proc taolinke matched */
-            if (s[pnlen] == ' ' || s[pnlen] == '\0') {
-                if (DEBUG) {
-                    log2file("found pid %d\n", pid);
-                }
-                foundpid[i] = pid;
-                i++;
-            }
-        }
+    char *pos = strrchr(buff, '/');
+    if (pos != 0) {
+       *pos = '\0';
     }
-    foundpid[i] = 0;
-    closedir(dir);
     return 0;
 }
 
 
-//// find python process pid and send signal to the process
-static int py_pids[128];
-static int pid_count = 0;
-void send_signal_to_python_process(int signal) {
-    int i, rv;
-    if (pid_count == 0) {
-        //rv = find_pid_by_name( "python3.7", py_pids);
-        rv = find_pid_by_name(PYTHON3_INTERP, py_pids);
-        for(i=0; py_pids[i] != 0; i++) {
-            log2file("found python pid: %d\n", py_pids[i]);
-            pid_count++;
-        }
-    }
-    if (pid_count > 0) {
-        for(i=0; i<pid_count; i++) {
-            if (kill(py_pids[i], signal) != 0) { //maybe pid is invalid
-                pid_count = 0;
-                break;
-            }
-        }
+//// according signal to handle gpio fd
+//// NOTE: just a demo, but NOT use the function in this main.c
+void sig_handler(int sig)
+{
+    if(sig == SIGINT){
+        supervise_stop();
+#ifdef WITH_EMBEDDED_PYTHON
+        pyembed_stop();
+#endif
+        close_banks();
+        config_close();
+        loop_close();
+        gesture_close();
+        sched_close();
+        timesync_close();
+        evring_destroy();
+        metrics_close();
+        history_close();
+        power_close();
+        draw_close();
+        render_close();
+        stats_close();
+        log2file("ctrl+c has been keydown\n");
+        exit(0);
     }
 }
-
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include "metrics.h"
+#include "sched.h"
+#include "history.h"
+#include "draw.h"
+#include "timesync.h"
+#include "stats.h"
+#include "timer.h"
+#include "logger.h"
+
+/*
+ * Every source is opened once and re-read with pread() at offset 0, which
+ * makes procfs/sysfs regenerate the file, into one static buffer. Parsing
+ * works in place. CPU load is the difference to the previous sample, so a
+ * refresh never sleeps.
+ */
+
+
+// ============================================================================
+
+
+#define METRICS_BUF_SIZE    8192
+
+enum { SRC_STAT, SRC_MEMINFO, SRC_NETDEV, SRC_TEMP, SRC_ROOT, SRC_COUNT };
+
+static int fds[SRC_COUNT] = { -1, -1, -1, -1, -1 };
+static char buf[METRICS_BUF_SIZE];
+static struct metrics_header* shm = NULL;
+static const char* shm_name = NULL;
+static struct metrics current;
+static struct timer tick = { { -1, NULL, NULL } };
+static uint64_t prev_total = 0, prev_idle = 0;
+
+static const char* temp_sources[] = {
+    "/sys/class/thermal/thermal_zone0/temp",
+    "/sys/class/thermal/thermal_zone1/temp",
+    "/sys/class/hwmon/hwmon0/temp1_input",
+};
+
+
+//// re-read one source into buf, returns its length or -1
+static int slurp(int src) {
+    ssize_t n;
+
+    if (fds[src] < 0) {
+        return -1;
+    }
+    n = pread(fds[src], buf, sizeof(buf) - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+//// parse the next unsigned number at or after *p
+static uint64_t next_u64(char** p) {
+    while (**p && (**p < '0' || **p > '9')) {
+        (*p)++;
+    }
+    return strtoull(*p, p, 10);
+}
+
+//// value of a "Key:   1234 kB" line in meminfo
+static uint64_t meminfo_field(const char* key) {
+    char* p = strstr(buf, key);
+    return p ? next_u64(&p) : 0;
+}
+
+static void read_cpu() {
+    uint64_t v[8], total = 0, idle;
+    int64_t busy;
+    char* p = buf;
+    int i;
+
+    if (slurp(SRC_STAT) < 4 || strncmp(buf, "cpu ", 4) != 0) {
+        return;
+    }
+    // user nice system idle iowait irq softirq steal
+    for (i = 0; i < 8; i++) {
+        v[i] = next_u64(&p);
+        total += v[i];
+    }
+    idle = v[3] + v[4];
+    if (total > prev_total) {
+        // iowait may go back (proc(5)), so either delta can be off; clamp
+        busy = 1000 - ((int64_t)idle - (int64_t)prev_idle) * 1000 /
+                (int64_t)(total - prev_total);
+        current.cpu_permille = (uint32_t)(busy < 0 ? 0 : busy > 1000 ? 1000 : busy);
+    }
+    prev_total = total;
+    prev_idle = idle;
+}
+
+static void read_mem() {
+    if (slurp(SRC_MEMINFO) <= 0) {
+        return;
+    }
+    current.mem_total_kb = meminfo_field("MemTotal:");
+    current.mem_available_kb = meminfo_field("MemAvailable:");
+}
+
+static void read_net() {
+    uint64_t rx = 0, tx = 0;
+    char* line;
+    char* p;
+    int i;
+
+    if (slurp(SRC_NETDEV) <= 0) {
+        return;
+    }
+    // two header lines, then "iface: rx_bytes 7 more rx fields tx_bytes ..."
+    line = strchr(buf, '\n');
+    line = line ? strchr(line + 1, '\n') : NULL;
+    while (line != NULL && *++line) {
+        p = strchr(line, ':');
+        if (p == NULL) {
+            break;
+        }
+        while (*line == ' ') {
+            line++;
+        }
+        p++;
+        if (strncmp(line, "lo:", 3) != 0) {
+            rx += next_u64(&p);
+            for (i = 0; i < 7; i++) {
+                next_u64(&p);
+            }
+            tx += next_u64(&p);
+        }
+        line = strchr(p, '\n');
+    }
+    current.net_rx_bytes = rx;
+    current.net_tx_bytes = tx;
+}
+
+static void read_temp() {
+    if (slurp(SRC_TEMP) <= 0) {
+        current.temp_mdeg = METRICS_NO_TEMP;
+        return;
+    }
+    current.temp_mdeg = (int32_t)strtol(buf, NULL, 10);
+}
+
+static void read_disk() {
+    struct statvfs vfs;
+    uint64_t frsize;
+
+    if (fds[SRC_ROOT] < 0 || fstatvfs(fds[SRC_ROOT], &vfs) != 0) {
+        return;
+    }
+    frsize = vfs.f_frsize / 512;
+    current.disk_total_kb = (uint64_t)vfs.f_blocks * frsize / 2;
+    current.disk_used_kb = (uint64_t)(vfs.f_blocks - vfs.f_bfree) * frsize / 2;
+    current.disk_avail_kb = (uint64_t)vfs.f_bavail * frsize / 2;
+}
+
+//// copy current into the shared segment under the seqlock
+static void read_clock() {
+    struct timesync_state state;
+
+    timesync_state(&state);
+    current.clock_synced = state.synced;
+    current.clock_maxerror_us = state.maxerror_us;
+}
+
+static void publish() {
+    uint32_t seq;
+
+    if (shm == NULL) {
+        return;
+    }
+    seq = shm->seq;
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&shm->snapshot, &current, sizeof(current));
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void metrics_tick(struct timer* t, uint64_t expirations) {
+    metrics_refresh();
+    history_add(&current);
+    sched_notify(SCHED_METRICS);
+}
+
+
+// ============================================================================
+
+
+//// open the sources, create the shared segment and sample every period_ms
+//// a missing source only leaves its fields at zero
+int metrics_open(const char* name, unsigned int period_ms) {
+    unsigned int i;
+    int fd;
+
+    fds[SRC_STAT] = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    fds[SRC_MEMINFO] = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    fds[SRC_NETDEV] = open("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+    fds[SRC_ROOT] = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (i = 0; i < sizeof(temp_sources) / sizeof(temp_sources[0]); i++) {
+        fds[SRC_TEMP] = open(temp_sources[i], O_RDONLY | O_CLOEXEC);
+        if (fds[SRC_TEMP] >= 0) {
+            break;
+        }
+    }
+    if (fds[SRC_TEMP] < 0) {
+        log2file("no temperature sensor found\n");
+    }
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log2file("shm_open %s failed: %s\n", name, strerror(errno));
+    } else {
+        if (ftruncate(fd, sizeof(*shm)) == 0) {
+            shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (shm == MAP_FAILED) {
+                log2file("mmap %s failed: %s\n", name, strerror(errno));
+                shm = NULL;
+            }
+        }
+        close(fd);
+    }
+
+    metrics_refresh();
+    if (shm != NULL) {
+        shm->version = METRICS_VERSION;
+        shm->snapshot_size = sizeof(struct metrics);
+        shm->period_ms = period_ms;
+        __atomic_store_n(&shm->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+        shm_name = name;
+        setenv("NANOHAT_METRICS", name, 1);
+    }
+
+    if (timer_init(&tick, CLOCK_MONOTONIC, metrics_tick, NULL) != 0 ||
+            timer_start(&tick, period_ms * NSEC_PER_MSEC) != 0) {
+        log2file("metrics timer unavailable\n");
+        return -1;
+    }
+    return 0;
+}
+
+//// take a new sample and publish it
+void metrics_refresh() {
+    read_cpu();
+    read_mem();
+    read_net();
+    read_temp();
+    read_disk();
+    read_clock();
+    current.timestamp_ns = clock_ns(CLOCK_MONOTONIC);
+    publish();
+    stats_add(STAT_METRICS_SAMPLES, 1);
+    draw_update(&current);
+}
+
+//// sample every period_ms from now on
+int metrics_period(unsigned int period_ms) {
+    if (shm != NULL) {
+        shm->period_ms = period_ms;
+    }
+    return timer_start(&tick, period_ms * NSEC_PER_MSEC);
+}
+
+//// stop sampling, or sample now and go on every period_ms
+void metrics_suspend(int suspend) {
+    if (suspend) {
+        timer_pause(&tick);
+    } else if (tick.paused) {
+        metrics_refresh();
+        timer_resume(&tick);
+    }
+}
+
+//// the latest sample, for code running in the daemon
+void metrics_snapshot(struct metrics* out) {
+    memcpy(out, &current, sizeof(current));
+}
+
+void metrics_close() {
+    int i;
+
+    timer_close(&tick);
+    for (i = 0; i < SRC_COUNT; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+    if (shm != NULL) {
+        munmap(shm, sizeof(*shm));
+        shm = NULL;
+    }
+    if (shm_name != NULL) {
+        shm_unlink(shm_name);
+        shm_name = NULL;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef __METRICS__H__
+#define __METRICS__H__
+
+#include <stdint.h>
+
+/*
+ * System metrics sampled by the daemon and published in /dev/shm
+ * (METRICS_NAME) for the view. The segment is a header followed by one
+ * snapshot guarded by a seqlock: seq is odd while the daemon writes, a
+ * reader copies the snapshot and retries if seq was odd or changed.
+ *
+ *   0   magic           4   version         8   snapshot size   12  seq
+ *   16  period_ms       64  snapshot
+ */
+
+#define METRICS_NAME        "/nanohat-oled-metrics"
+#define METRICS_MAGIC       0x544d484e      /* "NHMT" */
+#define METRICS_VERSION     2
+#define METRICS_PERIOD_MS   1000
+#define METRICS_NO_TEMP     INT32_MIN
+
+struct metrics {
+    uint64_t    timestamp_ns;       /* CLOCK_MONOTONIC of the sample */
+    uint32_t    cpu_permille;       /* busy time since the previous sample */
+    int32_t     temp_mdeg;          /* METRICS_NO_TEMP without a sensor */
+    uint64_t    mem_total_kb;
+    uint64_t    mem_available_kb;
+    uint64_t    disk_total_kb;      /* of / */
+    uint64_t    disk_used_kb;
+    uint64_t    disk_avail_kb;
+    uint64_t    net_rx_bytes;       /* all interfaces but lo */
+    uint64_t    net_tx_bytes;
+    uint32_t    clock_synced;       /* kernel clock disciplined (adjtimex) */
+    uint32_t    clock_maxerror_us;
+};
+
+struct metrics_header {
+    uint32_t        magic;
+    uint32_t        version;
+    uint32_t        snapshot_size;
+    uint32_t        seq;
+    uint32_t        period_ms;
+    uint8_t         pad[44];
+    struct metrics  snapshot;
+};
+
+extern int  metrics_open(const char* name, unsigned int period_ms);
+extern void metrics_refresh();
+extern int  metrics_period(unsigned int period_ms);
+extern void metrics_suspend(int suspend);
+extern void metrics_snapshot(struct metrics* out);
+extern void metrics_close();
+
+
+#endif
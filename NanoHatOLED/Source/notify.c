@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "notify.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+//// send a state string such as "READY=1" to $NOTIFY_SOCKET (the sd_notify
+//// protocol, without libsystemd), returns 0 if sent, 1 if nobody listens
+//// main() does not fork when $NOTIFY_SOCKET is set, so this is sent from
+//// the pid systemd started, which NotifyAccess=main accepts
+int notify_supervisor(const char* state) {
+    const char* path = getenv("NOTIFY_SOCKET");
+    struct sockaddr_un addr;
+    char msg[128];
+    socklen_t len;
+    int fd, ret;
+
+    if (path == NULL || (path[0] != '/' && path[0] != '@') ||
+            strlen(path) >= sizeof(addr.sun_path)) {
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (path[0] == '@') {
+        addr.sun_path[0] = '\0';    // abstract namespace
+    }
+    len = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    snprintf(msg, sizeof(msg), "%s\nMAINPID=%d", state, (int)getpid());
+    ret = sendto(fd, msg, strlen(msg), MSG_NOSIGNAL, (struct sockaddr*)&addr, len);
+    if (ret < 0) {
+        log2file("notify %s failed: %s\n", path, strerror(errno));
+    }
+    close(fd);
+    return ret < 0 ? -1 : 0;
+}
@@ -0,0 +1,7 @@
+#ifndef __NOTIFY__H__
+#define __NOTIFY__H__
+
+extern int notify_supervisor(const char* state);
+
+
+#endif
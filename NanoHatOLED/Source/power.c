@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <time.h>
+#include "power.h"
+#include "render.h"
+#include "evring.h"
+#include "timer.h"
+#include "tz.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static power_handler on_change = NULL;
+static struct timer idle = { { -1, NULL, NULL } };
+static struct timer dim = { { -1, NULL, NULL } };
+static uint64_t timeout_ns = 0;
+static uint64_t last_key_ns = 0;
+static int asleep = 0;
+static int woke_key = -1;           /* key whose press woke the panels */
+static int woke_held = 0;           /* ... and it is still down */
+static int zone = 0;
+static unsigned int level_on, level_dim, dim_start, dim_end;
+static int contrast = -1;           /* level last sent */
+
+
+static int dim_hour(unsigned int hour) {
+    if (dim_start == dim_end) {
+        return 0;
+    }
+    if (dim_start < dim_end) {
+        return hour >= dim_start && hour < dim_end;
+    }
+    return hour >= dim_start || hour < dim_end;
+}
+
+//// set the contrast for the current hour and arm the timer for the next
+//// hour that starts or ends the dim window
+static void schedule_dim() {
+    int64_t now = clock_ns(CLOCK_REALTIME) / NSEC_PER_SEC;
+    int64_t next, change;
+    struct tz_local lt;
+    unsigned int h, hour;
+    int level;
+
+    tz_localtime(zone, now, &lt);
+    level = dim_hour(lt.hour) ? level_dim : level_on;
+    if (level != contrast) {
+        render_contrast(level);
+        contrast = level;
+    }
+    if (dim_start == dim_end) {
+        timer_stop(&dim);
+        return;
+    }
+    for (h = 1; h < 24; h++) {
+        hour = (lt.hour + h) % 24;
+        if (hour == dim_start || hour == dim_end) {
+            break;
+        }
+    }
+    next = now - lt.min * 60 - lt.sec + h * 3600;
+    // local hours move when the UTC offset does, look again then
+    change = tz_next_change(zone);
+    if (change > now && change < next) {
+        next = change;
+    }
+    // absolute, so a clock step (the boot time sync) brings it here again
+    timer_at(&dim, next * NSEC_PER_SEC);
+}
+
+static void dim_boundary(struct timer* t, uint64_t expirations) {
+    schedule_dim();
+}
+
+static void sleep_panels() {
+    asleep = 1;
+    timer_stop(&idle);
+    timer_stop(&dim);
+    render_power(0);
+    log_msg(LOGLVL_INFO, "panels asleep after %llu s without a key\n",
+            (unsigned long long)(timeout_ns / NSEC_PER_SEC));
+    if (on_change != NULL) {
+        on_change(0);
+    }
+}
+
+static void wake_panels() {
+    asleep = 0;
+    schedule_dim();     // the contrast goes out before the display comes on
+    render_power(1);
+    if (timeout_ns) {
+        timer_oneshot(&idle, timeout_ns);
+    }
+    log_msg(LOGLVL_INFO, "panels awake\n");
+    if (on_change != NULL) {
+        on_change(1);
+    }
+}
+
+//// keys don't re-arm the timer, it looks at the last key when it expires
+static void idle_check(struct timer* t, uint64_t expirations) {
+    uint64_t quiet = clock_ns(CLOCK_MONOTONIC) - last_key_ns;
+
+    if (timeout_ns == 0 || asleep) {
+        return;
+    }
+    if (quiet < timeout_ns) {
+        timer_oneshot(&idle, timeout_ns - quiet);
+        return;
+    }
+    sleep_panels();
+}
+
+
+// ============================================================================
+
+
+//// manage the panels' power from now on, changed is called on sleep and wake
+int power_open(const struct config* cfg, power_handler changed) {
+    if (timer_init(&idle, CLOCK_MONOTONIC, idle_check, NULL) != 0 ||
+            timer_init(&dim, CLOCK_REALTIME, dim_boundary, NULL) != 0) {
+        power_close();
+        return -1;
+    }
+    on_change = changed;
+    last_key_ns = clock_ns(CLOCK_MONOTONIC);
+    contrast = -1;
+    power_configure(cfg);
+    return 0;
+}
+
+//// timeout, brightness and dim window from the config
+void power_configure(const struct config* cfg) {
+    if (idle.src.fd < 0) {
+        return;
+    }
+    level_on = cfg->brightness;
+    level_dim = cfg->dim_brightness;
+    dim_start = cfg->dim_start;
+    dim_end = cfg->dim_end;
+    zone = tz_find(cfg->timezone);
+    timeout_ns = (uint64_t)cfg->display_timeout * NSEC_PER_SEC;
+    if (asleep) {
+        // nothing goes to a dark panel, waking sets the contrast
+        if (timeout_ns == 0) {
+            wake_panels();
+        }
+        return;
+    }
+    schedule_dim();
+    if (timeout_ns) {
+        idle_check(&idle, 0);
+    } else {
+        timer_stop(&idle);
+    }
+}
+
+//// note a key event; returns 1 if it must not reach the view: a press that
+//// wakes the panels and everything that press goes on to produce
+int power_key(int key, int kind, uint64_t timestamp_ns) {
+    if (idle.src.fd < 0) {
+        return 0;
+    }
+    if (asleep) {
+        if (kind != EVRING_KEY_DOWN) {
+            return 1;       // the end of a press that began before the sleep
+        }
+        last_key_ns = timestamp_ns;
+        woke_key = key;
+        woke_held = 1;
+        wake_panels();
+        return 1;
+    }
+    last_key_ns = timestamp_ns;
+    if (key == woke_key) {
+        if (woke_held) {
+            woke_held = kind != EVRING_KEY_UP;
+            return 1;
+        }
+        if (kind == EVRING_KEY_DOUBLE) {
+            woke_key = -1;  // its first half was the waking press
+            return 1;
+        }
+        if (kind != EVRING_KEY_DOWN) {
+            woke_key = -1;
+        }
+    } else if (kind == EVRING_KEY_DOWN) {
+        woke_key = -1;
+    }
+    return 0;
+}
+
+int power_awake() {
+    return !asleep;
+}
+
+void power_close() {
+    timer_close(&idle);
+    timer_close(&dim);
+    on_change = NULL;
+    asleep = 0;
+    woke_key = -1;
+}
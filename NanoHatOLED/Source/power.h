@@ -0,0 +1,34 @@
+#ifndef __POWER__H__
+#define __POWER__H__
+
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Display power. After display_timeout seconds without a key event the
+ * panels are switched off (SSD1306 display off, GDDRAM is kept) and the
+ * handler is told to stop everything that produces frames; with the timers
+ * paused and the writer thread holding commits, a sleeping unit makes no
+ * I2C transfers and has no timer wakeups. The next press wakes the panels
+ * and is swallowed, with the rest of that press (the release, a long press,
+ * a double press it would start), so a key meant to wake the unit doesn't
+ * also act on the screen.
+ *
+ * Between dim_start and dim_end, local hours in the config's timezone, the
+ * contrast is dim_brightness instead of brightness; a one-shot timer at the
+ * next boundary switches it.
+ */
+
+#define POWER_DIM_BRIGHTNESS    16
+
+//// awake 0: the panels went dark, 1: they are on again
+typedef void (*power_handler)(int awake);
+
+extern int  power_open(const struct config* cfg, power_handler changed);
+extern void power_configure(const struct config* cfg);
+extern int  power_key(int key, int kind, uint64_t timestamp_ns);
+extern int  power_awake();
+extern void power_close();
+
+
+#endif
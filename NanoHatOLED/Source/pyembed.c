@@ -0,0 +1,288 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "pyembed.h"
+#include "evring.h"
+#include "sched.h"
+#include "timesync.h"
+#include "timer.h"
+#include "loop.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+struct py_timer {
+    struct timer    t;
+    PyObject*       callback;
+};
+
+static PyObject* key_callback = NULL;
+static struct py_timer timers[PYEMBED_TIMERS];
+static int ntimers = 0;
+static PyThreadState* main_state = NULL;
+static int active = 0;
+
+//// print the pending exception to sys.stderr, which is the log
+static void report() {
+    if (PyErr_Occurred()) {
+        PyErr_Print();
+    }
+}
+
+static void call(PyObject* callable, PyObject* args) {
+    PyObject* ret;
+
+    if (args == NULL) {
+        report();
+        return;
+    }
+    ret = PyObject_CallObject(callable, args);
+    Py_DECREF(args);
+    if (ret == NULL) {
+        report();
+    }
+    Py_XDECREF(ret);
+}
+
+static void timer_fired(struct timer* t, uint64_t expirations) {
+    struct py_timer* pt = t->ctx;
+    PyGILState_STATE gil = PyGILState_Ensure();
+
+    call(pt->callback, Py_BuildValue("(K)", (unsigned long long)expirations));
+    PyGILState_Release(gil);
+}
+
+
+// ============================================================================
+// the nanohat_host module
+
+
+static PyObject* host_on_key(PyObject* self, PyObject* args) {
+    PyObject* callback;
+
+    if (!PyArg_ParseTuple(args, "O:on_key", &callback)) {
+        return NULL;
+    }
+    if (callback != Py_None && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "on_key needs a callable or None");
+        return NULL;
+    }
+    Py_CLEAR(key_callback);
+    if (callback != Py_None) {
+        Py_INCREF(callback);
+        key_callback = callback;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* host_every(PyObject* self, PyObject* args) {
+    struct py_timer* pt;
+    unsigned int ms;
+    PyObject* callback;
+
+    if (!PyArg_ParseTuple(args, "IO:every", &ms, &callback)) {
+        return NULL;
+    }
+    if (ms == 0 || !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_ValueError, "every needs a period in ms and a callable");
+        return NULL;
+    }
+    if (ntimers == PYEMBED_TIMERS) {
+        PyErr_SetString(PyExc_RuntimeError, "too many timers");
+        return NULL;
+    }
+    pt = &timers[ntimers];
+    if (timer_init(&pt->t, CLOCK_MONOTONIC, timer_fired, pt) != 0 ||
+            timer_start(&pt->t, ms * NSEC_PER_MSEC) != 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_INCREF(callback);
+    pt->callback = callback;
+    return PyLong_FromLong(ntimers++);
+}
+
+static PyObject* host_want(PyObject* self, PyObject* args) {
+    unsigned int mask;
+
+    if (!PyArg_ParseTuple(args, "I:want", &mask)) {
+        return NULL;
+    }
+    sched_want(mask);
+    Py_RETURN_NONE;
+}
+
+static PyObject* host_sync_time(PyObject* self, PyObject* args) {
+    return PyBool_FromLong(timesync_request() == 0);
+}
+
+static PyObject* host_log(PyObject* self, PyObject* args) {
+    const char* text;
+
+    if (!PyArg_ParseTuple(args, "s:log", &text)) {
+        return NULL;
+    }
+    log_msg(LOGLVL_INFO, "view: %s\n", text);
+    Py_RETURN_NONE;
+}
+
+static PyObject* host_stop(PyObject* self, PyObject* args) {
+    loop_stop();
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef host_methods[] = {
+    { "on_key", host_on_key, METH_VARARGS, "on_key(callback(key, kind, timestamp_ns, value))" },
+    { "every", host_every, METH_VARARGS, "every(ms, callback(expirations)), phase aligned" },
+    { "want", host_want, METH_VARARGS, "want(WANT_* mask), FRAME events when those change" },
+    { "sync_time", host_sync_time, METH_NOARGS, "start a time sync in the background" },
+    { "log", host_log, METH_VARARGS, "log(text) to the daemon's log" },
+    { "stop", host_stop, METH_NOARGS, "stop the daemon's event loop" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef host_module = {
+    PyModuleDef_HEAD_INIT, "nanohat_host", NULL, -1, host_methods,
+    NULL, NULL, NULL, NULL
+};
+
+static PyObject* host_init() {
+    PyObject* m = PyModule_Create(&host_module);
+
+    if (m != NULL) {
+        PyModule_AddIntConstant(m, "KEY_DOWN", EVRING_KEY_DOWN);
+        PyModule_AddIntConstant(m, "KEY_UP", EVRING_KEY_UP);
+        PyModule_AddIntConstant(m, "KEY_LONG", EVRING_KEY_LONG);
+        PyModule_AddIntConstant(m, "KEY_REPEAT", EVRING_KEY_REPEAT);
+        PyModule_AddIntConstant(m, "KEY_DOUBLE", EVRING_KEY_DOUBLE);
+        PyModule_AddIntConstant(m, "FRAME", EVRING_FRAME);
+        PyModule_AddIntConstant(m, "WANT_CLOCK", SCHED_CLOCK);
+        PyModule_AddIntConstant(m, "WANT_METRICS", SCHED_METRICS);
+        PyModule_AddIntConstant(m, "WANT_KEYS", SCHED_KEYS);
+    }
+    return m;
+}
+
+// line buffered sys.stdout/sys.stderr that end up in the log
+static const char redirect[] =
+    "import sys, nanohat_host\n"
+    "class _Log:\n"
+    "    def __init__(self):\n"
+    "        self.buf = ''\n"
+    "    def write(self, s):\n"
+    "        self.buf += s\n"
+    "        *lines, self.buf = self.buf.split('\\n')\n"
+    "        for line in lines:\n"
+    "            nanohat_host.log(line)\n"
+    "        return len(s)\n"
+    "    def flush(self):\n"
+    "        pass\n"
+    "sys.stdout = sys.stderr = _Log()\n";
+
+
+// ============================================================================
+
+
+//// start the interpreter, import module from dir and run its embedded_main()
+//// returns -1 if the interpreter or the module couldn't be loaded
+int pyembed_start(const char* dir, const char* module) {
+    PyObject *path, *entry, *mod, *ret;
+    int ok = -1;
+
+    PyImport_AppendInittab("nanohat_host", host_init);
+    Py_InitializeEx(0);     // leave signal handling to the daemon
+#if PY_VERSION_HEX < 0x03070000
+    PyEval_InitThreads();
+#endif
+    if (PyRun_SimpleString(redirect) != 0) {
+        log2file("can't redirect python output\n");
+    }
+
+    path = PySys_GetObject("path");
+    entry = PyUnicode_DecodeFSDefault(dir);
+    if (path != NULL && entry != NULL) {
+        PyList_Insert(path, 0, entry);
+    }
+    Py_XDECREF(entry);
+
+    mod = PyImport_ImportModule(module);
+    if (mod == NULL) {
+        report();
+        log2file("can't import %s from %s\n", module, dir);
+    } else {
+        if (PyObject_HasAttrString(mod, "embedded_main")) {
+            ret = PyObject_CallMethod(mod, "embedded_main", NULL);
+            if (ret == NULL) {
+                report();
+            } else {
+                ok = 0;
+            }
+            Py_XDECREF(ret);
+        } else {
+            log2file("%s has no embedded_main()\n", module);
+        }
+        // sys.modules keeps the module alive
+        Py_DECREF(mod);
+    }
+
+    // from here on the GIL is only taken for a callback
+    main_state = PyEval_SaveThread();
+    active = (ok == 0);
+    if (active) {
+        log2file("embedded python view %s running\n", module);
+    }
+    return ok;
+}
+
+int pyembed_active() {
+    return active;
+}
+
+void pyembed_key(int key, int kind, uint64_t timestamp_ns, uint32_t value) {
+    PyGILState_STATE gil;
+
+    if (!active || key_callback == NULL) {
+        return;
+    }
+    gil = PyGILState_Ensure();
+    call(key_callback, Py_BuildValue("(iiKI)", key, kind,
+            (unsigned long long)timestamp_ns, value));
+    PyGILState_Release(gil);
+}
+
+//// stop or restart the view's every() timers, while the panels sleep
+void pyembed_suspend(int suspend) {
+    int i;
+
+    for (i = 0; i < ntimers; i++) {
+        if (suspend) {
+            timer_pause(&timers[i].t);
+        } else {
+            timer_resume(&timers[i].t);
+        }
+    }
+}
+
+void pyembed_stop() {
+    int i;
+
+    if (main_state == NULL) {
+        return;
+    }
+    for (i = 0; i < ntimers; i++) {
+        timer_close(&timers[i].t);
+    }
+    PyEval_RestoreThread(main_state);
+    main_state = NULL;
+    active = 0;
+    for (i = 0; i < ntimers; i++) {
+        Py_CLEAR(timers[i].callback);
+    }
+    ntimers = 0;
+    Py_CLEAR(key_callback);
+    sched_want(0);
+    Py_Finalize();
+}
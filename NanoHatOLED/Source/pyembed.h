@@ -0,0 +1,32 @@
+#ifndef __PYEMBED__H__
+#define __PYEMBED__H__
+
+#include <stdint.h>
+
+/*
+ * Hosts the view inside the daemon (build with -DWITH_EMBEDDED_PYTHON and
+ * link libpython, see install.sh). The view module is imported once and its
+ * embedded_main() is called; it registers callbacks with the built-in
+ * nanohat_host module, which the event loop then calls with the GIL held
+ * for the duration of the call only:
+ *
+ *   import nanohat_host
+ *   nanohat_host.on_key(lambda key, kind, timestamp_ns, value: ...)
+ *   nanohat_host.every(1000, tick)
+ *   nanohat_host.log('text')
+ *   nanohat_host.stop()
+ *
+ * Key kinds are the EVRING_KEY_* values. print() output goes to the log.
+ * The every() timers are paused while the panels sleep.
+ */
+
+#define PYEMBED_TIMERS  8
+
+extern int  pyembed_start(const char* dir, const char* module);
+extern int  pyembed_active();
+extern void pyembed_key(int key, int kind, uint64_t timestamp_ns, uint32_t value);
+extern void pyembed_suspend(int suspend);
+extern void pyembed_stop();
+
+
+#endif
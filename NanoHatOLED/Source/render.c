@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "render.h"
+#include "ssd1306.h"
+#include "stats.h"
+#include "timer.h"
+#include "rtsched.h"
+#include "logger.h"
+
+/*
+ * The daemon owns the panels: clients draw into a panel's back framebuffer
+ * and a commit sends the pages that changed since that panel's last commit.
+ * Every panel has its own framebuffers, diff state and I2C queue, so one
+ * panel's traffic never waits on or resends another's.
+ *
+ * The I2C transfers run on a writer thread, so a slow bus never holds up the
+ * event loop. A commit copies the back buffer into a per-panel triple buffer
+ * and swaps it into the middle slot; the writer swaps the middle slot out
+ * when it is marked fresh. Neither side waits for the other, and when the
+ * writer falls behind the newest commit simply replaces the one waiting.
+ */
+
+
+// ============================================================================
+
+
+#define SLOT_FRESH  4       /* in middle: the slot holds an unflushed commit */
+
+struct render_panel {
+    struct ssd1306      panel;
+    struct fb           local;
+    struct fb*          back;
+    struct render_shm*  shm;
+    char                shm_name[32];
+    struct fb           slots[3];
+    int                 write;      /* slot the next commit goes to, loop thread */
+    int                 middle;     /* slot handed over, | SLOT_FRESH */
+    int                 read;       /* slot being flushed, writer thread */
+    int                 contrast;   /* level for the writer to set, or -1 */
+    int                 power;      /* display on (1) or off (0) to send, or -1 */
+    int                 dark;       /* display is off, writer thread */
+};
+
+static struct render_panel panels[RENDER_MAX_PANELS];
+static int npanels = 0;
+static pthread_t writer;
+static int writer_fd = -1;      /* eventfd, counts commits that need a wakeup */
+static int writer_stop = 0;
+
+
+//// put the back buffer in shared memory as name (NULL: the index's usual
+//// name), a private one is used if that fails
+static void share_back(struct render_panel* p, int index, const char* name) {
+    char env[16];
+    int fd;
+
+    if (index == 0) {
+        snprintf(p->shm_name, sizeof(p->shm_name), "%s", RENDER_FB_NAME);
+        snprintf(env, sizeof(env), "NANOHAT_FB");
+    } else {
+        snprintf(p->shm_name, sizeof(p->shm_name), "%s-%d", RENDER_FB_NAME, index);
+        snprintf(env, sizeof(env), "NANOHAT_FB_%d", index);
+    }
+    if (name != NULL) {
+        snprintf(p->shm_name, sizeof(p->shm_name), "%s", name);
+    }
+    fd = shm_open(p->shm_name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        log2file("shm_open %s failed: %s\n", p->shm_name, strerror(errno));
+        return;
+    }
+    fchmod(fd, 0666);   // any view may draw, like the draw socket
+    if (ftruncate(fd, sizeof(*p->shm)) == 0) {
+        p->shm = mmap(NULL, sizeof(*p->shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p->shm == MAP_FAILED) {
+            log2file("mmap %s failed: %s\n", p->shm_name, strerror(errno));
+            p->shm = NULL;
+        }
+    }
+    close(fd);
+    if (p->shm == NULL) {
+        return;
+    }
+
+    p->shm->version = RENDER_FB_VERSION;
+    p->shm->width = FB_WIDTH;
+    p->shm->height = FB_HEIGHT;
+    p->shm->frames = 0;
+    __atomic_store_n(&p->shm->magic, RENDER_FB_MAGIC, __ATOMIC_RELEASE);
+    p->back = &p->shm->fb;
+    setenv(env, p->shm_name, 1);
+}
+
+static void unshare_back(struct render_panel* p) {
+    if (p->shm != NULL) {
+        munmap(p->shm, sizeof(*p->shm));
+        p->shm = NULL;
+        shm_unlink(p->shm_name);
+    }
+    p->back = &p->local;
+}
+
+
+static void wake_writer() {
+    uint64_t one = 1;
+
+    if (write(writer_fd, &one, sizeof(one)) < 0) {
+        log2file("render writer wakeup: %s\n", strerror(errno));
+    }
+}
+
+//// send the newest commit of every panel that has one, until none is left;
+//// panel commands go first, a dark panel keeps its commit until it is on
+static void flush_fresh() {
+    struct render_panel* p;
+    uint64_t start;
+    int i, n, level, more = 1;
+
+    while (more) {
+        more = 0;
+        n = __atomic_load_n(&npanels, __ATOMIC_ACQUIRE);
+        for (i = 0; i < n; i++) {
+            p = &panels[i];
+            level = __atomic_exchange_n(&p->contrast, -1, __ATOMIC_ACQ_REL);
+            if (level >= 0 && ssd1306_contrast(&p->panel, level) != 0) {
+                log2file("contrast of panel %d: i2c error\n", i);
+            }
+            level = __atomic_exchange_n(&p->power, -1, __ATOMIC_ACQ_REL);
+            if (level >= 0) {
+                if (ssd1306_power(&p->panel, level) != 0) {
+                    log2file("power of panel %d: i2c error\n", i);
+                }
+                p->dark = !level;
+            }
+            if (p->dark || !(__atomic_load_n(&p->middle, __ATOMIC_ACQUIRE) & SLOT_FRESH)) {
+                continue;
+            }
+            p->read = __atomic_exchange_n(&p->middle, p->read, __ATOMIC_ACQ_REL) & 3;
+            start = clock_ns(CLOCK_MONOTONIC);
+            if (ssd1306_flush(&p->panel, &p->slots[p->read]) >= 0) {
+                stats_frame(start, clock_ns(CLOCK_MONOTONIC));
+            }
+            if (p->shm != NULL) {
+                __atomic_add_fetch(&p->shm->frames, 1, __ATOMIC_RELEASE);
+            }
+            more = 1;
+        }
+    }
+}
+
+static void* writer_thread(void* arg) {
+    uint64_t n;
+
+    rtsched_thread(RTSCHED_OUTPUT);
+    while (!__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE)) {
+        if (read(writer_fd, &n, sizeof(n)) < 0 && errno != EINTR) {
+            log2file("render writer: %s\n", strerror(errno));
+            break;
+        }
+        flush_fresh();
+    }
+    return NULL;
+}
+
+//// signals stay with the loop thread, the writer never runs a handler
+static int start_writer() {
+    pthread_attr_t attr;
+    sigset_t all, old;
+    int ret;
+
+    writer_fd = eventfd(0, EFD_CLOEXEC);
+    if (writer_fd < 0) {
+        log2file("render eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+    writer_stop = 0;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    rtsched_attr(&attr);
+    ret = pthread_create(&writer, &attr, writer_thread, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        log2file("render writer thread: %s\n", strerror(ret));
+        close(writer_fd);
+        writer_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_writer() {
+    if (writer_fd < 0) {
+        return;
+    }
+    __atomic_store_n(&writer_stop, 1, __ATOMIC_RELEASE);
+    wake_writer();
+    pthread_join(writer, NULL);
+    close(writer_fd);
+    writer_fd = -1;
+}
+
+
+// ============================================================================
+
+
+//// open one more panel, returns its index or -1
+int render_init(const char* bus, int addr) {
+    struct ssd1306 panel;
+
+    if (npanels == RENDER_MAX_PANELS) {
+        log2file("too many panels, %s ignored\n", bus);
+        return -1;
+    }
+    if (ssd1306_open(&panel, bus, addr) != 0) {
+        return -1;
+    }
+    return render_add(&panel, NULL);
+}
+
+//// drive a panel opened by the caller (the bench's mock bus), its back
+//// buffer shared as shm_name (NULL: the usual name); index or -1
+int render_add(const struct ssd1306* panel, const char* shm_name) {
+    struct render_panel* p;
+
+    if (npanels == RENDER_MAX_PANELS) {
+        return -1;
+    }
+    p = &panels[npanels];
+    memset(p, 0, sizeof(*p));
+    p->back = &p->local;
+    memcpy(&p->panel, panel, sizeof(p->panel));
+    share_back(p, npanels, shm_name);
+    fb_clear(p->back, FB_BLACK);
+    // the first frame goes out here, so a panel that doesn't answer is dropped
+    if (ssd1306_flush(&p->panel, p->back) < 0 || (writer_fd < 0 && start_writer() != 0)) {
+        ssd1306_close(&p->panel);
+        unshare_back(p);
+        return -1;
+    }
+    p->write = 0;
+    p->middle = 1;
+    p->read = 2;
+    p->contrast = -1;
+    p->power = -1;
+    __atomic_store_n(&npanels, npanels + 1, __ATOMIC_RELEASE);
+    return npanels - 1;
+}
+
+//// number of panels driven
+int render_active() {
+    return npanels;
+}
+
+struct fb* render_fb(int panel) {
+    return panel >= 0 && panel < npanels ? panels[panel].back : NULL;
+}
+
+//// hand a panel's back buffer to the writer thread, returns 0 or -1; a
+//// commit the writer hasn't taken yet is replaced
+int render_commit(int panel) {
+    struct render_panel* p;
+    int prev;
+
+    if (panel < 0 || panel >= npanels) {
+        return -1;
+    }
+    p = &panels[panel];
+    memcpy(&p->slots[p->write], p->back, sizeof(struct fb));
+    prev = __atomic_exchange_n(&p->middle, p->write | SLOT_FRESH, __ATOMIC_ACQ_REL);
+    p->write = prev & 3;
+    if (prev & SLOT_FRESH) {
+        stats_add(STAT_FRAMES_MERGED, 1);
+    } else {
+        wake_writer();
+    }
+    return 0;
+}
+
+//// set the contrast (0-255) of every panel, sent by the writer thread
+void render_contrast(int level) {
+    int i;
+
+    for (i = 0; i < npanels; i++) {
+        __atomic_store_n(&panels[i].contrast, level, __ATOMIC_RELEASE);
+    }
+    if (npanels > 0) {
+        wake_writer();
+    }
+}
+
+//// switch every panel's display on or off, sent by the writer thread; an
+//// off panel makes no transfers, commits wait until it is on again
+void render_power(int on) {
+    int i;
+
+    for (i = 0; i < npanels; i++) {
+        __atomic_store_n(&panels[i].power, on ? 1 : 0, __ATOMIC_RELEASE);
+    }
+    if (npanels > 0) {
+        wake_writer();
+    }
+}
+
+void render_close() {
+    int i;
+
+    stop_writer();
+    for (i = 0; i < npanels; i++) {
+        ssd1306_close(&panels[i].panel);
+        unshare_back(&panels[i]);
+    }
+    npanels = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __RENDER__H__
+#define __RENDER__H__
+
+#include <stdint.h>
+#include "fb.h"
+#include "ssd1306.h"
+
+/*
+ * The back framebuffer lives in /dev/shm (RENDER_FB_NAME) so a view can draw
+ * into it directly and only send DRAW_COMMIT; frames counts flushes, so a
+ * client can tell when its commit went out. Panels after the first get
+ * their own segment, RENDER_FB_NAME with "-N" appended ($NANOHAT_FB_N).
+ *
+ *   0   magic   4   version   8   width   12  height   16  frames   64  pixels
+ */
+
+#define RENDER_FB_NAME      "/nanohat-oled-fb"
+#define RENDER_FB_MAGIC     0x4246484e      /* "NHFB" */
+#define RENDER_FB_VERSION   1
+#define RENDER_MAX_PANELS   4
+
+struct render_shm {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    frames;
+    uint8_t     pad[44];
+    struct fb   fb;
+};
+
+extern int  render_init(const char* bus, int addr);
+extern int  render_add(const struct ssd1306* panel, const char* shm_name);
+extern int  render_active();
+extern struct fb* render_fb(int panel);
+extern int  render_commit(int panel);
+extern void render_contrast(int level);
+extern void render_power(int on);
+extern void render_close();
+
+
+#endif
@@ -0,0 +1,526 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include "daemonize.h"
+#include "gpio.h"
+#include "gesture.h"
+#include "evring.h"
+#include "sched.h"
+#include "config.h"
+#include "stats.h"
+#include "loop.h"
+#include "timer.h"
+#include "logger.h"
+
+/*
+ * NanoHatOLED-replay: plays a recorded edge trace through the daemon's
+ * input path (debounce and gesture engine, event ring, frame scheduler),
+ * reads the ring back the way a view does and checks what came out:
+ *
+ *   - every press in the trace, a level that stayed high for at least the
+ *     key's debounce_ms, produced a KEY_DOWN (more is a glitch, not a loss)
+ *   - per key DOWN and UP alternate, LONG and REPEAT (counting from 1) only
+ *     come while the key is down, DOUBLE right after its DOWN
+ *   - timestamps never go back, every key event is followed by its frame,
+ *     and the ring dropped nothing
+ *
+ * By default the engine runs on a virtual clock, deadlines in time order
+ * straight after the edges, as fast as it goes and the same on every run;
+ * -x plays the trace at 1x on the real loop and timers instead.
+ *
+ * A trace is one edge per line, "timestamp_ns key level", in time order.
+ * The daemon's debug log is a trace too: SIGUSR1 switches it on, and every
+ * "kN events: L @ns" line in it is an edge. -z seed makes a trace of -n
+ * presses on three keys with the worst bounce the debounce window allows,
+ * edges down to a microsecond apart; then the counts must match exactly.
+ *
+ * Key timing comes from the config file (-D, CONFIG_FILE by default).
+ */
+
+
+// ============================================================================
+
+
+#define REPLAY_RING     "/nanohat-oled-replay"
+#define REPLAY_KEYS     3           /* of a -z trace */
+#define REPLAY_FAILS    10          /* reported, the rest only counted */
+
+struct edge {
+    uint64_t    ns;
+    int         key;
+    int         level;
+};
+
+static struct edge* edges = NULL;
+static int nedges = 0, edges_max = 0;
+static int nkeys = 0;
+static struct gesture_config key_config[GESTURE_MAX_KEYS];
+
+// the consumer's view of the ring
+static struct evring_header* ring = NULL;
+static int exact = 0;               /* a -z trace: DOWN count must match */
+static int down[GESTURE_MAX_KEYS];
+static uint32_t repeats[GESTURE_MAX_KEYS];
+static int last_kind[GESTURE_MAX_KEYS];
+static uint64_t last_ns = 0;
+static int frame_owed = 0;
+static unsigned int counts[EVRING_FRAME + 1];
+static unsigned int presses[GESTURE_MAX_KEYS];
+static unsigned int fails = 0;
+
+static const char* kind_names[] = { "?", "down", "up", "long", "repeat", "double", "frame" };
+
+
+static void fail(const struct evring_entry* e, const char* what) {
+    if (fails++ < REPLAY_FAILS) {
+        printf("  FAIL k%d %s @%llu: %s\n", e->key + 1, kind_names[e->kind],
+                (unsigned long long)e->timestamp_ns, what);
+    }
+}
+
+static void add_edge(uint64_t ns, int key, int level) {
+    if (key < 0 || key >= GESTURE_MAX_KEYS) {
+        return;
+    }
+    if (nedges == edges_max) {
+        edges_max = edges_max ? edges_max * 2 : 4096;
+        edges = realloc(edges, edges_max * sizeof(*edges));
+        if (edges == NULL) {
+            perror("trace");
+            exit(1);
+        }
+    }
+    edges[nedges].ns = ns;
+    edges[nedges].key = key;
+    edges[nedges].level = level != 0;
+    nedges++;
+    if (key >= nkeys) {
+        nkeys = key + 1;
+    }
+}
+
+//// native lines and the daemon's "kN events: L @ns" debug lines
+static int load_trace(FILE* f) {
+    char line[256];
+    unsigned long long ns;
+    const char* p;
+    int key, level;
+    char c;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if ((p = strstr(line, " events: ")) != NULL) {
+            while (p > line && p[-1] != ' ') {
+                p--;
+            }
+            if (sscanf(p, "k%d events: %c @%llu", &key, &c, &ns) == 3) {
+                add_edge(ns, key - 1, c == '1');
+            }
+            continue;
+        }
+        if (line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%llu %d %d", &ns, &key, &level) == 3) {
+            add_edge(ns, key, level);
+        }
+    }
+    return nedges;
+}
+
+static uint64_t rand_state;
+
+static uint64_t next_rand() {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+static uint64_t rand_ns(uint64_t lo, uint64_t hi) {
+    return lo + next_rand() % (hi - lo + 1);
+}
+
+//// a contact closing or opening: up to 8 bounces, all of them inside the
+//// window, and the contact settles where it was going
+static uint64_t bounce(uint64_t t, int key, int level, uint64_t window) {
+    int i, n = 2 * (next_rand() % 9);
+    uint64_t span = rand_ns(n * 1000, window - 1);
+    uint64_t at = t;
+
+    add_edge(t, key, level);
+    for (i = 1; i <= n; i++) {
+        at = t + span * i / n;
+        add_edge(at, key, (i & 1) ? !level : level);
+    }
+    return at;
+}
+
+static int cmp_edge(const void* a, const void* b) {
+    const struct edge *x = a, *y = b;
+    return x->ns < y->ns ? -1 : x->ns > y->ns ? 1 : x->key - y->key;
+}
+
+//// n presses per key, random gaps and holds, merged into one trace
+static void make_trace(uint64_t seed, int n) {
+    uint64_t t, window;
+    int key, i;
+
+    rand_state = seed ? seed : 1;
+    for (key = 0; key < REPLAY_KEYS; key++) {
+        window = (key_config[key].debounce_ms ? key_config[key].debounce_ms : 1) * NSEC_PER_MSEC;
+        t = NSEC_PER_SEC;
+        for (i = 0; i < n; i++) {
+            t += window + rand_ns(0, 400 * NSEC_PER_MSEC);
+            t = bounce(t, key, 1, window);
+            t += window + rand_ns(0, i % 4 ? 200 * NSEC_PER_MSEC : 2 * NSEC_PER_SEC);
+            t = bounce(t, key, 0, window);
+        }
+    }
+    qsort(edges, nedges, sizeof(*edges), cmp_edge);
+    exact = 1;
+}
+
+//// presses as the debounce window sees them: high levels that lasted
+static void count_presses() {
+    uint64_t since[GESTURE_MAX_KEYS];
+    int level[GESTURE_MAX_KEYS];
+    uint64_t window;
+    int i, k;
+
+    memset(level, 0, sizeof(level));
+    memset(since, 0, sizeof(since));
+    for (i = 0; i <= nedges; i++) {
+        for (k = 0; k < nkeys; k++) {
+            window = key_config[k].debounce_ms * NSEC_PER_MSEC;
+            if (level[k] == 1 && (i == nedges || (edges[i].key == k &&
+                    edges[i].ns - since[k] >= window))) {
+                presses[k]++;
+                level[k] = 2;       // counted, until the next edge
+            }
+        }
+        if (i == nedges) {
+            break;
+        }
+        k = edges[i].key;
+        level[k] = edges[i].level;
+        since[k] = edges[i].ns;
+    }
+}
+
+
+// ============================================================================
+// the daemon's side: what main.c does with a gesture and a frame
+
+
+static void on_gesture(int key, int kind, uint64_t timestamp_ns, uint32_t value) {
+    stats_add(STAT_EVENTS, 1);
+    evring_push(key, kind, timestamp_ns, value);
+    sched_notify(SCHED_KEYS);
+}
+
+static void on_frame(uint32_t reasons, uint64_t timestamp_ns) {
+    evring_push(0, EVRING_FRAME, timestamp_ns, reasons);
+}
+
+
+// ============================================================================
+// the view's side
+
+
+static void check(const struct evring_entry* e) {
+    int k = e->key;
+
+    if (e->kind == EVRING_FRAME) {
+        if (!(e->value & SCHED_KEYS)) {
+            fail(e, "frame without SCHED_KEYS");
+        }
+        frame_owed = 0;
+        counts[EVRING_FRAME]++;
+        return;
+    }
+    if (e->kind < EVRING_KEY_DOWN || e->kind > EVRING_KEY_DOUBLE || k >= nkeys) {
+        fail(e, "unknown event");
+        return;
+    }
+    counts[e->kind]++;
+    if (frame_owed) {
+        fail(e, "the previous event got no frame");
+    }
+    frame_owed = 1;
+    if (e->timestamp_ns < last_ns) {
+        fail(e, "timestamp went back");
+    }
+    last_ns = e->timestamp_ns;
+
+    switch (e->kind) {
+    case EVRING_KEY_DOWN:
+        if (down[k]) {
+            fail(e, "down while down");
+        }
+        down[k] = 1;
+        repeats[k] = 0;
+        break;
+    case EVRING_KEY_UP:
+        if (!down[k]) {
+            fail(e, "up while up");
+        }
+        down[k] = 0;
+        break;
+    case EVRING_KEY_LONG:
+        if (!down[k] || repeats[k] != 0 || last_kind[k] == EVRING_KEY_LONG) {
+            fail(e, "long out of place");
+        }
+        break;
+    case EVRING_KEY_REPEAT:
+        if (!down[k] || e->value != ++repeats[k]) {
+            fail(e, "repeat out of place or count");
+        }
+        break;
+    case EVRING_KEY_DOUBLE:
+        if (last_kind[k] != EVRING_KEY_DOWN) {
+            fail(e, "double not right after its down");
+        }
+        break;
+    }
+    last_kind[k] = e->kind;
+}
+
+static void drain() {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = ring->tail;
+
+    for (; tail != head; tail++) {
+        check(&ring->entries[tail & (ring->size - 1)]);
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void ring_ready(struct loop_source* src, uint32_t events) {
+    uint64_t n;
+
+    if (read(src->fd, &n, sizeof(n)) < 0 && errno != EAGAIN) {
+        perror("eventfd");
+    }
+    drain();
+}
+
+//// map the ring as a view would and announce ourselves, keys only
+static int attach() {
+    size_t bytes = sizeof(struct evring_header) + EVRING_SIZE * sizeof(struct evring_entry);
+    int fd = shm_open(REPLAY_RING, O_RDWR, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    ring = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        ring = NULL;
+        return -1;
+    }
+    ring->wants = SCHED_KEYS;
+    __atomic_store_n(&ring->consumer_pid, getpid(), __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+// ============================================================================
+// the two clocks
+
+
+static uint64_t settle_ns() {
+    unsigned int i, ms = 0;
+
+    for (i = 0; i < (unsigned int)nkeys; i++) {
+        ms = key_config[i].debounce_ms > ms ? key_config[i].debounce_ms : ms;
+    }
+    return (ms + 1) * NSEC_PER_MSEC;
+}
+
+static void replay_virtual() {
+    struct gpio_event ev;
+    int i;
+
+    memset(&ev, 0, sizeof(ev));
+    for (i = 0; i < nedges; i++) {
+        ev.key = edges[i].key;
+        ev.edge = edges[i].level ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+        ev.timestamp_ns = edges[i].ns;
+        ev.seqno = i + 1;
+        gesture_edge(&ev);
+        drain();
+    }
+    // settle windows still open at the end of the trace
+    gesture_expire(edges[nedges - 1].ns + settle_ns());
+    drain();
+}
+
+static struct timer player = { { -1, NULL, NULL } };
+static uint64_t start_ns, offset_ns;
+static int played = 0;
+
+static void arm_next() {
+    uint64_t at = played < nedges ? edges[played].ns - offset_ns
+                                  : edges[nedges - 1].ns - offset_ns + settle_ns();
+    uint64_t now = clock_ns(CLOCK_MONOTONIC) - start_ns;
+
+    timer_oneshot(&player, at > now ? at - now : 1);
+}
+
+//// edges are played at their offset in the trace, stamped with the real clock
+static void play(struct timer* t, uint64_t expirations) {
+    struct gpio_event ev;
+    uint64_t now = clock_ns(CLOCK_MONOTONIC) - start_ns;
+
+    if (played == nedges) {
+        loop_stop();
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    while (played < nedges && edges[played].ns - offset_ns <= now) {
+        ev.key = edges[played].key;
+        ev.edge = edges[played].level ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+        ev.timestamp_ns = start_ns + edges[played].ns - offset_ns;
+        ev.seqno = ++played;
+        gesture_edge(&ev);
+    }
+    arm_next();
+}
+
+static void replay_realtime() {
+    struct loop_source src = { evring_eventfd(), ring_ready, NULL };
+
+    if (timer_init(&player, CLOCK_MONOTONIC, play, NULL) != 0 || loop_add(&src, EPOLLIN) != 0) {
+        fprintf(stderr, "loop setup failed\n");
+        exit(1);
+    }
+    start_ns = clock_ns(CLOCK_MONOTONIC);
+    offset_ns = edges[0].ns;
+    arm_next();
+    loop_run();
+    drain();
+    loop_del(&src);
+    timer_close(&player);
+}
+
+
+// ============================================================================
+
+
+int main(int argc, char* argv[]) {
+    const char* conf_path = CONFIG_FILE;
+    struct config cfg;
+    uint64_t seed = 0, t0, t;
+    unsigned int total = 0, want = 0;
+    int realtime = 0, n = 1000, i, opt;
+    FILE* f = stdin;
+
+    while ((opt = getopt(argc, argv, "D:xz:n:")) != -1) {
+        switch (opt) {
+        case 'D':
+            conf_path = optarg;
+            break;
+        case 'x':
+            realtime = 1;
+            break;
+        case 'z':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'n':
+            n = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-D config] [-x] [-z seed [-n presses]] [trace]\n", argv[0]);
+            exit(2);
+        }
+    }
+    log_set_level(LOGLVL_WARN);
+    config_compile(conf_path, &cfg);    // defaults when it can't be read
+    for (i = 0; i < GESTURE_MAX_KEYS; i++) {
+        key_config[i].debounce_ms = cfg.debounce_ms[i];
+        key_config[i].long_ms = cfg.long_ms;
+        key_config[i].repeat_ms = cfg.repeat_ms;
+        key_config[i].double_ms = cfg.double_ms;
+    }
+
+    if (seed) {
+        make_trace(seed, n < 1 ? 1 : n);
+    } else {
+        if (optind < argc && (f = fopen(argv[optind], "r")) == NULL) {
+            perror(argv[optind]);
+            exit(2);
+        }
+        load_trace(f);
+    }
+    if (nedges == 0) {
+        fprintf(stderr, "no edges in the trace\n");
+        exit(2);
+    }
+    for (i = 1; i < nedges; i++) {
+        if (edges[i].ns < edges[i - 1].ns) {
+            fprintf(stderr, "trace goes back in time at edge %d\n", i + 1);
+            exit(2);
+        }
+    }
+    count_presses();
+
+    if (!realtime) {
+        gesture_virtual();
+    }
+    if (loop_init() != 0 || evring_create(REPLAY_RING, EVRING_SIZE) != 0 || attach() != 0 ||
+            gesture_init(key_config, nkeys, on_gesture) != 0 || sched_init(on_frame) != 0) {
+        fprintf(stderr, "setup failed\n");
+        evring_destroy();
+        return 1;
+    }
+    printf("%d edges on %d keys over %.1f s, debounce %u ms, %s\n", nedges, nkeys,
+            (edges[nedges - 1].ns - edges[0].ns) / 1e9, key_config[0].debounce_ms,
+            realtime ? "played at 1x" : "virtual clock");
+
+    t0 = clock_ns(CLOCK_MONOTONIC);
+    if (realtime) {
+        replay_realtime();
+    } else {
+        replay_virtual();
+    }
+    t = clock_ns(CLOCK_MONOTONIC) - t0;
+
+    for (i = EVRING_KEY_DOWN; i <= EVRING_KEY_DOUBLE; i++) {
+        total += counts[i];
+    }
+    printf("  %u events: %u down, %u up, %u long, %u repeat, %u double; %u frames\n",
+            total, counts[EVRING_KEY_DOWN], counts[EVRING_KEY_UP], counts[EVRING_KEY_LONG],
+            counts[EVRING_KEY_REPEAT], counts[EVRING_KEY_DOUBLE], counts[EVRING_FRAME]);
+    printf("  %.0f edges/s, %.0f events/s\n", nedges * 1e9 / t, total * 1e9 / t);
+
+    for (i = 0; i < nkeys; i++) {
+        want += presses[i];
+    }
+    if (counts[EVRING_KEY_DOWN] < want || (exact && counts[EVRING_KEY_DOWN] != want)) {
+        printf("  FAIL %u presses in the trace, %u downs\n", want, counts[EVRING_KEY_DOWN]);
+        fails++;
+    } else if (counts[EVRING_KEY_DOWN] > want) {
+        printf("  %u presses in the trace, %u glitches made downs too\n", want,
+                counts[EVRING_KEY_DOWN] - want);
+    }
+    if (ring->dropped) {
+        printf("  FAIL the ring dropped %u events\n", ring->dropped);
+        fails++;
+    }
+    if (fails > REPLAY_FAILS) {
+        printf("  ... %u failures\n", fails);
+    }
+    printf(fails ? "FAILED\n" : "ok\n");
+
+    gesture_close();
+    sched_close();
+    evring_destroy();
+    loop_close();
+    return fails ? 1 : 0;
+}
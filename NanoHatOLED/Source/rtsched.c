@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "rtsched.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+struct rt_thread {
+    pid_t       tid;
+    int         role;
+};
+
+static const char* role_names[] = { "input", "output", "background" };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rt_thread threads[RTSCHED_THREADS];
+static int nthreads = 0;
+static int applied = 0;
+static uint32_t cpus = 0;
+static unsigned int rt_priority = 0;
+
+
+//// put thread tid (0: the caller) on the CPUs and in the policy of its role
+static int place(pid_t tid, int role) {
+    struct sched_param sp;
+    cpu_set_t set;
+    int cpu, policy, ret = 0;
+
+    if (cpus != 0) {
+        CPU_ZERO(&set);
+        for (cpu = 0; cpu < 32; cpu++) {
+            if (cpus & (1u << cpu)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+            log2file("%s thread on cpus 0x%x: %s\n", role_names[role], cpus, strerror(errno));
+            ret = -1;
+        }
+    }
+    if (rt_priority == 0 || role == RTSCHED_OUTPUT) {
+        return ret;     // the flush waits on the bus, normal priority will do
+    }
+    memset(&sp, 0, sizeof(sp));
+    if (role == RTSCHED_BACKGROUND) {
+        policy = SCHED_IDLE;
+    } else {
+        policy = SCHED_FIFO | SCHED_RESET_ON_FORK;
+        sp.sched_priority = rt_priority;
+    }
+    if (sched_setscheduler(tid, policy, &sp) != 0) {
+        log2file("%s thread %s: %s\n", role_names[role],
+                role == RTSCHED_BACKGROUND ? "SCHED_IDLE" : "SCHED_FIFO", strerror(errno));
+        ret = -1;
+    }
+    return ret;
+}
+
+
+// ============================================================================
+
+
+//// the calling thread is a role's; placed now, or by rtsched_apply
+void rtsched_thread(int role) {
+    pid_t tid = syscall(SYS_gettid);
+
+    pthread_mutex_lock(&lock);
+    if (applied) {
+        place(0, role);
+    } else if (nthreads < RTSCHED_THREADS) {
+        threads[nthreads].tid = tid;
+        threads[nthreads].role = role;
+        nthreads++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+//// attributes for pthread_create of a helper thread, pthread_attr_destroy after
+void rtsched_attr(pthread_attr_t* attr) {
+    pthread_attr_init(attr);
+    pthread_attr_setstacksize(attr, RTSCHED_STACK_SIZE);
+}
+
+//// place the caller as the input thread and every thread known so far,
+//// and lock the memory mapped until now; -1 if any of it was refused
+int rtsched_apply(uint32_t cpu_mask, unsigned int priority, int lock_memory) {
+    int i, ret, locked = 0;
+
+    pthread_mutex_lock(&lock);
+    cpus = cpu_mask;
+    rt_priority = priority;
+    applied = 1;
+    ret = place(0, RTSCHED_INPUT);
+    for (i = 0; i < nthreads; i++) {
+        if (place(threads[i].tid, threads[i].role) != 0) {
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (lock_memory) {
+        locked = mlockall(MCL_CURRENT) == 0;
+        if (!locked) {
+            log2file("mlockall: %s\n", strerror(errno));
+            ret = -1;
+        }
+    }
+    if (cpu_mask || priority || lock_memory) {
+        log_msg(LOGLVL_INFO, "cpus 0x%x, rt priority %u, memory %slocked\n",
+                cpu_mask, priority, locked ? "" : "not ");
+    }
+    return ret;
+}
@@ -0,0 +1,38 @@
+#ifndef __RTSCHED__H__
+#define __RTSCHED__H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * CPU placement of the daemon's threads, read from the config at startup:
+ *
+ *   cpu_mask     the CPUs every thread runs on (bit 0 is CPU 0), 0 any
+ *   rt_priority  1-99 puts the loop thread (keys, timers, commits) in
+ *                SCHED_FIFO at that priority and the background threads
+ *                (log flusher, SNTP worker) in SCHED_IDLE; the render
+ *                writer, which sleeps in I2C transfers, stays at normal
+ *                priority; 0 leaves everything at normal priority
+ *   lock_memory  1 locks what the daemon has mapped once startup is over,
+ *                the arena included, so a key never waits on a page fault
+ *
+ * A thread says what it is with rtsched_thread() as it starts, before or
+ * after rtsched_apply(); the loop thread is the one calling rtsched_apply.
+ * The real-time policy is set with SCHED_RESET_ON_FORK, so the spawned view
+ * starts at normal priority; it does keep the CPU mask. The one lock the
+ * loop shares with a background thread, the logger's, inherits priority.
+ * Helper threads are created with rtsched_attr(), a RTSCHED_STACK_SIZE
+ * stack instead of the 8 MB default, which is what lock_memory would pin.
+ */
+
+#define RTSCHED_THREADS     8
+#define RTSCHED_STACK_SIZE  (128 * 1024)
+
+enum { RTSCHED_INPUT, RTSCHED_OUTPUT, RTSCHED_BACKGROUND };
+
+extern void rtsched_thread(int role);
+extern void rtsched_attr(pthread_attr_t* attr);
+extern int  rtsched_apply(uint32_t cpu_mask, unsigned int priority, int lock);
+
+
+#endif
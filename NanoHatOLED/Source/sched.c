@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <time.h>
+#include "sched.h"
+#include "evring.h"
+#include "timer.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+static struct timer second = { { -1, NULL, NULL } };
+static sched_handler frame_handler = NULL;
+static uint32_t local_wants = 0;
+
+
+//// missed seconds (expirations > 1) still make one frame, a clock step
+//// (0) redraws right away instead of at the next tick of the old clock
+static void second_tick(struct timer* t, uint64_t expirations) {
+    if (expirations == 0) {
+        log_msg(LOGLVL_INFO, "wall clock was set, ticks realigned\n");
+    }
+    sched_notify(SCHED_CLOCK);
+}
+
+
+// ============================================================================
+
+
+//// arm the second tick, frames go to frame()
+int sched_init(sched_handler frame) {
+    frame_handler = frame;
+    // timer_start aligns to multiples of the period on the timer's clock,
+    // which for CLOCK_REALTIME are the wall clock's second boundaries
+    if (timer_init(&second, CLOCK_REALTIME, second_tick, NULL) != 0 ||
+            timer_start(&second, NSEC_PER_SEC) != 0) {
+        log2file("second tick unavailable\n");
+        timer_close(&second);
+        return -1;
+    }
+    return 0;
+}
+
+//// dependencies of the in-process view's screen, SCHED_* bits
+void sched_want(uint32_t mask) {
+    local_wants = mask;
+}
+
+//// reason changed; schedule a frame if the current screen depends on it
+void sched_notify(uint32_t reason) {
+    uint32_t wants = local_wants | evring_wants();
+
+    if (frame_handler != NULL && (wants & reason)) {
+        frame_handler(reason, clock_ns(CLOCK_MONOTONIC));
+    }
+}
+
+//// stop or restart the second tick, while the panels sleep
+void sched_suspend(int suspend) {
+    if (suspend) {
+        timer_pause(&second);
+    } else {
+        timer_resume(&second);
+    }
+}
+
+void sched_close() {
+    timer_close(&second);
+    frame_handler = NULL;
+    local_wants = 0;
+}
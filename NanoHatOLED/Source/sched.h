@@ -0,0 +1,32 @@
+#ifndef __SCHED__H__
+#define __SCHED__H__
+
+#include <stdint.h>
+
+/*
+ * Frame scheduling: the view says what its current screen depends on and
+ * the daemon sends it an EVRING_FRAME event (value: the SCHED_* reasons)
+ * only when one of those changed, instead of the view redrawing on a sleep.
+ * The clock tick is a CLOCK_REALTIME timer at absolute whole seconds, so a
+ * displayed clock turns over with the wall clock and doesn't drift; when the
+ * clock is set the timer is cancelled (TFD_TIMER_CANCEL_ON_SET), realigned
+ * and a frame goes out at once.
+ *
+ * A spawned view publishes its mask in the event ring header (wants), an
+ * embedded one calls sched_want().
+ */
+
+#define SCHED_CLOCK     0x01        /* a wall clock second started */
+#define SCHED_METRICS   0x02        /* a new metrics sample */
+#define SCHED_KEYS      0x04        /* a key event was delivered */
+
+typedef void (*sched_handler)(uint32_t reasons, uint64_t timestamp_ns);
+
+extern int  sched_init(sched_handler frame);
+extern void sched_want(uint32_t mask);
+extern void sched_notify(uint32_t reason);
+extern void sched_suspend(int suspend);
+extern void sched_close();
+
+
+#endif
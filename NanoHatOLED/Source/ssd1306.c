@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "ssd1306.h"
+#include "logger.h"
+
+#define CTRL_CMD    0x00
+#define CTRL_DATA   0x40
+
+
+// ============================================================================
+
+
+static const uint8_t init_seq[] = {
+    0xae,           // display off
+    0xd5, 0x80,     // clock divide
+    0xa8, 0x3f,     // multiplex 64
+    0xd3, 0x00,     // display offset
+    0x40,           // start line 0
+    0x8d, 0x14,     // charge pump on
+    0x20, 0x00,     // horizontal addressing
+    0xa1,           // segment remap
+    0xc8,           // com scan decrement
+    0xda, 0x12,     // com pins
+    0x81, 0xcf,     // contrast
+    0xd9, 0xf1,     // precharge
+    0xdb, 0x40,     // vcomh
+    0xa4,           // resume from ram
+    0xa6,           // normal, not inverted
+    0xaf,           // display on
+};
+
+#define NOP         0xe3
+
+static int commands(struct ssd1306* panel, const uint8_t* cmd, int len) {
+    if (i2c_queue(&panel->bus, CTRL_CMD, cmd, len) != 0) {
+        i2c_reset(&panel->bus);
+        return -1;
+    }
+    return i2c_commit(&panel->bus);
+}
+
+
+// ============================================================================
+
+
+//// open the bus and initialise the panel, addr 0 probes 0x3c then 0x3d
+int ssd1306_open(struct ssd1306* panel, const char* bus, int addr) {
+    static const uint8_t nop = NOP;
+    const int probe[] = { SSD1306_ADDR_PRIMARY, SSD1306_ADDR_SECONDARY };
+    int i;
+
+    memset(panel, 0, sizeof(*panel));
+    if (i2c_open(&panel->bus, bus) != 0) {
+        return -1;
+    }
+
+    panel->addr = -1;
+    for (i = 0; i < 2; i++) {
+        int a = addr ? addr : probe[i];
+        if (i2c_set_address(&panel->bus, a) == 0 && commands(panel, &nop, 1) == 0) {
+            panel->addr = a;
+            break;
+        }
+        if (addr) {
+            break;
+        }
+    }
+    if (panel->addr < 0) {
+        log2file("no ssd1306 found on %s\n", bus);
+        ssd1306_close(panel);
+        return -1;
+    }
+
+    if (i2c_probe_max_msg(&panel->bus, CTRL_CMD, NOP) < 0) {
+        log2file("probing i2c message size failed: %s\n", strerror(errno));
+    }
+    if (commands(panel, init_seq, sizeof(init_seq)) != 0) {
+        log2file("ssd1306 init failed: %s\n", strerror(errno));
+        ssd1306_close(panel);
+        return -1;
+    }
+    log2file("ssd1306 at 0x%02x on %s, %d byte messages, %d kHz\n",
+            panel->addr, bus, panel->bus.max_msg, panel->bus.clock_khz);
+    return 0;
+}
+
+//// send only the column spans that differ from what the panel shows
+//// returns the number of data bytes written or -1
+int ssd1306_flush(struct ssd1306* panel, const struct fb* fb) {
+    struct fb_dirty dirty;
+    uint8_t window[6];
+    int page, bytes;
+
+    if (panel->synced) {
+        bytes = fb_diff(fb, &panel->shown, &dirty);
+        if (bytes == 0) {
+            return 0;
+        }
+    } else {
+        // unknown GDDRAM content, send every page once
+        for (page = 0; page < FB_PAGES; page++) {
+            dirty.x0[page] = 0;
+            dirty.x1[page] = FB_WIDTH - 1;
+        }
+        dirty.pages = FB_PAGES;
+        bytes = sizeof(fb->pix);
+    }
+
+    for (page = 0; page < FB_PAGES; page++) {
+        int x0 = dirty.x0[page], x1 = dirty.x1[page];
+        if (x0 > x1) {
+            continue;
+        }
+        window[0] = 0x21; window[1] = x0; window[2] = x1;
+        window[3] = 0x22; window[4] = page; window[5] = page;
+        if (i2c_queue(&panel->bus, CTRL_CMD, window, sizeof(window)) != 0 ||
+                i2c_queue(&panel->bus, CTRL_DATA, &fb->pix[page][x0], x1 - x0 + 1) != 0) {
+            i2c_reset(&panel->bus);
+            panel->synced = 0;
+            return -1;
+        }
+        // a window and its data are retried together
+        i2c_group(&panel->bus);
+    }
+    if (i2c_commit(&panel->bus) != 0) {
+        panel->synced = 0;
+        return -1;
+    }
+    for (page = 0; page < FB_PAGES; page++) {
+        if (dirty.x0[page] <= dirty.x1[page]) {
+            memcpy(&panel->shown.pix[page][dirty.x0[page]], &fb->pix[page][dirty.x0[page]],
+                    dirty.x1[page] - dirty.x0[page] + 1);
+        }
+    }
+    panel->synced = 1;
+    panel->frames++;
+    panel->bytes += bytes;
+    return bytes;
+}
+
+int ssd1306_contrast(struct ssd1306* panel, int level) {
+    uint8_t cmd[2] = { 0x81, (uint8_t)level };
+    return commands(panel, cmd, 2);
+}
+
+int ssd1306_power(struct ssd1306* panel, int on) {
+    uint8_t cmd = on ? 0xaf : 0xae;
+    return commands(panel, &cmd, 1);
+}
+
+void ssd1306_close(struct ssd1306* panel) {
+    i2c_close(&panel->bus);
+    panel->synced = 0;
+}
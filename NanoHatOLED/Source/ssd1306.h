@@ -0,0 +1,27 @@
+#ifndef __SSD1306__H__
+#define __SSD1306__H__
+
+#include "fb.h"
+#include "i2c.h"
+
+#define SSD1306_ADDR_PRIMARY    0x3c
+#define SSD1306_ADDR_SECONDARY  0x3d
+
+//// one panel: its bus and a copy of what its GDDRAM currently holds
+struct ssd1306 {
+    struct i2c_bus bus;
+    int         addr;
+    int         synced;     /* shown mirrors the panel */
+    struct fb   shown;
+    unsigned int frames;
+    unsigned int bytes;
+};
+
+extern int  ssd1306_open(struct ssd1306* panel, const char* bus, int addr);
+extern int  ssd1306_flush(struct ssd1306* panel, const struct fb* fb);
+extern int  ssd1306_contrast(struct ssd1306* panel, int level);
+extern int  ssd1306_power(struct ssd1306* panel, int on);
+extern void ssd1306_close(struct ssd1306* panel);
+
+
+#endif
@@ -0,0 +1,216 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "stats.h"
+#include "loop.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+#define STATS_BUF_SIZE  8192
+
+struct histogram {
+    uint64_t    buckets[STATS_BUCKETS];
+    uint64_t    sum_ns;
+    uint64_t    count;
+};
+
+static uint64_t counters[STAT_COUNTERS];
+static uint64_t edges[STATS_MAX_KEYS];
+static int nkeys = 3;       /* keys listed, grows with the highest key seen */
+static struct histogram hists[STAT_HISTOGRAMS];
+static uint64_t pending_press = 0;
+
+static const char* counter_names[STAT_COUNTERS] = {
+    "epoll_wakeups",
+    "key_events",
+    "key_events_dropped",
+    "metrics_samples",
+    "signals_sent",
+    "frames",
+    "frames_merged",
+    "i2c_bytes",
+    "i2c_transactions",
+    "i2c_errors",
+    "gpio_overruns",
+    "gpio_edges_lost",
+    "heap_allocs",
+};
+static const char* hist_names[STAT_HISTOGRAMS] = {
+    "edge_to_flush_seconds",
+    "flush_seconds",
+};
+
+static struct loop_source stats_source = { -1, NULL, NULL };
+static const char* stats_path = NULL;
+
+
+// ============================================================================
+
+
+void stats_add(int counter, uint64_t n) {
+    __atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+//// a raw edge on key, before debouncing
+void stats_edge(int key) {
+    if (key >= 0 && key < STATS_MAX_KEYS) {
+        __atomic_fetch_add(&edges[key], 1, __ATOMIC_RELAXED);
+        if (key >= nkeys) {
+            nkeys = key + 1;
+        }
+    }
+}
+
+void stats_observe(int hist, uint64_t ns) {
+    struct histogram* h = &hists[hist];
+    uint64_t us = ns / 1000;
+    int b = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+
+    if (b >= STATS_BUCKETS) {
+        b = STATS_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+}
+
+//// a key went down; the next flushed frame is taken as its response
+//// (presses before that flush are folded into the first one)
+void stats_press(uint64_t timestamp_ns) {
+    uint64_t none = 0;
+
+    __atomic_compare_exchange_n(&pending_press, &none, timestamp_ns, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+//// a frame went out to the panel, both times CLOCK_MONOTONIC; called from
+//// the I2C writer thread
+void stats_frame(uint64_t start_ns, uint64_t end_ns) {
+    uint64_t press = __atomic_exchange_n(&pending_press, 0, __ATOMIC_RELAXED);
+
+    stats_add(STAT_FRAMES, 1);
+    stats_observe(STAT_FLUSH_TIME, end_ns - start_ns);
+    if (press != 0 && end_ns > press) {
+        stats_observe(STAT_EDGE_TO_FLUSH, end_ns - press);
+    }
+}
+
+
+// ============================================================================
+
+
+static uint64_t load(const uint64_t* v) {
+    return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+//// the dump sent to a stats client, returns its length
+int stats_format(char* buf, int size) {
+    const struct histogram* h;
+    uint64_t total;
+    int n = 0, i, b;
+
+#define OUT(...) \
+    do { \
+        if (n < size) n += snprintf(buf + n, size - n, __VA_ARGS__); \
+    } while (0)
+
+    for (i = 0; i < STAT_COUNTERS; i++) {
+        OUT("# TYPE nanohat_%s_total counter\n", counter_names[i]);
+        OUT("nanohat_%s_total %llu\n", counter_names[i],
+                (unsigned long long)load(&counters[i]));
+    }
+    OUT("# TYPE nanohat_key_edges_total counter\n");
+    for (i = 0; i < nkeys; i++) {
+        OUT("nanohat_key_edges_total{key=\"k%d\"} %llu\n", i + 1,
+                (unsigned long long)load(&edges[i]));
+    }
+
+    for (i = 0; i < STAT_HISTOGRAMS; i++) {
+        h = &hists[i];
+        total = 0;
+        OUT("# TYPE nanohat_%s histogram\n", hist_names[i]);
+        for (b = 0; b < STATS_BUCKETS - 1; b++) {
+            total += load(&h->buckets[b]);
+            OUT("nanohat_%s_bucket{le=\"%.6f\"} %llu\n", hist_names[i],
+                    (double)(1ull << b) / 1e6, (unsigned long long)total);
+        }
+        total += load(&h->buckets[b]);
+        OUT("nanohat_%s_bucket{le=\"+Inf\"} %llu\n", hist_names[i],
+                (unsigned long long)total);
+        OUT("nanohat_%s_sum %.6f\n", hist_names[i], load(&h->sum_ns) / 1e9);
+        OUT("nanohat_%s_count %llu\n", hist_names[i],
+                (unsigned long long)load(&h->count));
+    }
+#undef OUT
+    return n < size ? n : size - 1;
+}
+
+
+// ============================================================================
+
+
+//// each connection gets one dump and is closed, the client only reads
+static void stats_ready(struct loop_source* src, uint32_t events) {
+    static char buf[STATS_BUF_SIZE];
+    int fd, len;
+
+    while ((fd = accept4(src->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        len = stats_format(buf, sizeof(buf));
+        if (send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            log_msg(LOGLVL_DEBUG, "stats client: %s\n", strerror(errno));
+        }
+        close(fd);
+    }
+}
+
+//// listen on the stats socket and add it to the loop
+int stats_open(const char* path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log2file("stats socket: %s\n", strerror(errno));
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+        log2file("bind %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    chmod(path, 0666);
+
+    stats_source.fd = fd;
+    stats_source.handler = stats_ready;
+    if (loop_add(&stats_source, EPOLLIN) != 0) {
+        stats_close();
+        return -1;
+    }
+    stats_path = path;
+    return 0;
+}
+
+void stats_close() {
+    if (stats_source.fd >= 0) {
+        loop_del(&stats_source);
+        close(stats_source.fd);
+        stats_source.fd = -1;
+    }
+    if (stats_path != NULL) {
+        unlink(stats_path);
+        stats_path = NULL;
+    }
+}
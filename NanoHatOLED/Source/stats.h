@@ -0,0 +1,53 @@
+#ifndef __STATS__H__
+#define __STATS__H__
+
+#include <stdint.h>
+
+/*
+ * Hot path counters and latency histograms, updated with relaxed atomics and
+ * read by whoever connects to the stats socket (SOCK_STREAM). A connection
+ * gets one dump in the Prometheus text format and is closed:
+ *
+ *   socat - UNIX-CONNECT:/var/run/nanohat-oled-stats.sock
+ *
+ * Histogram buckets are powers of two in microseconds, 1 us to ~1 s.
+ */
+
+#define STATS_MAX_KEYS  16
+#define STATS_BUCKETS   22      /* le 2^0 .. 2^20 us, then +Inf */
+
+enum {
+    STAT_WAKEUPS,               /* epoll_wait returns with events */
+    STAT_EVENTS,                /* debounced key events */
+    STAT_DROPPED,               /* events the ring had no room for */
+    STAT_METRICS_SAMPLES,       /* samples taken by the metrics timer */
+    STAT_SIGNALS,               /* signals sent to the view */
+    STAT_FRAMES,                /* frames flushed to the panel */
+    STAT_FRAMES_MERGED,         /* commits superseded before the writer took them */
+    STAT_I2C_BYTES,
+    STAT_I2C_TRANSACTIONS,      /* I2C_RDWR ioctls that succeeded */
+    STAT_I2C_ERRORS,            /* failed ioctls, retries included */
+    STAT_GPIO_OVERRUNS,         /* reads that found edges missing */
+    STAT_GPIO_LOST,             /* edges the kernel dropped or merged */
+    STAT_HEAP_ALLOCS,           /* mallocs after startup, see arena.h */
+    STAT_COUNTERS
+};
+
+enum {
+    STAT_EDGE_TO_FLUSH,         /* key press to the first flush after it */
+    STAT_FLUSH_TIME,            /* one frame diffed and sent */
+    STAT_HISTOGRAMS
+};
+
+extern void stats_add(int counter, uint64_t n);
+extern void stats_edge(int key);
+extern void stats_observe(int hist, uint64_t ns);
+extern void stats_press(uint64_t timestamp_ns);
+extern void stats_frame(uint64_t start_ns, uint64_t end_ns);
+extern int  stats_format(char* buf, int size);
+
+extern int  stats_open(const char* path);
+extern void stats_close();
+
+
+#endif
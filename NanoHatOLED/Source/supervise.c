@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "supervise.h"
+#include "view.h"
+#include "evring.h"
+#include "timer.h"
+#include "loop.h"
+#include "logger.h"
+
+/*
+ * Keeps the python view running. An exit is noticed through the view's
+ * pidfd, or a SIGCHLD signalfd on kernels without pidfd, and the view is
+ * started again after a delay that doubles with every crash in a row.
+ *
+ * A view that attached to the event ring and bumps the heartbeat in its
+ * header has promised to keep doing so: if the counter stops moving for
+ * watchdog_ms the view is killed, which restarts it like any other exit.
+ * Views that never send a heartbeat are not watched.
+ */
+
+
+// ============================================================================
+
+
+static const char* view_workpath = NULL;
+static unsigned int deadline_ms = 0;
+static unsigned int backoff_ms = SUPERVISE_BACKOFF_MS;
+static uint64_t started_ns = 0;
+static pid_t child = 0;
+static int stopping = 0;
+
+static struct loop_source exit_source = { -1, NULL, NULL };
+static struct loop_source chld_source = { -1, NULL, NULL };
+static struct timer restart = { { -1, NULL, NULL } };
+static struct timer watchdog = { { -1, NULL, NULL } };
+
+static uint32_t last_beat = 0;
+static uint64_t last_beat_ns = 0;
+
+static void start_view();
+
+
+static void view_gone() {
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    unsigned int delay;
+
+    if (exit_source.fd >= 0) {
+        loop_del(&exit_source);
+        exit_source.fd = -1;
+    }
+    if (!view_running() || view_reap() < 0) {
+        return;     // e.g. SIGCHLD from a child of the view
+    }
+    evring_detach();
+    last_beat = 0;
+    if (stopping) {
+        return;
+    }
+
+    if (now - started_ns >= SUPERVISE_STABLE_MS * NSEC_PER_MSEC) {
+        backoff_ms = SUPERVISE_BACKOFF_MS;
+    }
+    delay = backoff_ms;
+    backoff_ms = (backoff_ms * 2 > SUPERVISE_BACKOFF_MAX) ? SUPERVISE_BACKOFF_MAX : backoff_ms * 2;
+    log2file("restarting python view in %u ms\n", delay);
+    timer_oneshot(&restart, delay * NSEC_PER_MSEC);
+}
+
+//// the pidfd polls readable once the child has exited
+static void view_exited(struct loop_source* src, uint32_t events) {
+    view_gone();
+}
+
+//// without pidfd: drain the SIGCHLD signalfd, then reap
+static void child_signal(struct loop_source* src, uint32_t events) {
+    struct signalfd_siginfo si;
+
+    while (read(src->fd, &si, sizeof(si)) == sizeof(si));
+    view_gone();
+}
+
+static void restart_expired(struct timer* t, uint64_t expirations) {
+    start_view();
+}
+
+static void watchdog_check(struct timer* t, uint64_t expirations) {
+    uint32_t beat = evring_heartbeat();
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+
+    // only a heartbeat from our own child counts
+    if (!view_running() || beat == 0 || evring_consumer() != child) {
+        return;
+    }
+    if (beat != last_beat) {
+        last_beat = beat;
+        last_beat_ns = now;
+    } else if (now - last_beat_ns >= deadline_ms * NSEC_PER_MSEC) {
+        log2file("python view missed its heartbeat for %u ms, killing it\n", deadline_ms);
+        view_signal(SIGKILL);
+        last_beat = 0;
+    }
+}
+
+static void start_view() {
+    if (view_running()) {
+        return;
+    }
+    child = view_start(view_workpath);
+    if (child <= 0) {
+        timer_oneshot(&restart, backoff_ms * NSEC_PER_MSEC);
+        return;
+    }
+    started_ns = clock_ns(CLOCK_MONOTONIC);
+    last_beat = 0;
+    if (view_pidfd() >= 0) {
+        exit_source.fd = view_pidfd();
+        exit_source.handler = view_exited;
+        loop_add(&exit_source, EPOLLIN);
+    }
+}
+
+//// SIGCHLD as a loop source, for kernels that lack pidfd_open
+static int open_child_signal() {
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    chld_source.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (chld_source.fd < 0) {
+        log2file("signalfd failed: %s\n", strerror(errno));
+        return -1;
+    }
+    chld_source.handler = child_signal;
+    return loop_add(&chld_source, EPOLLIN);
+}
+
+
+// ============================================================================
+
+
+//// start the view and keep it running, the loop must be initialized
+int supervise_start(const char* workpath, unsigned int watchdog_ms) {
+    view_workpath = workpath;
+    deadline_ms = watchdog_ms;
+    stopping = 0;
+
+    if (timer_init(&restart, CLOCK_MONOTONIC, restart_expired, NULL) != 0) {
+        return -1;
+    }
+    // SIGCHLD is blocked before the first spawn so no exit can slip through,
+    // the spawned view gets an empty mask (see view.c)
+    if (view_pidfd_supported() == 0 && open_child_signal() != 0) {
+        return -1;
+    }
+    if (deadline_ms) {
+        if (timer_init(&watchdog, CLOCK_MONOTONIC, watchdog_check, NULL) != 0 ||
+                timer_start(&watchdog, (deadline_ms + 3) / 4 * NSEC_PER_MSEC) != 0) {
+            log2file("view watchdog unavailable\n");
+        }
+    }
+    start_view();
+    return 0;
+}
+
+//// stop or restart the watchdog; the view's heartbeats while it was paused
+//// don't count, its deadline starts over
+void supervise_suspend(int suspend) {
+    if (suspend) {
+        timer_pause(&watchdog);
+    } else {
+        last_beat = 0;
+        timer_resume(&watchdog);
+    }
+}
+
+//// stop supervising and terminate the view
+void supervise_stop() {
+    stopping = 1;
+    timer_close(&restart);
+    timer_close(&watchdog);
+    if (view_running()) {
+        view_signal(SIGTERM);
+    }
+    if (chld_source.fd >= 0) {
+        loop_del(&chld_source);
+        close(chld_source.fd);
+        chld_source.fd = -1;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef __SUPERVISE__H__
+#define __SUPERVISE__H__
+
+#define SUPERVISE_BACKOFF_MS    1000    /* first restart delay, doubles per crash */
+#define SUPERVISE_BACKOFF_MAX   60000
+#define SUPERVISE_STABLE_MS     30000   /* a view up this long resets the backoff */
+#define SUPERVISE_WATCHDOG_MS   10000   /* heartbeat deadline, 0 disables */
+
+extern int  supervise_start(const char* workpath, unsigned int watchdog_ms);
+extern void supervise_suspend(int suspend);
+extern void supervise_stop();
+
+
+#endif
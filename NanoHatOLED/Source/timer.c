@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include "timer.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+uint64_t clock_ns(int clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void ns_to_timespec(uint64_t ns, struct timespec* ts) {
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static void timer_ready(struct loop_source* src, uint32_t events) {
+    struct timer* t = src->ctx;
+    uint64_t expirations;
+
+    if (read(t->src.fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        if (errno == ECANCELED) {
+            // the wall clock was set: align to the new clock and say so once,
+            // a timer_at deadline is for its handler to work out again
+            if (t->period_ns) {
+                timer_start(t, t->period_ns);
+            }
+            t->fire(t, 0);
+        }
+        return;
+    }
+    t->fire(t, expirations);
+}
+
+
+// ============================================================================
+
+
+//// create the timerfd (disarmed) and register it in the loop
+int timer_init(struct timer* t, int clock, timer_handler fire, void* ctx) {
+    t->clock = clock;
+    t->paused = 0;
+    t->period_ns = 0;
+    t->fire = fire;
+    t->ctx = ctx;
+    t->src.fd = timerfd_create(clock, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (t->src.fd < 0) {
+        log2file("timerfd_create: %s\n", strerror(errno));
+        return -1;
+    }
+    t->src.handler = timer_ready;
+    t->src.ctx = t;
+    if (loop_add(&t->src, EPOLLIN) != 0) {
+        close(t->src.fd);
+        t->src.fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+//// fire every period_ns, first at the next whole multiple of the period
+//// on CLOCK_REALTIME a step of the clock (settimeofday, NTP) cancels the
+//// timer; it is re-armed against the new time and fires with 0 expirations
+int timer_start(struct timer* t, uint64_t period_ns) {
+    struct itimerspec its;
+    int flags = TFD_TIMER_ABSTIME;
+    uint64_t now;
+
+    if (period_ns == 0) {
+        return -1;
+    }
+    t->period_ns = period_ns;
+    if (t->paused) {
+        return 0;
+    }
+    now = clock_ns(t->clock);
+    ns_to_timespec((now / period_ns + 1) * period_ns, &its.it_value);
+    ns_to_timespec(period_ns, &its.it_interval);
+    if (t->clock == CLOCK_REALTIME) {
+        flags |= TFD_TIMER_CANCEL_ON_SET;
+    }
+    return timerfd_settime(t->src.fd, flags, &its, NULL);
+}
+
+//// fire once after delay_ns
+int timer_oneshot(struct timer* t, uint64_t delay_ns) {
+    struct itimerspec its;
+
+    t->period_ns = 0;
+    memset(&its, 0, sizeof(its));
+    ns_to_timespec(delay_ns ? delay_ns : 1, &its.it_value);
+    return timerfd_settime(t->src.fd, 0, &its, NULL);
+}
+
+//// fire once when the timer's clock reaches when_ns; on CLOCK_REALTIME a
+//// step of the clock fires it early with 0 expirations instead
+int timer_at(struct timer* t, uint64_t when_ns) {
+    struct itimerspec its;
+    int flags = TFD_TIMER_ABSTIME;
+
+    t->period_ns = 0;
+    memset(&its, 0, sizeof(its));
+    ns_to_timespec(when_ns, &its.it_value);
+    if (t->clock == CLOCK_REALTIME) {
+        flags |= TFD_TIMER_CANCEL_ON_SET;
+    }
+    return timerfd_settime(t->src.fd, flags, &its, NULL);
+}
+
+void timer_stop(struct timer* t) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    t->period_ns = 0;
+    timerfd_settime(t->src.fd, 0, &its, NULL);
+}
+
+//// disarm a periodic timer but keep its period, for timer_resume
+void timer_pause(struct timer* t) {
+    struct itimerspec its;
+
+    t->paused = 1;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(t->src.fd, 0, &its, NULL);
+}
+
+//// re-arm a paused timer at the next multiple of its period, if it has one
+int timer_resume(struct timer* t) {
+    if (!t->paused) {
+        return 0;
+    }
+    t->paused = 0;
+    return t->period_ns ? timer_start(t, t->period_ns) : 0;
+}
+
+int timer_armed(const struct timer* t) {
+    struct itimerspec its;
+
+    if (timerfd_gettime(t->src.fd, &its) != 0) {
+        return 0;
+    }
+    return its.it_value.tv_sec != 0 || its.it_value.tv_nsec != 0;
+}
+
+void timer_close(struct timer* t) {
+    if (t->src.fd >= 0) {
+        loop_del(&t->src);
+        close(t->src.fd);
+        t->src.fd = -1;
+    }
+}
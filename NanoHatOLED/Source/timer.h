@@ -0,0 +1,42 @@
+#ifndef __TIMER__H__
+#define __TIMER__H__
+
+#include <stdint.h>
+#include "loop.h"
+
+#define NSEC_PER_MSEC   1000000ull
+#define NSEC_PER_SEC    1000000000ull
+
+struct timer;
+typedef void (*timer_handler)(struct timer* t, uint64_t expirations);
+
+//// a timerfd registered in the event loop
+//// periodic timers declare their period and are phase aligned to multiples
+//// of it, so timers with harmonic periods (250 ms, 1 s, 5 s...) expire in
+//// the same wakeup instead of each waking the CPU on its own; a periodic
+//// CLOCK_REALTIME timer, or one armed with timer_at, fires with
+//// expirations 0 when the clock is set;
+//// a paused timer stays disarmed, timer_start only records the period
+struct timer {
+    struct loop_source  src;
+    int                 clock;
+    int                 paused;
+    uint64_t            period_ns;
+    timer_handler       fire;
+    void*               ctx;
+};
+
+extern uint64_t clock_ns(int clock);
+
+extern int  timer_init(struct timer* t, int clock, timer_handler fire, void* ctx);
+extern int  timer_start(struct timer* t, uint64_t period_ns);
+extern int  timer_oneshot(struct timer* t, uint64_t delay_ns);
+extern int  timer_at(struct timer* t, uint64_t when_ns);
+extern void timer_stop(struct timer* t);
+extern int  timer_armed(const struct timer* t);
+extern void timer_pause(struct timer* t);
+extern int  timer_resume(struct timer* t);
+extern void timer_close(struct timer* t);
+
+
+#endif
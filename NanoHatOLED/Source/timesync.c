@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <sys/timex.h>
+#include <sys/eventfd.h>
+#include "timesync.h"
+#include "timer.h"
+#include "loop.h"
+#include "rtsched.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+#define NTP_PACKET_SIZE     48
+#define NTP_UNIX_EPOCH      2208988800ull   /* 1900 to 1970 in seconds */
+#define NTP_CLIENT          0x23            /* LI 0, version 4, mode 3 */
+#define NTP_MODE_SERVER     4
+#define NTP_MAX_ADDRS       4
+
+static char ntp_server[TIMESYNC_SERVER_MAX];
+static struct loop_source request_source = { -1, NULL, NULL };
+static const char* request_path = NULL;
+static int suspended = 0;
+static int busy = 0;
+static pthread_t worker;
+static int worker_fd = -1;      /* eventfd, one count per request */
+
+// worker thread only: the request's server and its addresses from the last
+// lookup, kept until no address answers or the server changes
+static char request_server[TIMESYNC_SERVER_MAX];
+static char resolved[TIMESYNC_SERVER_MAX];
+static struct sockaddr_storage addrs[NTP_MAX_ADDRS];
+static socklen_t addr_lens[NTP_MAX_ADDRS];
+static int naddrs = 0;
+
+
+static void put_timestamp(uint8_t* p, uint64_t ns) {
+    uint32_t sec = ns / NSEC_PER_SEC + NTP_UNIX_EPOCH;
+    uint32_t frac = ((ns % NSEC_PER_SEC) << 32) / NSEC_PER_SEC;
+
+    sec = htonl(sec);
+    frac = htonl(frac);
+    memcpy(p, &sec, 4);
+    memcpy(p + 4, &frac, 4);
+}
+
+static int64_t get_timestamp(const uint8_t* p) {
+    uint32_t sec, frac;
+
+    memcpy(&sec, p, 4);
+    memcpy(&frac, p + 4, 4);
+    sec = ntohl(sec);
+    frac = ntohl(frac);
+    return (int64_t)(sec - NTP_UNIX_EPOCH) * NSEC_PER_SEC +
+            (int64_t)(((uint64_t)frac * NSEC_PER_SEC) >> 32);
+}
+
+//// one SNTP round trip to addr, offset of the local clock in ns
+static int query(const struct sockaddr_storage* addr, socklen_t len, int64_t* offset) {
+    struct timeval tv = { TIMESYNC_TIMEOUT_MS / 1000, TIMESYNC_TIMEOUT_MS % 1000 * 1000 };
+    uint8_t pkt[NTP_PACKET_SIZE], sent[8];
+    int64_t t1, t2, t3, t4;
+    ssize_t n;
+    int fd;
+
+    fd = socket(addr->ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr*)addr, len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    memset(pkt, 0, sizeof(pkt));
+    pkt[0] = NTP_CLIENT;
+    t1 = clock_ns(CLOCK_REALTIME);
+    put_timestamp(pkt + 40, t1);
+    memcpy(sent, pkt + 40, sizeof(sent));
+    if (send(fd, pkt, sizeof(pkt), 0) != sizeof(pkt)) {
+        close(fd);
+        return -1;
+    }
+    n = recv(fd, pkt, sizeof(pkt), 0);
+    t4 = clock_ns(CLOCK_REALTIME);
+    close(fd);
+
+    // a reply to this request, from a server that has time (stratum > 0)
+    if (n < NTP_PACKET_SIZE || (pkt[0] & 7) != NTP_MODE_SERVER || pkt[1] == 0 ||
+            memcmp(pkt + 24, sent, sizeof(sent)) != 0) {
+        errno = n < 0 ? errno : EPROTO;
+        return -1;
+    }
+    t2 = get_timestamp(pkt + 32);
+    t3 = get_timestamp(pkt + 40);
+    *offset = ((t2 - t1) + (t3 - t4)) / 2;
+    return 0;
+}
+
+static void correct(int64_t offset) {
+    struct timesync_state state;
+    struct timespec ts;
+    struct timeval tv;
+    int64_t abs_off = offset < 0 ? -offset : offset;
+
+    timesync_state(&state);
+    if (state.synced) {
+        log2file("time sync: clock off by %lld ms, left to the system's ntp\n",
+                (long long)(offset / (int64_t)NSEC_PER_MSEC));
+        return;
+    }
+    if (abs_off >= TIMESYNC_STEP_MS * (int64_t)NSEC_PER_MSEC) {
+        uint64_t now = clock_ns(CLOCK_REALTIME) + offset;
+        ts.tv_sec = now / NSEC_PER_SEC;
+        ts.tv_nsec = now % NSEC_PER_SEC;
+        if (clock_settime(CLOCK_REALTIME, &ts) != 0) {
+            log2file("time sync: clock_settime: %s\n", strerror(errno));
+            return;
+        }
+        log2file("time sync: clock stepped by %lld ms\n",
+                (long long)(offset / (int64_t)NSEC_PER_MSEC));
+    } else {
+        tv.tv_sec = offset / (int64_t)NSEC_PER_SEC;
+        tv.tv_usec = offset % (int64_t)NSEC_PER_SEC / 1000;
+        if (adjtime(&tv, NULL) != 0) {
+            log2file("time sync: adjtime: %s\n", strerror(errno));
+            return;
+        }
+        log2file("time sync: slewing by %lld us\n", (long long)(offset / 1000));
+    }
+}
+
+//// look the server up; getaddrinfo allocates, so this only runs when the
+//// server changed or none of its addresses answered
+static int resolve(const char* server) {
+    struct addrinfo hints, *res, *ai;
+    int ret;
+
+    naddrs = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    ret = getaddrinfo(server, "123", &hints, &res);
+    if (ret != 0) {
+        log2file("time sync: %s: %s\n", server, gai_strerror(ret));
+        return -1;
+    }
+    for (ai = res; ai != NULL && naddrs < NTP_MAX_ADDRS; ai = ai->ai_next) {
+        if (ai->ai_addrlen <= sizeof(addrs[0])) {
+            memcpy(&addrs[naddrs], ai->ai_addr, ai->ai_addrlen);
+            addr_lens[naddrs++] = ai->ai_addrlen;
+        }
+    }
+    freeaddrinfo(res);
+    snprintf(resolved, sizeof(resolved), "%s", server);
+    return 0;
+}
+
+//// one request: lookup if needed, round trip, correction
+static void sync_once(const char* server) {
+    int64_t offset;
+    int i;
+
+    if ((naddrs == 0 || strcmp(resolved, server) != 0) && resolve(server) != 0) {
+        return;
+    }
+    for (i = 0; i < naddrs; i++) {
+        if (query(&addrs[i], addr_lens[i], &offset) == 0) {
+            correct(offset);
+            return;
+        }
+    }
+    log2file("time sync: no answer from %s: %s\n", server, strerror(errno));
+    naddrs = 0;
+}
+
+//// requests run here, started with the daemon so none creates a thread
+static void* sync_thread(void* arg) {
+    uint64_t n;
+
+    rtsched_thread(RTSCHED_BACKGROUND);
+    for (;;) {
+        if (read(worker_fd, &n, sizeof(n)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log2file("time sync worker: %s\n", strerror(errno));
+            break;
+        }
+        sync_once(request_server);
+        __atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+//// signals stay with the loop thread
+static int start_worker() {
+    pthread_attr_t attr;
+    sigset_t all, old;
+    int ret;
+
+    worker_fd = eventfd(0, EFD_CLOEXEC);
+    if (worker_fd < 0) {
+        log2file("time sync eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    rtsched_attr(&attr);
+    ret = pthread_create(&worker, &attr, sync_thread, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        log2file("time sync thread: %s\n", strerror(ret));
+        close(worker_fd);
+        worker_fd = -1;
+        return -1;
+    }
+    pthread_detach(worker);
+    return 0;
+}
+
+//// any datagram on the socket is a request, a burst of them makes one
+static void request_ready(struct loop_source* src, uint32_t events) {
+    char buf[16];
+    int n = 0;
+
+    while (recv(src->fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0) {
+        n++;
+    }
+    if (n > 0) {
+        timesync_request();
+    }
+}
+
+
+// ============================================================================
+
+
+//// the kernel's view of the clock, no processes or files involved
+void timesync_state(struct timesync_state* out) {
+    struct timex tx;
+    int ret;
+
+    memset(&tx, 0, sizeof(tx));
+    ret = adjtimex(&tx);
+    out->synced = ret >= 0 && ret != TIME_ERROR && !(tx.status & STA_UNSYNC);
+    out->maxerror_us = tx.maxerror;
+    out->esterror_us = tx.esterror;
+}
+
+//// sync against server on request; binds the socket views send them to
+int timesync_open(const char* server, const char* path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    timesync_server(server);
+    if (start_worker() != 0) {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log2file("time sync socket: %s\n", strerror(errno));
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        log2file("bind %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    chmod(path, 0666);
+    request_path = path;
+
+    request_source.fd = fd;
+    request_source.handler = request_ready;
+    if (loop_add(&request_source, EPOLLIN) != 0) {
+        timesync_close();
+        return -1;
+    }
+    return 0;
+}
+
+//// start a sync in the background, a request while one runs is dropped
+int timesync_request() {
+    uint64_t one = 1;
+
+    if (worker_fd < 0 || ntp_server[0] == '\0' || __atomic_exchange_n(&busy, 1, __ATOMIC_ACQ_REL)) {
+        return -1;
+    }
+    // the worker is idle until the write, it reads its own copy of the server
+    memcpy(request_server, ntp_server, sizeof(request_server));
+    if (write(worker_fd, &one, sizeof(one)) < 0) {
+        log2file("time sync wakeup: %s\n", strerror(errno));
+        __atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    log_msg(LOGLVL_INFO, "time sync with %s requested\n", ntp_server);
+    return 0;
+}
+
+//// server for the next request
+void timesync_server(const char* server) {
+    snprintf(ntp_server, sizeof(ntp_server), "%s", server);
+}
+
+//// stop or restart watching for requests, one made meanwhile is seen then
+void timesync_suspend(int suspend) {
+    if (request_source.fd < 0 || suspend == suspended) {
+        return;
+    }
+    suspended = suspend;
+    if (suspend) {
+        loop_del(&request_source);
+    } else if (loop_add(&request_source, EPOLLIN) == 0) {
+        request_ready(&request_source, EPOLLIN);
+    }
+}
+
+int timesync_busy() {
+    return __atomic_load_n(&busy, __ATOMIC_ACQUIRE);
+}
+
+void timesync_close() {
+    if (request_source.fd >= 0) {
+        if (!suspended) {
+            loop_del(&request_source);
+        }
+        close(request_source.fd);
+        request_source.fd = -1;
+    }
+    if (request_path != NULL) {
+        unlink(request_path);
+        request_path = NULL;
+    }
+}
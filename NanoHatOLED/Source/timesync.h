@@ -0,0 +1,40 @@
+#ifndef __TIMESYNC__H__
+#define __TIMESYNC__H__
+
+#include <stdint.h>
+
+/*
+ * Wall clock sync state and on-demand SNTP. The state is the kernel's
+ * (adjtimex), so a running ntpd/chrony/timesyncd is respected: a request
+ * while the kernel clock is disciplined only measures the offset. Otherwise
+ * the clock is stepped (clock_settime) when off by TIMESYNC_STEP_MS or
+ * more, slewed (adjtime) when less.
+ *
+ * A request runs on a worker thread started with the daemon, so neither
+ * the name lookup nor the round trip ever blocks the event loop. The
+ * server's addresses are kept from one request to the next and only looked
+ * up again when the server changes or none of them answers, which is the
+ * only time a request allocates. Views ask for one by sending any datagram
+ * to the request socket (TIMESYNC_SOCKET), which wakes the loop only then.
+ */
+
+#define TIMESYNC_TIMEOUT_MS 2000
+#define TIMESYNC_STEP_MS    128
+#define TIMESYNC_SERVER_MAX 64
+
+struct timesync_state {
+    int         synced;         /* kernel clock disciplined, STA_UNSYNC clear */
+    uint32_t    maxerror_us;
+    uint32_t    esterror_us;
+};
+
+extern void timesync_state(struct timesync_state* out);
+extern int  timesync_open(const char* server, const char* path);
+extern void timesync_server(const char* server);
+extern int  timesync_request();
+extern int  timesync_busy();
+extern void timesync_suspend(int suspend);
+extern void timesync_close();
+
+
+#endif
@@ -0,0 +1,529 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "tz.h"
+#include "arena.h"
+#include "logger.h"
+
+
+// ============================================================================
+
+
+#define TZIF_HEADER     44
+#define TZIF_MAX_SIZE   (256 * 1024)
+#define SECS_PER_DAY    86400
+
+struct tz_type {
+    int32_t     utoff;
+    uint8_t     isdst;
+    uint8_t     abbr;           /* index into chars */
+};
+
+//// a date in a POSIX TZ rule: Mm.w.d, Jn (no Feb 29) or n (from 0)
+struct tz_date {
+    char        kind;           /* 'M', 'J' or 'D' */
+    int         month, week, wday, yday;
+    int32_t     time;           /* local seconds after midnight */
+};
+
+//// the TZ string at the end of a TZif file, for times past its table
+struct tz_rule {
+    int             valid;
+    int             has_dst;
+    int32_t         std_off;    /* seconds east, unlike the string */
+    int32_t         dst_off;
+    char            std_abbr[TZ_ABBR_MAX];
+    char            dst_abbr[TZ_ABBR_MAX];
+    struct tz_date  start, end;
+};
+
+struct tz_zone {
+    char            name[TZ_NAME_MAX];
+    int             ntimes;
+    int             ntypes;
+    int             nchars;
+    int64_t*        times;
+    uint8_t*        idx;
+    struct tz_type* types;
+    char*           chars;
+    struct tz_rule  rule;
+
+    // what is in effect over [from, until)
+    int64_t         from;
+    int64_t         until;
+    int32_t         utoff;
+    char            abbr[TZ_ABBR_MAX];
+};
+
+static struct tz_zone zones[TZ_MAX_ZONES];
+static int nzones = 0;
+
+
+// ============================================================================
+// calendar arithmetic, proleptic Gregorian, days since 1970-01-01
+
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static int64_t days_from_civil(int64_t y, int m, int d) {
+    int64_t era;
+    unsigned int yoe, doy, doe;
+
+    y -= m <= 2;
+    era = floor_div(y, 400);
+    yoe = (unsigned int)(y - era * 400);
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int* y, int* m, int* d) {
+    int64_t era;
+    unsigned int doe, yoe, doy, mp;
+
+    z += 719468;
+    era = floor_div(z, 146097);
+    doe = (unsigned int)(z - era * 146097);
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (int)((int64_t)yoe + era * 400 + (*m <= 2));
+}
+
+static int weekday(int64_t days) {
+    return (int)(((days + 4) % 7 + 7) % 7);
+}
+
+static int is_leap(int y) {
+    return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static int days_in_month(int y, int m) {
+    static const int dim[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    return m == 2 && is_leap(y) ? 29 : dim[m - 1];
+}
+
+
+// ============================================================================
+// POSIX TZ rules, e.g. "EST5EDT,M3.2.0,M11.1.0" or "<+0545>-5:45"
+
+
+static const char* parse_abbr(const char* p, char* out) {
+    int n = 0;
+
+    if (*p == '<') {
+        for (p++; *p && *p != '>'; p++) {
+            if (n < TZ_ABBR_MAX - 1) out[n++] = *p;
+        }
+        if (*p != '>') {
+            return NULL;
+        }
+        p++;
+    } else {
+        for (; isalpha((unsigned char)*p); p++) {
+            if (n < TZ_ABBR_MAX - 1) out[n++] = *p;
+        }
+    }
+    out[n] = '\0';
+    return n > 0 ? p : NULL;
+}
+
+//// [+-]hh[:mm[:ss]] in seconds
+static const char* parse_time(const char* p, int32_t* out) {
+    int32_t sign = 1, v = 0, part;
+    int i;
+
+    if (*p == '+' || *p == '-') {
+        sign = *p++ == '-' ? -1 : 1;
+    }
+    if (!isdigit((unsigned char)*p)) {
+        return NULL;
+    }
+    for (i = 0; i < 3; i++) {
+        for (part = 0; isdigit((unsigned char)*p); p++) {
+            part = part * 10 + (*p - '0');
+        }
+        v = v * 60 + part;
+        if (i < 2 && *p == ':' && isdigit((unsigned char)p[1])) {
+            p++;
+        } else {
+            for (i++; i < 3; i++) {
+                v *= 60;
+            }
+        }
+    }
+    *out = sign * v;
+    return p;
+}
+
+static const char* parse_date(const char* p, struct tz_date* date) {
+    char* end;
+
+    date->time = 2 * 3600;
+    if (*p == 'M') {
+        date->kind = 'M';
+        date->month = strtol(p + 1, &end, 10);
+        if (*end != '.') return NULL;
+        date->week = strtol(end + 1, &end, 10);
+        if (*end != '.') return NULL;
+        date->wday = strtol(end + 1, &end, 10);
+        if (date->month < 1 || date->month > 12 || date->week < 1 || date->week > 5 ||
+                date->wday < 0 || date->wday > 6) {
+            return NULL;
+        }
+    } else {
+        date->kind = *p == 'J' ? 'J' : 'D';
+        if (*p == 'J') {
+            p++;
+        }
+        if (!isdigit((unsigned char)*p)) {
+            return NULL;
+        }
+        date->yday = strtol(p, &end, 10);
+    }
+    p = end;
+    if (*p == '/') {
+        p = parse_time(p + 1, &date->time);
+    }
+    return p;
+}
+
+static int parse_rule(const char* s, struct tz_rule* rule) {
+    const char* p = s;
+    int32_t off;
+
+    memset(rule, 0, sizeof(*rule));
+    if ((p = parse_abbr(p, rule->std_abbr)) == NULL || (p = parse_time(p, &off)) == NULL) {
+        return -1;
+    }
+    rule->std_off = -off;
+    if (*p) {
+        if ((p = parse_abbr(p, rule->dst_abbr)) == NULL) {
+            return -1;
+        }
+        rule->has_dst = 1;
+        rule->dst_off = rule->std_off + 3600;
+        if (*p && *p != ',') {
+            if ((p = parse_time(p, &off)) == NULL) {
+                return -1;
+            }
+            rule->dst_off = -off;
+        }
+        if (*p == ',') {
+            if ((p = parse_date(p + 1, &rule->start)) == NULL || *p != ',' ||
+                    (p = parse_date(p + 1, &rule->end)) == NULL) {
+                return -1;
+            }
+        } else {
+            // no dates given: the US rules, as POSIX leaves it to us
+            parse_date("M3.2.0", &rule->start);
+            parse_date("M11.1.0", &rule->end);
+        }
+    }
+    rule->valid = (*p == '\0');
+    return rule->valid ? 0 : -1;
+}
+
+//// local seconds since the epoch at which date happens in year y
+static int64_t rule_local(int y, const struct tz_date* date) {
+    int64_t days;
+    int day;
+
+    if (date->kind == 'M') {
+        day = 1 + (date->wday - weekday(days_from_civil(y, date->month, 1)) + 7) % 7 +
+                (date->week - 1) * 7;
+        while (day > days_in_month(y, date->month)) {
+            day -= 7;
+        }
+        days = days_from_civil(y, date->month, day);
+    } else if (date->kind == 'J') {
+        days = days_from_civil(y, 1, 1) + date->yday - 1 +
+                (is_leap(y) && date->yday >= 60);
+    } else {
+        days = days_from_civil(y, 1, 1) + date->yday;
+    }
+    return days * SECS_PER_DAY + date->time;
+}
+
+static void set_state(struct tz_zone* z, int32_t utoff, const char* abbr) {
+    z->utoff = utoff;
+    snprintf(z->abbr, sizeof(z->abbr), "%s", abbr);
+}
+
+//// the rule's offset at t and the transitions around it
+static void rule_lookup(struct tz_zone* z, int64_t t) {
+    const struct tz_rule* r = &z->rule;
+    int64_t at[6], tmp;
+    int dst[6], d, i, j, n = 0, year, m, day;
+
+    set_state(z, r->std_off, r->std_abbr);
+    if (!r->has_dst) {
+        return;
+    }
+    civil_from_days(floor_div(t + r->std_off, SECS_PER_DAY), &year, &m, &day);
+    for (i = year - 1; i <= year + 1; i++) {
+        // start is given in standard time, end in daylight time
+        at[n] = rule_local(i, &r->start) - r->std_off;
+        dst[n++] = 1;
+        at[n] = rule_local(i, &r->end) - r->dst_off;
+        dst[n++] = 0;
+    }
+    for (i = 1; i < n; i++) {
+        for (j = i; j > 0 && at[j - 1] > at[j]; j--) {
+            tmp = at[j]; at[j] = at[j - 1]; at[j - 1] = tmp;
+            d = dst[j]; dst[j] = dst[j - 1]; dst[j - 1] = d;
+        }
+    }
+    for (i = 0; i < n && at[i] <= t; i++) {
+    }
+    if (i > 0) {
+        z->from = at[i - 1] > z->from ? at[i - 1] : z->from;
+        if (dst[i - 1]) {
+            set_state(z, r->dst_off, r->dst_abbr);
+        }
+    }
+    if (i < n) {
+        z->until = at[i];
+    }
+}
+
+static void type_state(struct tz_zone* z, int type) {
+    const struct tz_type* tt = &z->types[type];
+    set_state(z, tt->utoff, tt->abbr < z->nchars ? z->chars + tt->abbr : "");
+}
+
+//// refill the zone's cache for t
+static void lookup(struct tz_zone* z, int64_t t) {
+    int lo, hi, mid;
+
+    z->from = INT64_MIN;
+    z->until = INT64_MAX;
+    if (z->ntimes > 0 && (t < z->times[z->ntimes - 1] || !z->rule.valid)) {
+        if (t < z->times[0]) {
+            z->until = z->times[0];
+            type_state(z, 0);
+            return;
+        }
+        lo = 0;
+        hi = z->ntimes - 1;
+        while (lo < hi) {
+            mid = (lo + hi + 1) / 2;
+            if (z->times[mid] <= t) lo = mid; else hi = mid - 1;
+        }
+        z->from = z->times[lo];
+        if (lo + 1 < z->ntimes) {
+            z->until = z->times[lo + 1];
+        }
+        type_state(z, z->idx[lo]);
+    } else if (z->rule.valid) {
+        if (z->ntimes > 0) {
+            z->from = z->times[z->ntimes - 1];
+        }
+        rule_lookup(z, t);
+    } else if (z->ntypes > 0) {
+        type_state(z, 0);
+    } else {
+        set_state(z, 0, "UTC");
+    }
+}
+
+
+// ============================================================================
+// TZif (RFC 8536), the 64-bit block of version 2+ files when present
+
+
+static uint32_t be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int parse_tzif(struct tz_zone* z, const uint8_t* buf, size_t len) {
+    const uint8_t* p = buf;
+    const uint8_t* end = buf + len;
+    uint32_t isut, isstd, leap, ntimes, ntypes, nchars;
+    size_t tsize = 4, body;
+    char footer[64];
+    const uint8_t* nl;
+    int i;
+
+    for (;;) {
+        if (end - p < TZIF_HEADER || memcmp(p, "TZif", 4) != 0) {
+            return -1;
+        }
+        isut = be32(p + 20);
+        isstd = be32(p + 24);
+        leap = be32(p + 28);
+        ntimes = be32(p + 32);
+        ntypes = be32(p + 36);
+        nchars = be32(p + 40);
+        if (ntypes == 0 || ntypes > 256 || ntimes > 65536 || nchars > 256 || leap > 65536) {
+            return -1;
+        }
+        body = ntimes * tsize + ntimes + ntypes * 6 + nchars + leap * (tsize + 4) + isstd + isut;
+        if ((size_t)(end - p) < TZIF_HEADER + body) {
+            return -1;
+        }
+        if (tsize == 8 || p[4] < '2') {
+            break;
+        }
+        p += TZIF_HEADER + body;
+        tsize = 8;
+    }
+    p += TZIF_HEADER;
+
+    z->times = arena_alloc(ntimes * sizeof(int64_t) + 1);
+    z->idx = arena_alloc(ntimes + 1);
+    z->types = arena_alloc(ntypes * sizeof(struct tz_type));
+    z->chars = arena_alloc(nchars + 1);
+    if (!z->times || !z->idx || !z->types || !z->chars) {
+        return -1;
+    }
+    for (i = 0; i < (int)ntimes; i++, p += tsize) {
+        z->times[i] = tsize == 8 ? (int64_t)(((uint64_t)be32(p) << 32) | be32(p + 4))
+                                 : (int64_t)(int32_t)be32(p);
+    }
+    for (i = 0; i < (int)ntimes; i++) {
+        z->idx[i] = *p++;
+        if (z->idx[i] >= ntypes) {
+            return -1;
+        }
+    }
+    for (i = 0; i < (int)ntypes; i++, p += 6) {
+        z->types[i].utoff = (int32_t)be32(p);
+        z->types[i].isdst = p[4];
+        z->types[i].abbr = p[5];
+    }
+    memcpy(z->chars, p, nchars);
+    z->chars[nchars] = '\0';
+    p += nchars + leap * (tsize + 4) + isstd + isut;
+    z->ntimes = ntimes;
+    z->ntypes = ntypes;
+    z->nchars = nchars;
+
+    // "\nTZ string\n" after the 64-bit block
+    if (tsize == 8 && p < end && *p == '\n' &&
+            (nl = memchr(p + 1, '\n', end - p - 1)) != NULL && nl - p - 1 < (long)sizeof(footer)) {
+        memcpy(footer, p + 1, nl - p - 1);
+        footer[nl - p - 1] = '\0';
+        if (footer[0] && parse_rule(footer, &z->rule) != 0) {
+            log2file("tz %s: unsupported rule \"%s\"\n", z->name, footer);
+        }
+    }
+    return 0;
+}
+
+//// the tables stay in the arena, a zone's slot is never reused for another
+static void drop_zone(struct tz_zone* z) {
+    memset(z, 0, sizeof(*z));
+}
+
+static int load(struct tz_zone* z, const char* name) {
+    char path[sizeof(TZ_DIR) + TZ_NAME_MAX + 1];
+    struct stat st;
+    uint8_t* buf;
+    int fd, ret = -1;
+
+    // names come from clients, keep them inside TZ_DIR
+    if (name[0] == '/' || strstr(name, "..") != NULL) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/%s", TZ_DIR, name);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    // the file is parsed in place, only its tables are kept
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= TZIF_MAX_SIZE &&
+            (buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+        ret = parse_tzif(z, buf, st.st_size);
+        munmap(buf, st.st_size);
+    }
+    close(fd);
+    return ret;
+}
+
+
+// ============================================================================
+
+
+//// index of the zone called name, loaded on first use; -1 if the table is
+//// full (tz_localtime then gives UTC)
+int tz_find(const char* name) {
+    struct tz_zone* z;
+    int i;
+
+    for (i = 0; i < nzones; i++) {
+        if (strcmp(zones[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if (nzones == TZ_MAX_ZONES || strlen(name) >= TZ_NAME_MAX) {
+        return -1;
+    }
+
+    z = &zones[nzones];
+    memset(z, 0, sizeof(*z));
+    strcpy(z->name, name);
+    if (load(z, name) != 0) {
+        log2file("tz %s: can't load %s/%s, using UTC\n", name, TZ_DIR, name);
+        drop_zone(z);
+        strcpy(z->name, name);
+    }
+    z->until = INT64_MIN;   // nothing cached yet
+    return nzones++;
+}
+
+const char* tz_name(int zone) {
+    return zone >= 0 && zone < nzones ? zones[zone].name : "UTC";
+}
+
+//// broken down local time of t (seconds since the epoch) in zone
+int tz_localtime(int zone, int64_t t, struct tz_local* out) {
+    struct tz_zone* z;
+    int64_t local, days;
+
+    if (zone >= 0 && zone < nzones) {
+        z = &zones[zone];
+        if (t < z->from || t >= z->until) {
+            lookup(z, t);
+        }
+        out->utoff = z->utoff;
+        out->abbr = z->abbr;
+    } else {
+        out->utoff = 0;
+        out->abbr = "UTC";
+    }
+
+    local = t + out->utoff;
+    days = floor_div(local, SECS_PER_DAY);
+    local -= days * SECS_PER_DAY;
+    civil_from_days(days, &out->year, &out->month, &out->day);
+    out->hour = local / 3600;
+    out->min = local / 60 % 60;
+    out->sec = local % 60;
+    out->wday = weekday(days);
+    return 0;
+}
+
+//// the next transition after the last tz_localtime() in zone
+int64_t tz_next_change(int zone) {
+    return zone >= 0 && zone < nzones ? zones[zone].until : INT64_MAX;
+}
+
+void tz_close() {
+    int i;
+
+    for (i = 0; i < nzones; i++) {
+        drop_zone(&zones[i]);
+    }
+    nzones = 0;
+}
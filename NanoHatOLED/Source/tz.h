@@ -0,0 +1,42 @@
+#ifndef __TZ__H__
+#define __TZ__H__
+
+#include <stdint.h>
+
+/*
+ * Time zones from the system's TZif files, loaded once per zone and kept
+ * in memory. Each zone caches the UTC offset in effect and the instant of
+ * the next transition, so converting a timestamp is integer arithmetic
+ * until the next DST change; only then is the transition table (or the
+ * POSIX TZ rule at the end of the file, for times past the table) looked
+ * at again. A zone name is resolved once, after that a zone is an index.
+ *
+ * A name that can't be loaded becomes a UTC zone, so callers always get
+ * a clock. The tables are taken from the arena (arena.h) and kept.
+ */
+
+#define TZ_DIR          "/usr/share/zoneinfo"
+#define TZ_MAX_ZONES    16
+#define TZ_NAME_MAX     48
+#define TZ_ABBR_MAX     8
+
+struct tz_local {
+    int         year;
+    int         month;          /* 1-12 */
+    int         day;            /* 1-31 */
+    int         hour;
+    int         min;
+    int         sec;
+    int         wday;           /* 0 = Sunday */
+    int32_t     utoff;          /* seconds east of UTC */
+    const char* abbr;           /* e.g. "EAT", "EDT" */
+};
+
+extern int  tz_find(const char* name);
+extern const char* tz_name(int zone);
+extern int  tz_localtime(int zone, int64_t t, struct tz_local* out);
+extern int64_t tz_next_change(int zone);
+extern void tz_close();
+
+
+#endif
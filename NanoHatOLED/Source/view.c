@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "daemonize.h"
+#include "view.h"
+#include "stats.h"
+#include "loop.h"
+#include "logger.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open          434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal   424
+#endif
+
+// posix_spawn_file_actions_addchdir_np() arrived in glibc 2.29
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define HAVE_SPAWN_CHDIR        1
+#endif
+
+extern char** environ;
+
+
+// ============================================================================
+
+
+static pid_t view_pid = 0;
+static int view_fd = -1;
+static struct loop_source output_source = { -1, NULL, NULL };
+static char output[VIEW_OUTPUT_MAX];
+static int output_len = 0;
+static char interp[64] = PYTHON3_INTERP;
+static char script[128] = PYTHON3_SCRIPT;
+
+
+//// pass complete lines of the view's output to the log
+static void output_lines() {
+    char* start = output;
+    char* nl;
+
+    while ((nl = memchr(start, '\n', output + output_len - start)) != NULL) {
+        log_msg(LOGLVL_INFO, "view: %.*s\n", (int)(nl - start), start);
+        start = nl + 1;
+    }
+    output_len -= start - output;
+    memmove(output, start, output_len);
+    if (output_len == sizeof(output)) {
+        // an overlong line goes out in pieces
+        log_msg(LOGLVL_INFO, "view: %.*s\n", output_len, output);
+        output_len = 0;
+    }
+}
+
+static void output_close() {
+    if (output_len > 0) {
+        log_msg(LOGLVL_INFO, "view: %.*s\n", output_len, output);
+        output_len = 0;
+    }
+    if (output_source.fd >= 0) {
+        loop_del(&output_source);
+        close(output_source.fd);
+        output_source.fd = -1;
+    }
+}
+
+static void output_ready(struct loop_source* src, uint32_t events) {
+    ssize_t n;
+
+    for (;;) {
+        n = read(src->fd, output + output_len, sizeof(output) - output_len);
+        if (n > 0) {
+            output_len += n;
+            output_lines();
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (n == 0 || errno != EAGAIN) {
+                output_close();     // the view and everything it forked exited
+            }
+            return;
+        }
+    }
+}
+
+//// spawn the interpreter in dir with stdout and stderr on pipe_fd
+static pid_t spawn(const char* dir, int pipe_fd) {
+    char* const argv[] = { interp, script, NULL };
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    pid_t pid = -1;
+    int err;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fd, 1);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fd, 2);
+
+    // the daemon ignores SIGHUP (daemonize) and SIGPIPE (main), the view shouldn't
+    posix_spawnattr_init(&attr);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+#ifdef HAVE_SPAWN_CHDIR
+    posix_spawn_file_actions_addchdir_np(&actions, dir);
+    err = posix_spawnp(&pid, interp, &actions, &attr, argv, environ);
+#else
+    // nothing else in the daemon depends on the working directory
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (chdir(dir) != 0) {
+        err = errno;
+    } else {
+        err = posix_spawnp(&pid, interp, &actions, &attr, argv, environ);
+    }
+    if (cwd >= 0) {
+        if (fchdir(cwd) != 0) {
+            log2file("can't return to the working directory\n");
+        }
+        close(cwd);
+    }
+#endif
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        log2file("spawn of %s in %s failed: %s\n", interp, dir, strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+
+// ============================================================================
+
+
+//// interpreter and script for the next start, the running view keeps going
+void view_command(const char* python, const char* view) {
+    snprintf(interp, sizeof(interp), "%s", python);
+    snprintf(script, sizeof(script), "%s", view);
+}
+
+//// start the python view as our own child and keep a pidfd to it
+//// the pidfd becomes readable when the child exits (Linux 5.3+), older
+//// kernels fall back to kill() on the pid we know; the view's output is
+//// read through a pipe in the event loop and goes to the daemon's log
+pid_t view_start(const char* workpath) {
+    char dir[PATH_MAX];
+    int fds[2];
+    pid_t pid;
+
+    if (snprintf(dir, sizeof(dir), "%s/BakeBit/Software/Python", workpath)
+            >= (int)sizeof(dir)) {
+        log2file("view path too long\n");
+        return -1;
+    }
+
+    output_close();
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        log2file("pipe for the python view failed: %s\n", strerror(errno));
+        return -1;
+    }
+    setenv("PYTHONUNBUFFERED", "1", 1);
+    pid = spawn(dir, fds[1]);
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return -1;
+    }
+
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    output_source.fd = fds[0];
+    output_source.handler = output_ready;
+    output_source.ctx = NULL;
+    if (loop_add(&output_source, EPOLLIN) != 0) {
+        close(fds[0]);
+        output_source.fd = -1;
+    }
+
+    view_pid = pid;
+    view_fd = syscall(SYS_pidfd_open, pid, 0);
+    if (view_fd < 0) {
+        log2file("pidfd_open failed: %s, tracking pid %d only\n",
+                strerror(errno), pid);
+    }
+    log2file("python view started, pid %d\n", pid);
+    return pid;
+}
+
+//// whether the kernel has pidfd_open (Linux 5.3+)
+int view_pidfd_supported() {
+    static int supported = -1;
+    int fd;
+
+    if (supported < 0) {
+        fd = syscall(SYS_pidfd_open, getpid(), 0);
+        supported = (fd >= 0);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return supported;
+}
+
+//// pidfd of the running view, -1 if there is none or the kernel lacks pidfd
+int view_pidfd() {
+    return view_fd;
+}
+
+int view_running() {
+    return view_pid > 0;
+}
+
+//// send a signal to the view, never looks the process up again
+int view_signal(int sig) {
+    int ret;
+
+    if (view_pid <= 0) {
+        return -1;
+    }
+    if (view_fd >= 0) {
+        ret = syscall(SYS_pidfd_send_signal, view_fd, sig, NULL, 0);
+    } else {
+        ret = kill(view_pid, sig);
+    }
+    if (ret == 0) {
+        stats_add(STAT_SIGNALS, 1);
+    }
+    // an exited view is reaped when its exit is noticed (see supervise.c)
+    return ret;
+}
+
+//// collect the exited view, called when the pidfd polls readable
+//// returns the wait status or -1 if the view is still running
+int view_reap() {
+    int status;
+    pid_t ret;
+
+    if (view_pid <= 0) {
+        return -1;
+    }
+    ret = waitpid(view_pid, &status, WNOHANG);
+    if (ret == 0) {
+        return -1;
+    }
+    if (ret < 0) {
+        status = 0;
+    }
+
+    if (WIFEXITED(status)) {
+        log2file("python view %d exited with %d\n", view_pid, WEXITSTATUS(status));
+    } else if (WIFSIGNALED(status)) {
+        log2file("python view %d killed by signal %d\n", view_pid, WTERMSIG(status));
+    }
+    if (view_fd >= 0) {
+        close(view_fd);
+        view_fd = -1;
+    }
+    view_pid = 0;
+    return status;
+}
@@ -0,0 +1,17 @@
+#ifndef __VIEW__H__
+#define __VIEW__H__
+
+#include <sys/types.h>
+
+#define VIEW_OUTPUT_MAX 512     /* longest output line passed to the log */
+
+extern void  view_command(const char* python, const char* view);
+extern pid_t view_start(const char* workpath);
+extern int   view_pidfd();
+extern int   view_pidfd_supported();
+extern int   view_running();
+extern int   view_signal(int sig);
+extern int   view_reap();
+
+
+#endif
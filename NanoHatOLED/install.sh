@@ -47,6 +47,10 @@ echo "Installing Dependencies"
 echo "======================="
 #sudo apt-get install gcc python3 python3-dev -y
 sudo apt-get install gcc python3 -y
+# EMBED_PYTHON=1 ./install.sh builds the view host into the daemon (-e)
+if [ "${EMBED_PYTHON:-0}" = "1" ]; then
+    sudo apt-get install python3-dev -y
+fi
 echo "Dependencies installed"
 
 if [ ! -f /usr/bin/python3 ]; then
@@ -62,14 +66,45 @@ if [ $? -ne 0 ]; then
 fi
 REAL_PATH=$(realpath $(dirname $0))
 #sed -i '/^#define.*DEBUG.*$/s/1/0/' "${REAL_PATH}/Source/daemonize.h"
-sed -i "/^#define.*PYTHON3_INTERP.*$/s/\".*\"/\"${PY3_INTERP}\"/" "${REAL_PATH}/Source/daemonize.h"
+# settings live in the config file, the daemon reloads it when it changes
+if ! grep -qs '^python ' /etc/nanohat-oled.conf; then
+    echo "python ${PY3_INTERP}" >> /etc/nanohat-oled.conf
+fi
+# screens the daemon draws by itself, an edited copy is kept
+if [ ! -f /etc/nanohat-oled.layout ]; then
+    cp "${REAL_PATH}/nanohat-oled.layout" /etc/nanohat-oled.layout
+fi
 
 echo ""
 echo "Compiling with GCC ..."
 echo "======================="
-gcc Source/daemonize.c Source/main.c -lrt -lpthread -o NanoHatOLED
+EMBED_FLAGS=""
+if [ "${EMBED_PYTHON:-0}" = "1" ]; then
+    # --embed exists from python 3.8, before that --ldflags includes libpython
+    PY_LIBS=$(python3-config --embed --ldflags 2>/dev/null || python3-config --ldflags)
+    EMBED_FLAGS="-DWITH_EMBEDDED_PYTHON $(python3-config --includes) Source/pyembed.c ${PY_LIBS}"
+fi
+gcc Source/daemonize.c Source/main.c Source/gpio.c Source/gesture.c Source/evring.c Source/view.c Source/supervise.c Source/logger.c Source/loop.c Source/timer.c Source/fb.c Source/ssd1306.c Source/i2c.c Source/render.c Source/draw.c Source/font.c Source/metrics.c Source/devwait.c Source/notify.c Source/stats.c Source/sched.c Source/timesync.c Source/tz.c Source/devtab.c Source/config.c Source/history.c Source/power.c Source/arena.c Source/layout.c Source/rtsched.c -lrt -lpthread ${EMBED_FLAGS} -o NanoHatOLED
 echo "Compiled NanoHatOLED"
 
+# key-to-pixel benchmark against mock gpio and i2c, run ./NanoHatOLED-bench
+BENCH_SRCS="Source/bench.c Source/gpio.c Source/gesture.c Source/evring.c Source/loop.c Source/timer.c Source/fb.c Source/font.c Source/draw.c Source/render.c Source/ssd1306.c Source/i2c.c Source/logger.c Source/stats.c Source/tz.c Source/history.c Source/arena.c Source/layout.c Source/rtsched.c"
+if gcc -O2 ${BENCH_SRCS} -lrt -lpthread -o NanoHatOLED-bench; then
+    echo "Compiled NanoHatOLED-bench"
+fi
+
+# replay and fuzz harness for the input path, run ./NanoHatOLED-replay
+REPLAY_SRCS="Source/replay.c Source/gesture.c Source/evring.c Source/sched.c Source/timer.c Source/loop.c Source/logger.c Source/stats.c Source/config.c Source/devtab.c Source/arena.c Source/rtsched.c"
+if gcc -O2 ${REPLAY_SRCS} -lrt -lpthread -o NanoHatOLED-replay; then
+    echo "Compiled NanoHatOLED-replay"
+fi
+
+# optional python extension for views (nanohat._native), needs python3-dev
+if python3-config --includes >/dev/null 2>&1; then
+    gcc -shared -fPIC $(python3-config --includes) nanohat/_native.c \
+        -o nanohat/_native$(python3-config --extension-suffix) && echo "Compiled nanohat._native"
+fi
+
 if [ ! -f /usr/local/bin/oled-start ]; then
     cat >/usr/local/bin/oled-start <<EOL
 #!/bin/sh
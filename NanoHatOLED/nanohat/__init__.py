@@ -0,0 +1,3 @@
+"""
+Client side helpers for the NanoHatOLED daemon.
+"""
@@ -0,0 +1,363 @@
+/*
+ * nanohat._native: zero-copy access to the daemon's shared segments.
+ *
+ *   framebuffer()        writable memoryview of the back framebuffer, 8 pages
+ *                        of 128 column bytes (bit 0 at the top of a page)
+ *   commit(wait=False)   flush the framebuffer, wait=True returns once sent
+ *   metrics()            read-only memoryview of the raw metrics snapshot
+ *   snapshot()           consistent tuple of the metrics snapshot
+ *   events(timeout=None) key events as (key, kind, timestamp_ns, value),
+ *                        blocks with the GIL released
+ *   eventfd()            fd that polls readable when events are pending
+ *   heartbeat()          tell the daemon's watchdog the view is alive
+ *
+ * Built by install.sh when the python headers are there.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include "../Source/daemonize.h"
+#include "../Source/evring.h"
+#include "../Source/metrics.h"
+#include "../Source/render.h"
+#include "../Source/draw.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open      434
+#endif
+#ifndef SYS_pidfd_getfd
+#define SYS_pidfd_getfd     438
+#endif
+
+
+// ============================================================================
+
+
+static struct render_shm* fb_shm = NULL;
+static struct metrics_header* metrics_shm = NULL;
+static struct evring_header* ring = NULL;
+static uint32_t ring_tail = 0;
+static int ring_efd = -1;
+static int draw_fd = -1;
+
+//// map a segment named by $env (or name) and check its magic, *size is
+//// what a caller rejecting it unmaps
+static void* map_segment(const char* env, const char* name, uint32_t magic,
+                         int writable, size_t* size) {
+    const char* shm_name = getenv(env);
+    char path[128];
+    struct stat st;
+    void* p;
+    int fd;
+
+    snprintf(path, sizeof(path), "/dev/shm%s", shm_name ? shm_name : name);
+    fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < 64) {
+        close(fd);
+        PyErr_Format(PyExc_OSError, "%s is not a daemon segment", path);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0),
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return NULL;
+    }
+    if (__atomic_load_n((uint32_t*)p, __ATOMIC_ACQUIRE) != magic) {
+        munmap(p, st.st_size);
+        PyErr_Format(PyExc_OSError, "%s has an unknown layout", path);
+        return NULL;
+    }
+    *size = st.st_size;
+    return p;
+}
+
+static int open_fb() {
+    size_t size;
+
+    if (fb_shm == NULL) {
+        fb_shm = map_segment("NANOHAT_FB", RENDER_FB_NAME, RENDER_FB_MAGIC, 1, &size);
+    }
+    return fb_shm ? 0 : -1;
+}
+
+static int open_metrics() {
+    size_t size;
+
+    if (metrics_shm == NULL) {
+        metrics_shm = map_segment("NANOHAT_METRICS", METRICS_NAME, METRICS_MAGIC, 0, &size);
+        if (metrics_shm && metrics_shm->snapshot_size != sizeof(struct metrics)) {
+            PyErr_SetString(PyExc_OSError, "metrics snapshot size mismatch");
+            munmap((void*)metrics_shm, size);
+            metrics_shm = NULL;
+        }
+    }
+    return metrics_shm ? 0 : -1;
+}
+
+//// the eventfd is inherited by a spawned view, others borrow it (Linux 5.6+)
+static int borrow_eventfd() {
+    const char* env = getenv("NANOHAT_EVENTFD");
+    int pidfd, fd;
+
+    if (env != NULL) {
+        return atoi(env);
+    }
+    pidfd = syscall(SYS_pidfd_open, ring->producer_pid, 0);
+    if (pidfd < 0) {
+        return -1;
+    }
+    fd = syscall(SYS_pidfd_getfd, pidfd, ring->eventfd, 0);
+    close(pidfd);
+    return fd;
+}
+
+static int open_ring() {
+    size_t size;
+
+    if (ring != NULL) {
+        return 0;
+    }
+    ring = map_segment("NANOHAT_EVRING", EVRING_NAME, EVRING_MAGIC, 1, &size);
+    if (ring == NULL) {
+        return -1;
+    }
+    if (ring->entry_size != sizeof(struct evring_entry)) {
+        PyErr_SetString(PyExc_OSError, "event ring entry size mismatch");
+        munmap(ring, size);
+        ring = NULL;
+        return -1;
+    }
+    ring_efd = borrow_eventfd();
+    // start with what's new from now on, then announce ourselves
+    ring_tail = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ring->tail, ring_tail, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->consumer_pid, getpid(), __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+// ============================================================================
+
+
+static PyObject* native_framebuffer(PyObject* self, PyObject* args) {
+    if (open_fb() != 0) {
+        return NULL;
+    }
+    return PyMemoryView_FromMemory((char*)&fb_shm->fb, sizeof(fb_shm->fb), PyBUF_WRITE);
+}
+
+static PyObject* native_commit(PyObject* self, PyObject* args, PyObject* kw) {
+    static char* keywords[] = { "wait", NULL };
+    static const uint8_t op = DRAW_COMMIT;
+    const char* path = getenv("NANOHAT_DRAW_SOCKET");
+    struct sockaddr_un addr;
+    uint32_t frames = 0;
+    int wait = 0, sent, i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|p:commit", keywords, &wait)) {
+        return NULL;
+    }
+    if (open_fb() != 0) {
+        return NULL;
+    }
+    if (draw_fd < 0) {
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path ? path : DRAW_SOCKET);
+        draw_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (draw_fd < 0 || connect(draw_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, addr.sun_path);
+            if (draw_fd >= 0) {
+                close(draw_fd);
+                draw_fd = -1;
+            }
+            return NULL;
+        }
+    }
+
+    frames = __atomic_load_n(&fb_shm->frames, __ATOMIC_ACQUIRE);
+    Py_BEGIN_ALLOW_THREADS
+    sent = send(draw_fd, &op, 1, 0);
+    // the daemon flushes right away, a frame takes a few ms on the bus
+    for (i = 0; wait && sent == 1 && i < 1000 &&
+            __atomic_load_n(&fb_shm->frames, __ATOMIC_ACQUIRE) == frames; i++) {
+        usleep(1000);
+    }
+    Py_END_ALLOW_THREADS
+    if (sent != 1) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* native_metrics(PyObject* self, PyObject* args) {
+    if (open_metrics() != 0) {
+        return NULL;
+    }
+    return PyMemoryView_FromMemory((char*)&metrics_shm->snapshot,
+            sizeof(metrics_shm->snapshot), PyBUF_READ);
+}
+
+static PyObject* native_snapshot(PyObject* self, PyObject* args) {
+    struct metrics m;
+    uint32_t seq;
+
+    if (open_metrics() != 0) {
+        return NULL;
+    }
+    for (;;) {
+        seq = __atomic_load_n(&metrics_shm->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(&m, &metrics_shm->snapshot, sizeof(m));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&metrics_shm->seq, __ATOMIC_RELAXED) == seq) {
+            break;
+        }
+    }
+    if (m.temp_mdeg == METRICS_NO_TEMP) {
+        return Py_BuildValue("(KdOKKKKKKKOI)", (unsigned long long)m.timestamp_ns,
+                m.cpu_permille / 10.0, Py_None,
+                (unsigned long long)m.mem_total_kb, (unsigned long long)m.mem_available_kb,
+                (unsigned long long)m.disk_total_kb, (unsigned long long)m.disk_used_kb,
+                (unsigned long long)m.disk_avail_kb,
+                (unsigned long long)m.net_rx_bytes, (unsigned long long)m.net_tx_bytes,
+                m.clock_synced ? Py_True : Py_False, m.clock_maxerror_us);
+    }
+    return Py_BuildValue("(KddKKKKKKKOI)", (unsigned long long)m.timestamp_ns,
+            m.cpu_permille / 10.0, m.temp_mdeg / 1000.0,
+            (unsigned long long)m.mem_total_kb, (unsigned long long)m.mem_available_kb,
+            (unsigned long long)m.disk_total_kb, (unsigned long long)m.disk_used_kb,
+            (unsigned long long)m.disk_avail_kb,
+            (unsigned long long)m.net_rx_bytes, (unsigned long long)m.net_tx_bytes,
+            m.clock_synced ? Py_True : Py_False, m.clock_maxerror_us);
+}
+
+static PyObject* native_events(PyObject* self, PyObject* args, PyObject* kw) {
+    static char* keywords[] = { "timeout", NULL };
+    PyObject* timeout = Py_None;
+    PyObject* out;
+    struct pollfd pfd;
+    uint64_t count;
+    uint32_t head;
+    int ms = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|O:events", keywords, &timeout)) {
+        return NULL;
+    }
+    if (timeout != Py_None) {
+        double t = PyFloat_AsDouble(timeout);
+        if (t == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        ms = t < 0 ? 0 : (int)(t * 1000);
+    }
+    if (open_ring() != 0) {
+        return NULL;
+    }
+
+    // the eventfd is non-blocking, drain it so it only polls readable for
+    // events that arrive after this call
+    if (ring_efd >= 0 && read(ring_efd, &count, sizeof(count)) < 0) {
+        count = 0;
+    }
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == ring_tail && ms != 0) {
+        pfd.fd = ring_efd;
+        pfd.events = POLLIN;
+        Py_BEGIN_ALLOW_THREADS
+        if (ring_efd >= 0) {
+            if (poll(&pfd, 1, ms) > 0 && read(ring_efd, &count, sizeof(count)) < 0) {
+                count = 0;
+            }
+        } else {
+            // no wakeup fd, poll the ring
+            poll(NULL, 0, ms < 0 || ms > 20 ? 20 : ms);
+        }
+        Py_END_ALLOW_THREADS
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+
+    out = PyList_New(0);
+    while (out != NULL && ring_tail != head) {
+        const struct evring_entry* e = &ring->entries[ring_tail & (ring->size - 1)];
+        PyObject* ev = Py_BuildValue("(iiKI)", e->key, e->kind,
+                (unsigned long long)e->timestamp_ns, e->value);
+        if (ev == NULL || PyList_Append(out, ev) != 0) {
+            Py_XDECREF(ev);
+            Py_CLEAR(out);
+            break;
+        }
+        Py_DECREF(ev);
+        ring_tail++;
+    }
+    __atomic_store_n(&ring->tail, ring_tail, __ATOMIC_RELEASE);
+    return out;
+}
+
+static PyObject* native_eventfd(PyObject* self, PyObject* args) {
+    if (open_ring() != 0) {
+        return NULL;
+    }
+    return PyLong_FromLong(ring_efd);
+}
+
+static PyObject* native_heartbeat(PyObject* self, PyObject* args) {
+    uint32_t beat;
+
+    if (open_ring() != 0) {
+        return NULL;
+    }
+    beat = __atomic_load_n(&ring->heartbeat, __ATOMIC_RELAXED) + 1;
+    __atomic_store_n(&ring->heartbeat, beat ? beat : 1, __ATOMIC_RELEASE);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef native_methods[] = {
+    { "framebuffer", native_framebuffer, METH_NOARGS, "writable memoryview of the back framebuffer" },
+    { "commit", (PyCFunction)native_commit, METH_VARARGS | METH_KEYWORDS, "commit(wait=False)" },
+    { "metrics", native_metrics, METH_NOARGS, "read-only memoryview of the metrics snapshot" },
+    { "snapshot", native_snapshot, METH_NOARGS, "consistent copy of the metrics snapshot" },
+    { "events", (PyCFunction)native_events, METH_VARARGS | METH_KEYWORDS, "events(timeout=None)" },
+    { "eventfd", native_eventfd, METH_NOARGS, "fd readable while key events are pending" },
+    { "heartbeat", native_heartbeat, METH_NOARGS, "bump the watchdog heartbeat" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef native_module = {
+    PyModuleDef_HEAD_INIT, "_native", NULL, -1, native_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit__native() {
+    PyObject* m = PyModule_Create(&native_module);
+
+    if (m != NULL) {
+        PyModule_AddIntConstant(m, "WIDTH", FB_WIDTH);
+        PyModule_AddIntConstant(m, "HEIGHT", FB_HEIGHT);
+        PyModule_AddIntConstant(m, "KEY_DOWN", EVRING_KEY_DOWN);
+        PyModule_AddIntConstant(m, "KEY_UP", EVRING_KEY_UP);
+        PyModule_AddIntConstant(m, "KEY_LONG", EVRING_KEY_LONG);
+        PyModule_AddIntConstant(m, "KEY_REPEAT", EVRING_KEY_REPEAT);
+        PyModule_AddIntConstant(m, "KEY_DOUBLE", EVRING_KEY_DOUBLE);
+    }
+    return m;
+}
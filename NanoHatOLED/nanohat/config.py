@@ -0,0 +1,106 @@
+"""
+Reader for the daemon's config snapshot (see Source/config.h).
+
+    c = Config()
+    print(c.timezone, c.refresh_ms)
+    if c.changed():     # the config file was edited since the last call
+        ...
+    c.set('timezone', 'Asia/Tokyo')
+
+Reading a setting is a plain copy out of the mapping. changed() costs one
+load of the stale flag; only after a reload does it map the new snapshot.
+set() rewrites that line of the text file, and the daemon compiles it into
+a new snapshot, so every view and the daemon see the same values.
+"""
+
+import collections
+import mmap
+import os
+import struct
+
+CONFIG_SNAPSHOT = '/dev/shm/nanohat-oled-config'
+CONFIG_FILE = '/etc/nanohat-oled.conf'
+CONFIG_MAGIC = 0x4643484e
+CONFIG_VERSION = 6
+
+_HEADER = struct.Struct('<IIIII')
+_STALE_OFFSET = 16
+_SETTINGS_OFFSET = 64
+_SETTINGS = struct.Struct('<16I6I32s64s64s48s3I68s5I64s3I')
+_U32 = struct.Struct('<I')
+
+Settings = collections.namedtuple('Settings', [
+    'debounce_ms', 'long_ms', 'repeat_ms', 'double_ms',
+    'metrics_ms', 'refresh_ms', 'brightness',
+    'python', 'script', 'ntp_server', 'timezone',
+    'history_samples', 'history_ms', 'history_batch', 'history_path',
+    'display_timeout', 'dim_brightness', 'dim_start', 'dim_end', 'arena_kb',
+    'layout_path', 'cpu_mask', 'rt_priority', 'lock_memory',
+])
+
+
+def _text(raw):
+    return raw.split(b'\0', 1)[0].decode('ascii', 'replace')
+
+
+class Config:
+    def __init__(self, path=None, source=None):
+        self.path = path or os.environ.get('NANOHAT_CONFIG', CONFIG_SNAPSHOT)
+        self.source = source or os.environ.get('NANOHAT_CONFIG_FILE', CONFIG_FILE)
+        self._map = None
+        self._load()
+
+    def _load(self):
+        fd = os.open(self.path, os.O_RDONLY)
+        try:
+            m = mmap.mmap(fd, 0, prot=mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        magic, version, size, self.generation, _ = _HEADER.unpack_from(m, 0)
+        if magic != CONFIG_MAGIC or version != CONFIG_VERSION or size < 536:
+            m.close()
+            raise OSError('config snapshot %s has an unknown layout' % self.path)
+        raw = _SETTINGS.unpack_from(m, _SETTINGS_OFFSET)
+        self.settings = Settings(list(raw[:16]), *raw[16:22],
+                                 *(_text(s) for s in raw[22:26]),
+                                 *raw[26:29], _text(raw[29]), *raw[30:35],
+                                 _text(raw[35]), *raw[36:39])
+        if self._map is not None:
+            self._map.close()
+        self._map = m
+
+    def __getattr__(self, name):
+        if name in Settings._fields:
+            return getattr(self.settings, name)
+        raise AttributeError(name)
+
+    def changed(self):
+        """True once after the daemon published a new snapshot"""
+        if not _U32.unpack_from(self._map, _STALE_OFFSET)[0]:
+            return False
+        self._load()
+        return True
+
+    def set(self, name, value):
+        """Set one setting in the config file, the daemon picks it up"""
+        if name not in Settings._fields:
+            raise KeyError(name)
+        line = '%s %s\n' % (name, value)
+        try:
+            with open(self.source) as f:
+                lines = f.readlines()
+        except FileNotFoundError:
+            lines = []
+        for i, l in enumerate(lines):
+            if l.split('#', 1)[0].split()[:1] == [name]:
+                lines[i] = line
+                break
+        else:
+            lines.append(line)
+        tmp = self.source + '.new'
+        with open(tmp, 'w') as f:
+            f.writelines(lines)
+        os.replace(tmp, self.source)
+
+    def close(self):
+        self._map.close()
@@ -0,0 +1,158 @@
+"""
+Client for the daemon's native renderer (see Source/draw.h).
+
+Commands are collected locally and sent as one datagram per frame:
+
+    d = Display()
+    d.clear()
+    d.image(0, 0, pil_image)
+    d.text(0, 48, 'hello')
+    d.commit()
+
+Text is drawn by the daemon from its built-in 8 and 16 px fonts (printable
+ASCII, 6 and 12 px per character), so clients need no PIL for it.
+
+With more than one panel in the device table, Display(panel=1) draws on the
+second one.
+"""
+
+import os
+import socket
+import struct
+
+DRAW_SOCKET = '/var/run/nanohat-oled-draw.sock'
+
+WIDTH = 128
+HEIGHT = 64
+
+BLACK = 0
+WHITE = 1
+INVERT = 2
+
+CLEAR = 0x01
+PIXEL = 0x02
+HLINE = 0x03
+VLINE = 0x04
+RECT = 0x05
+FILL = 0x06
+PAGES = 0x07
+ROWS = 0x08
+TEXT = 0x09
+CLOCK = 0x0a
+PANEL = 0x0b
+SPARK = 0x0c
+LAYOUT = 0x0d
+COMMIT = 0x7f
+
+CLOCK_TIME = 0
+CLOCK_DATE = 1
+CLOCK_ZONE = 2
+
+# history series for spark()
+SPARK_CPU = 0
+SPARK_MEM = 1
+SPARK_TEMP = 2
+SPARK_DISK = 3
+
+_XY = struct.Struct('<Bhh')
+_XYW = struct.Struct('<Bhhh')
+_XYWH = struct.Struct('<Bhhhh')
+
+
+class Display:
+    def __init__(self, path=None, panel=0):
+        self.path = path or os.environ.get('NANOHAT_DRAW_SOCKET', DRAW_SOCKET)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.sock.connect(self.path)
+        self._prefix = bytes((PANEL, panel)) if panel else b''
+        self._buf = bytearray(self._prefix)
+        self._last = None
+
+    def clear(self, color=BLACK):
+        self._buf += bytes((CLEAR, color))
+
+    def pixel(self, x, y, color=WHITE):
+        self._buf += _XY.pack(PIXEL, x, y) + bytes((color,))
+
+    def hline(self, x, y, w, color=WHITE):
+        self._buf += _XYW.pack(HLINE, x, y, w) + bytes((color,))
+
+    def vline(self, x, y, h, color=WHITE):
+        self._buf += _XYW.pack(VLINE, x, y, h) + bytes((color,))
+
+    def rect(self, x, y, w, h, color=WHITE):
+        self._buf += _XYWH.pack(RECT, x, y, w, h) + bytes((color,))
+
+    def fill(self, x, y, w, h, color=WHITE):
+        self._buf += _XYWH.pack(FILL, x, y, w, h) + bytes((color,))
+
+    def pages(self, x, y, w, h, data):
+        """Blit data already in the panel's page layout"""
+        self._buf += _XYWH.pack(PAGES, x, y, w, h) + bytes(data)
+
+    def image(self, x, y, img):
+        """Blit a PIL image, converted to 1 bpp"""
+        img = img.convert('1')
+        w, h = img.size
+        self._buf += _XYWH.pack(ROWS, x, y, w, h) + img.tobytes()
+
+    def text(self, x, y, s, size=8, color=WHITE):
+        """Draw a line of text with its top left corner at x, y"""
+        data = s.encode('ascii', 'replace')[:31]
+        self._buf += _XY.pack(TEXT, x, y) + bytes((size, color, len(data))) + data
+
+    def clock(self, x, y, zone, kind=CLOCK_TIME, size=8, color=WHITE):
+        """Draw the time in zone ('Asia/Tokyo'); the daemon keeps redrawing
+        it every second on its own until the next clear()"""
+        data = zone.encode('ascii')[:47]
+        self._buf += (_XY.pack(CLOCK, x, y) + bytes((size, color, kind, len(data)))
+                      + data)
+
+    def spark(self, x, y, w, h, series, color=WHITE):
+        """Draw the newest w samples of a metrics history series (SPARK_*),
+        straight from the daemon's history ring"""
+        self._buf += _XYWH.pack(SPARK, x, y, w, h) + bytes((color, series))
+
+    def layout(self, name, zone=''):
+        """Put up a screen of the daemon's layout file; the daemon keeps its
+        widgets current by itself until the next clear(), and sending the
+        screen that is already up does nothing, so draw what the layout
+        doesn't cover after it in every frame"""
+        data = name.encode('ascii')[:15]
+        tz = zone.encode('ascii')[:47]
+        self._buf += bytes((LAYOUT, len(data))) + data + bytes((len(tz),)) + tz
+
+    def commit(self):
+        """Send the frame, the daemon only flushes the pages that changed;
+        a frame drawn exactly like the last one is not sent at all"""
+        self._buf.append(COMMIT)
+        try:
+            if self._buf != self._last:
+                self.sock.send(self._buf)
+                self._last = self._buf
+        finally:
+            self._buf = bytearray(self._prefix)
+
+    def close(self):
+        self.sock.close()
+
+
+class Canvas:
+    """The subset of PIL's ImageDraw used for text and boxes, on a Display"""
+
+    def __init__(self, display, size=8):
+        self.display = display
+        self.size = size
+
+    def text(self, xy, s, fill='white', font=None):
+        color = BLACK if fill in ('black', 0) else WHITE
+        self.display.text(xy[0], xy[1], s.replace('\u00b0', ''), self.size, color)
+
+    def rectangle(self, box, outline=None, fill=None):
+        x0, y0, x1, y1 = box
+        if fill is not None:
+            color = BLACK if fill in ('black', 0) else WHITE
+            self.display.fill(x0, y0, x1 - x0 + 1, y1 - y0 + 1, color)
+        if outline is not None:
+            color = BLACK if outline in ('black', 0) else WHITE
+            self.display.rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1, color)
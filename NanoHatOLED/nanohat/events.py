@@ -0,0 +1,142 @@
+"""
+Reader for the daemon's key event ring (see Source/evring.h).
+
+    ring = EventRing()
+    for key, kind, timestamp_ns, value in ring.events():
+        ...
+"""
+
+import ctypes
+import mmap
+import os
+import select
+import socket
+import struct
+
+EVRING_NAME = '/nanohat-oled-events'
+SYNC_SOCKET = '/var/run/nanohat-oled-sync.sock'
+EVRING_MAGIC = 0x5645484e
+EVRING_VERSION = 1
+
+KEY_DOWN = 1
+KEY_UP = 2
+KEY_LONG = 3
+KEY_REPEAT = 4
+KEY_DOUBLE = 5
+FRAME = 6
+
+# what a screen depends on (Source/sched.h), FRAME's value says which changed
+WANT_CLOCK = 0x01
+WANT_METRICS = 0x02
+WANT_KEYS = 0x04
+
+_HEADER = struct.Struct('<IIIIIiII')
+_HEAD_OFFSET = 64
+_TAIL_OFFSET = 128
+_ENTRY_OFFSET = 192
+_ENTRY = struct.Struct('<QIBBH')
+_U32 = struct.Struct('<I')
+
+_SYS_PIDFD_GETFD = 438
+
+
+def _borrow_eventfd(pid, fd):
+    """Duplicate the daemon's eventfd when it wasn't inherited (Linux 5.6+)"""
+    try:
+        pidfd = os.pidfd_open(pid)
+    except (AttributeError, OSError):
+        return -1
+    try:
+        libc = ctypes.CDLL(None, use_errno=True)
+        return libc.syscall(_SYS_PIDFD_GETFD, pidfd, fd, 0)
+    finally:
+        os.close(pidfd)
+
+
+class EventRing:
+    def __init__(self, name=None):
+        name = name or os.environ.get('NANOHAT_EVRING', EVRING_NAME)
+        fd = os.open('/dev/shm' + name, os.O_RDWR)
+        try:
+            self._map = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+
+        (magic, version, self.size, entry_size, self.producer_pid,
+         producer_efd, _, _) = _HEADER.unpack_from(self._map, 0)
+        if magic != EVRING_MAGIC or version != EVRING_VERSION:
+            raise OSError('event ring %s has an unknown layout' % name)
+        if entry_size != _ENTRY.size:
+            raise OSError('event ring %s has entry size %d' % (name, entry_size))
+
+        self.eventfd = int(os.environ.get('NANOHAT_EVENTFD', -1))
+        if self.eventfd < 0:
+            self.eventfd = _borrow_eventfd(self.producer_pid, producer_efd)
+
+        # start with whatever is new from now on and tell the daemon we listen
+        self._tail = _U32.unpack_from(self._map, _HEAD_OFFSET)[0]
+        _U32.pack_into(self._map, _TAIL_OFFSET, self._tail)
+        _U32.pack_into(self._map, 24, os.getpid())
+
+    def heartbeat(self):
+        """Tell the daemon the view is alive, call at least once per watchdog
+        deadline (10 s by default) once started, or the view gets restarted"""
+        beat = (_U32.unpack_from(self._map, 32)[0] + 1) & 0xffffffff
+        _U32.pack_into(self._map, 32, beat or 1)
+
+    def want(self, mask):
+        """Ask for a FRAME event whenever one of the WANT_* sources changes"""
+        _U32.pack_into(self._map, 36, mask)
+
+    def request_sync(self):
+        """Ask the daemon for a time sync, it runs in the background"""
+        with socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM) as sock:
+            try:
+                sock.sendto(b'sync', SYNC_SOCKET)
+            except OSError:
+                return False
+        return True
+
+    @property
+    def dropped(self):
+        return _U32.unpack_from(self._map, 28)[0]
+
+    def fileno(self):
+        return self.eventfd
+
+    def poll(self):
+        """Return all pending events as (key, kind, timestamp_ns, value)"""
+        head = _U32.unpack_from(self._map, _HEAD_OFFSET)[0]
+        out = []
+        while self._tail != head:
+            off = _ENTRY_OFFSET + (self._tail & (self.size - 1)) * _ENTRY.size
+            ts, value, key, kind, _ = _ENTRY.unpack_from(self._map, off)
+            out.append((key, kind, ts, value))
+            self._tail = (self._tail + 1) & 0xffffffff
+        _U32.pack_into(self._map, _TAIL_OFFSET, self._tail)
+        return out
+
+    def wait(self, timeout=None):
+        """Block until events arrive or timeout (seconds) passes"""
+        if self.eventfd >= 0:
+            r, _, _ = select.select([self.eventfd], [], [], timeout)
+            if r:
+                try:
+                    os.read(self.eventfd, 8)
+                except BlockingIOError:
+                    pass
+        else:
+            # no wakeup fd available, fall back to a short poll interval
+            select.select([], [], [], 0.02 if timeout is None else min(timeout, 0.02))
+        return self.poll()
+
+    def events(self):
+        """Generator over events, blocks between batches"""
+        while True:
+            for ev in self.wait():
+                yield ev
+
+    def close(self):
+        _U32.pack_into(self._map, 36, 0)
+        _U32.pack_into(self._map, 24, 0)
+        self._map.close()
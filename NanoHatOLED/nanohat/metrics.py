@@ -0,0 +1,68 @@
+"""
+Reader for the system metrics the daemon samples (see Source/metrics.h).
+
+    m = Metrics()
+    s = m.snapshot()
+    print(s.cpu_percent, s.temperature)
+
+A snapshot is a plain copy, reading it costs no syscalls.
+"""
+
+import collections
+import os
+import struct
+import time
+import mmap
+
+METRICS_NAME = '/nanohat-oled-metrics'
+METRICS_MAGIC = 0x544d484e
+METRICS_VERSION = 2
+METRICS_NO_TEMP = -2 ** 31
+
+_HEADER = struct.Struct('<IIIII')
+_SEQ_OFFSET = 12
+_SNAPSHOT_OFFSET = 64
+_SNAPSHOT = struct.Struct('<QIiQQQQQQQII')
+_U32 = struct.Struct('<I')
+
+Snapshot = collections.namedtuple('Snapshot', [
+    'timestamp_ns', 'cpu_percent', 'temperature',
+    'mem_total_kb', 'mem_available_kb',
+    'disk_total_kb', 'disk_used_kb', 'disk_avail_kb',
+    'net_rx_bytes', 'net_tx_bytes',
+    'clock_synced', 'clock_maxerror_us',
+])
+
+
+class Metrics:
+    def __init__(self, name=None):
+        name = name or os.environ.get('NANOHAT_METRICS', METRICS_NAME)
+        fd = os.open('/dev/shm' + name, os.O_RDONLY)
+        try:
+            self._map = mmap.mmap(fd, 0, prot=mmap.PROT_READ)
+        finally:
+            os.close(fd)
+
+        magic, version, size, _, self.period_ms = _HEADER.unpack_from(self._map, 0)
+        if magic != METRICS_MAGIC or version != METRICS_VERSION:
+            raise OSError('metrics segment %s has an unknown layout' % name)
+        if size != _SNAPSHOT.size:
+            raise OSError('metrics segment %s has snapshot size %d' % (name, size))
+
+    def snapshot(self):
+        """Copy the latest sample, retrying while the daemon updates it"""
+        while True:
+            seq = _U32.unpack_from(self._map, _SEQ_OFFSET)[0]
+            if seq & 1:
+                time.sleep(0)
+                continue
+            raw = _SNAPSHOT.unpack_from(self._map, _SNAPSHOT_OFFSET)
+            if _U32.unpack_from(self._map, _SEQ_OFFSET)[0] == seq:
+                break
+        ts, cpu, temp = raw[:3]
+        return Snapshot(ts, cpu / 10.0,
+                        None if temp == METRICS_NO_TEMP else temp / 1000.0,
+                        *raw[3:10], bool(raw[10]), raw[11])
+
+    def close(self):
+        self._map.close()
@@ -0,0 +1,47 @@
+"""
+Fast paths into the daemon through the nanohat._native extension:
+
+    from nanohat import native
+    fb = native.framebuffer()       # 1024 bytes, 8 pages of 128 columns
+    fb[0:128] = bytes(128)
+    native.commit()
+
+    for key, kind, timestamp_ns, value in native.events(timeout=1.0):
+        ...
+
+    events = await native.wait_events()     # asyncio
+
+The extension is built by install.sh; fall back to nanohat.display,
+nanohat.events and nanohat.metrics when it is missing.
+"""
+
+import asyncio
+
+from nanohat._native import (framebuffer, commit, metrics, snapshot, events,
+                             eventfd, heartbeat, WIDTH, HEIGHT, KEY_DOWN,
+                             KEY_UP, KEY_LONG, KEY_REPEAT, KEY_DOUBLE)
+from nanohat.metrics import Snapshot
+
+
+def metrics_snapshot():
+    """The latest metrics sample as a nanohat.metrics.Snapshot"""
+    return Snapshot(*snapshot())
+
+
+async def wait_events(loop=None):
+    """Wait for the next batch of key events without blocking the loop"""
+    pending = events(0)
+    if pending:
+        return pending
+    loop = loop or asyncio.get_event_loop()
+    fd = eventfd()
+    done = loop.create_future()
+    loop.add_reader(fd, lambda: done.done() or done.set_result(None))
+    try:
+        while not pending:
+            await done
+            pending = events(0)
+            done = loop.create_future()
+    finally:
+        loop.remove_reader(fd)
+    return pending
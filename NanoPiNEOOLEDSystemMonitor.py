@@ -11,12 +11,30 @@ import time
 import json
 import threading
 import subprocess
+import socket
+import fcntl
+import struct
 from datetime import datetime, timezone
 import pytz
 import signal
 import logging
 from pathlib import Path
 
+sys.path.insert(0, str(Path(__file__).resolve().parent / 'NanoHatOLED'))
+try:
+    from nanohat.events import (EventRing, KEY_DOWN, KEY_REPEAT, FRAME,
+                                WANT_CLOCK, WANT_METRICS, WANT_KEYS)
+    from nanohat.display import (Display, Canvas, CLOCK_TIME, CLOCK_DATE,
+                                 SPARK_CPU, SPARK_TEMP)
+    from nanohat.metrics import Metrics
+    from nanohat.config import Config
+except ImportError:
+    EventRing = None
+    Display = None
+    Canvas = None
+    Metrics = None
+    Config = None
+
 # Auto-install required packages
 def install_packages():
     """Install required packages if not available"""
@@ -67,8 +85,19 @@ class NanoPiOLEDMonitor:
         )
         self.logger = logging.getLogger(__name__)
         
-        # Configuration
+        # Configuration, the daemon's config file when it runs
+        self.settings = None
+        if Config is not None:
+            try:
+                self.settings = Config()
+            except OSError:
+                self.settings = None
         self.config = self.load_config()
+
+        # hosted by the daemon (-e), the view runs on the daemon's loop: no
+        # psutil fallbacks, no subprocesses, addresses refreshed by a timer
+        self.embedded = 'nanohat_host' in sys.modules
+        self.ip_addresses = self.read_ip_addresses() if self.embedded else []
         
         # Display modes
         self.display_modes = [
@@ -85,9 +114,21 @@ class NanoPiOLEDMonitor:
         
         # OLED setup
         self.setup_display()
+
+        # metrics sampled by the NanoHatOLED daemon, psutil otherwise
+        self.metrics = None
+        if Metrics is not None:
+            try:
+                self.metrics = Metrics()
+            except OSError:
+                self.metrics = None
         
         # Time zone
         self.timezone = pytz.timezone(self.config.get('timezone', 'UTC'))
+        self._date_day = None
+        self._date_str = ''
+        self._layouts = set()
+        self._layout_generation = None
         
         # Threading
         self.running = True
@@ -96,6 +137,7 @@ class NanoPiOLEDMonitor:
         # NTP sync
         self.last_ntp_sync = 0
         self.ntp_sync_interval = 3600  # 1 hour
+        self._ntp_thread = None
         
         self.logger.info("NanoPi OLED Monitor initialized")
 
@@ -103,10 +145,8 @@ class NanoPiOLEDMonitor:
         """Load configuration from file"""
         default_config = {
             'timezone': 'UTC',
-            'display_brightness': 255,
-            'auto_brightness': True,
+            'display_brightness': 255,  # dimming and sleep: the daemon's dim_* and display_timeout
             'ntp_servers': ['pool.ntp.org', 'time.google.com'],
-            'display_timeout': 0,  # 0 = never timeout
             'refresh_rate': 1.0
         }
         
@@ -117,9 +157,25 @@ class NanoPiOLEDMonitor:
                     default_config.update(config)
             except Exception as e:
                 self.logger.warning(f"Could not load config: {e}")
-        
+
+        if self.settings:
+            default_config['timezone'] = self.settings.timezone
+            default_config['display_brightness'] = self.settings.brightness
+            default_config['refresh_rate'] = self.settings.refresh_ms / 1000.0
+            default_config['ntp_servers'] = [self.settings.ntp_server] + [
+                s for s in default_config['ntp_servers'] if s != self.settings.ntp_server]
         return default_config
 
+    def reload_settings(self):
+        """Pick up an edit of the daemon's config file"""
+        if not self.settings or not self.settings.changed():
+            return
+        self.config = self.load_config()
+        self.timezone = pytz.timezone(self.config.get('timezone', 'UTC'))
+        if self.device:
+            self.device.contrast(self.config['display_brightness'])
+        self.logger.info(f"Config generation {self.settings.generation} loaded")
+
     def save_config(self):
         """Save configuration to file"""
         try:
@@ -130,6 +186,18 @@ class NanoPiOLEDMonitor:
 
     def setup_gpio(self):
         """Setup GPIO for buttons"""
+        self.event_ring = None
+        if self.embedded:
+            # hosted by the NanoHatOLED daemon, keys arrive as calls
+            return
+        if EventRing is not None:
+            try:
+                self.event_ring = EventRing()
+                self.logger.info("Using NanoHatOLED daemon key events")
+                return
+            except OSError:
+                self.event_ring = None
+
         try:
             GPIO.setmode(GPIO.BCM)
             GPIO.setwarnings(False)
@@ -148,6 +216,17 @@ class NanoPiOLEDMonitor:
 
     def setup_display(self):
         """Setup OLED display"""
+        # prefer the NanoHatOLED daemon's renderer, it only sends changed pages
+        self.native_display = None
+        if Display is not None:
+            try:
+                self.native_display = Display()
+                self.device = None
+                self.logger.info("Using NanoHatOLED daemon renderer")
+                return
+            except OSError:
+                self.native_display = None
+
         try:
             # Try different I2C addresses
             addresses = [0x3C, 0x3D]
@@ -187,6 +266,54 @@ class NanoPiOLEDMonitor:
         except Exception as e:
             self.logger.error(f"Button callback error: {e}")
 
+    def layout_screens(self):
+        """Screens of the daemon's layout file, the modes it draws by itself"""
+        if not self.settings or not self.native_display:
+            return set()
+        if self._layout_generation != self.settings.generation:
+            self._layout_generation = self.settings.generation
+            try:
+                with open(self.settings.layout_path) as f:
+                    self._layouts = {line.split()[1] for line in f
+                                     if line.startswith('screen ') and len(line.split()) > 1}
+            except OSError:
+                self._layouts = set()
+        return self._layouts
+
+    def screen_wants(self):
+        """What the active mode's screen depends on, for the daemon's scheduler"""
+        if self.display_modes[self.current_mode] in self.layout_screens():
+            # the daemon keeps a layout screen current on its own
+            return WANT_KEYS
+        if self.display_modes[self.current_mode] == 'datetime':
+            # the daemon's renderer ticks its clock fields by itself
+            return WANT_KEYS if self.native_display else WANT_CLOCK | WANT_KEYS
+        return WANT_METRICS | WANT_KEYS
+
+    def event_thread(self):
+        """Forward key presses from the daemon's event ring and redraw when
+        the daemon says the screen's content changed"""
+        # the daemon debounces, holding F1 or F2 keeps cycling
+        self.event_ring.want(self.screen_wants())
+        while self.running:
+            try:
+                redraw = False
+                for key, kind, timestamp_ns, value in self.event_ring.wait(1.0):
+                    if kind == FRAME:
+                        redraw = True
+                    elif key >= len(self.button_pins):
+                        continue
+                    elif kind == KEY_DOWN or (kind == KEY_REPEAT and key < 2):
+                        self.button_callback(self.button_pins[key])
+                self.event_ring.want(self.screen_wants())
+                if redraw:
+                    self.update_display()
+                # the daemon restarts a view whose heartbeat stops
+                self.event_ring.heartbeat()
+            except Exception as e:
+                self.logger.error(f"Event thread error: {e}")
+                time.sleep(1)
+
     def cycle_timezone(self):
         """Cycle through common timezones"""
         timezones = [
@@ -202,14 +329,36 @@ class NanoPiOLEDMonitor:
             
             self.config['timezone'] = timezones[next_index]
             self.timezone = pytz.timezone(timezones[next_index])
-            self.save_config()
+            if self.settings:
+                self.settings.set('timezone', timezones[next_index])
+            else:
+                self.save_config()
             
             self.logger.info(f"Timezone changed to: {timezones[next_index]}")
         except Exception as e:
             self.logger.error(f"Timezone change error: {e}")
 
     def sync_ntp(self):
-        """Synchronize time with NTP servers"""
+        """Start a time sync, never blocks the caller (key handling)"""
+        self.last_ntp_sync = time.time()
+        if self.embedded:
+            import nanohat_host
+            nanohat_host.sync_time()
+            return True
+        if self.event_ring:
+            # the daemon syncs on its own thread and redraws when the clock steps
+            self.event_ring.request_sync()
+            self.logger.info("Time sync requested from NanoHatOLED daemon")
+            return True
+        if self._ntp_thread and self._ntp_thread.is_alive():
+            return False
+        self._ntp_thread = threading.Thread(target=self.run_ntpdate)
+        self._ntp_thread.daemon = True
+        self._ntp_thread.start()
+        return True
+
+    def run_ntpdate(self):
+        """Synchronize time with NTP servers, without the daemon"""
         try:
             for server in self.config['ntp_servers']:
                 try:
@@ -232,6 +381,22 @@ class NanoPiOLEDMonitor:
 
     def get_system_info(self):
         """Get system information"""
+        if self.metrics:
+            m = self.metrics.snapshot()
+            mem_used = m.mem_total_kb - m.mem_available_kb
+            disk_size = m.disk_used_kb + m.disk_avail_kb
+            return {
+                'cpu': m.cpu_percent,
+                'memory_percent': mem_used * 100.0 / max(m.mem_total_kb, 1),
+                'memory_used': mem_used // 1024,  # MB
+                'memory_total': m.mem_total_kb // 1024,  # MB
+                'disk_percent': m.disk_used_kb * 100.0 / max(disk_size, 1),
+                'disk_used': m.disk_used_kb // (1024**2),  # GB
+                'disk_total': m.disk_total_kb // (1024**2)  # GB
+            }
+        if self.embedded:
+            return None
+
         try:
             cpu_percent = psutil.cpu_percent(interval=1)
             memory = psutil.virtual_memory()
@@ -250,15 +415,45 @@ class NanoPiOLEDMonitor:
             self.logger.error(f"System info error: {e}")
             return None
 
+    @staticmethod
+    def read_ip_addresses():
+        """IPv4 addresses of the interfaces other than loopback, by ioctl"""
+        SIOCGIFADDR = 0x8915
+        addresses = []
+        with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+            for _, name in socket.if_nameindex():
+                if name == 'lo':
+                    continue
+                try:
+                    ifreq = fcntl.ioctl(sock.fileno(), SIOCGIFADDR,
+                                        struct.pack('256s', name[:15].encode()))
+                except OSError:
+                    continue    # no address
+                addresses.append(socket.inet_ntoa(ifreq[20:24]))
+        return addresses
+
     def get_network_info(self):
         """Get network information"""
         try:
             # Get IP address
-            result = subprocess.run(['hostname', '-I'], 
-                                  capture_output=True, text=True, timeout=5)
-            ip_addresses = result.stdout.strip().split()
+            if self.embedded:
+                # refreshed by the daemon's timer, a frame only reads it
+                ip_addresses = self.ip_addresses
+            else:
+                result = subprocess.run(['hostname', '-I'], 
+                                      capture_output=True, text=True, timeout=5)
+                ip_addresses = result.stdout.strip().split()
             
             # Get network stats
+            if self.metrics:
+                m = self.metrics.snapshot()
+                return {
+                    'ip_addresses': ip_addresses,
+                    'bytes_sent': m.net_tx_bytes // (1024**2),  # MB
+                    'bytes_recv': m.net_rx_bytes // (1024**2),  # MB
+                }
+            if self.embedded:
+                return None
             net_io = psutil.net_io_counters()
             
             return {
@@ -272,6 +467,9 @@ class NanoPiOLEDMonitor:
 
     def get_temperature(self):
         """Get system temperature"""
+        if self.metrics:
+            return self.metrics.snapshot().temperature
+
         try:
             # Try multiple temperature sources
             temp_files = [
@@ -286,6 +484,8 @@ class NanoPiOLEDMonitor:
                         return temp
                 except:
                     continue
+            if self.embedded:
+                return None
             
             # Fallback to psutil if available
             temps = psutil.sensors_temperatures()
@@ -302,18 +502,27 @@ class NanoPiOLEDMonitor:
 
     def draw_datetime(self, draw, width, height):
         """Draw date and time display"""
+        tz_str = str(self.timezone).split('/')[-1]
+        if self.native_display:
+            # formatted by the daemon from its cached zone offsets, no pytz
+            zone = str(self.timezone)
+            self.native_display.clock(0, 0, zone, CLOCK_DATE)
+            self.native_display.clock(0, 20, zone, CLOCK_TIME)
+            draw.text((0, 40), f"TZ: {tz_str}", fill="white")
+            return
+
         try:
             now = datetime.now(self.timezone)
             
-            # Date
-            date_str = now.strftime("%a, %b %d %Y")
+            # Date, formatted once a day
+            if self._date_day != now.date():
+                self._date_day = now.date()
+                self._date_str = now.strftime("%a, %b %d %Y")
+            date_str = self._date_str
             
             # Time
             time_str = now.strftime("%H:%M:%S")
             
-            # Timezone
-            tz_str = str(self.timezone).split('/')[-1]
-            
             # Draw text
             draw.text((0, 0), date_str, fill="white")
             draw.text((0, 20), time_str, fill="white")
@@ -331,6 +540,9 @@ class NanoPiOLEDMonitor:
                 return
             
             draw.text((0, 0), f"CPU: {info['cpu']:.1f}%", fill="white")
+            if self.native_display:
+                # trend from the daemon's metrics history
+                self.native_display.spark(72, 0, 56, 10, SPARK_CPU)
             draw.text((0, 12), f"RAM: {info['memory_percent']:.1f}%", fill="white")
             draw.text((0, 24), f"     {info['memory_used']}MB/{info['memory_total']}MB", fill="white")
             draw.text((0, 36), f"Disk: {info['disk_percent']:.1f}%", fill="white")
@@ -379,6 +591,8 @@ class NanoPiOLEDMonitor:
                     status = "HOT!"
                 
                 draw.text((0, 40), f"Status: {status}", fill="white")
+                if self.native_display:
+                    self.native_display.spark(0, 54, 128, 10, SPARK_TEMP)
             else:
                 draw.text((0, 20), "Temperature sensor", fill="white")
                 draw.text((0, 32), "not available", fill="white")
@@ -386,39 +600,67 @@ class NanoPiOLEDMonitor:
         except Exception as e:
             draw.text((0, 0), f"Temp Error: {str(e)[:15]}", fill="white")
 
+    def draw_mode(self, draw):
+        """Draw the active mode"""
+        mode = self.display_modes[self.current_mode]
+
+        if mode == 'datetime':
+            self.draw_datetime(draw, 128, 64)
+        elif mode == 'system_info':
+            self.draw_system_info(draw, 128, 64)
+        elif mode == 'network_info':
+            self.draw_network_info(draw, 128, 64)
+        elif mode == 'temperature':
+            self.draw_temperature(draw, 128, 64)
+
     def update_display(self):
         """Update the OLED display"""
         try:
             with self.display_lock:
+                mode = self.display_modes[self.current_mode]
+                if mode in self.layout_screens():
+                    # widgets compiled from the layout file, only the zone
+                    # name is drawn here
+                    self.native_display.layout(mode, str(self.timezone))
+                    if mode == 'datetime':
+                        tz_str = str(self.timezone).split('/')[-1]
+                        self.native_display.text(0, 40, f"TZ: {tz_str}")
+                    self.native_display.commit()
+                    return
+                if self.native_display:
+                    self.native_display.clear()
+                    self.draw_mode(Canvas(self.native_display))
+                    self.native_display.commit()
+                    return
+
                 if not self.device:
                     return
                 
                 with canvas(self.device) as draw:
-                    mode = self.display_modes[self.current_mode]
-                    
-                    if mode == 'datetime':
-                        self.draw_datetime(draw, 128, 64)
-                    elif mode == 'system_info':
-                        self.draw_system_info(draw, 128, 64)
-                    elif mode == 'network_info':
-                        self.draw_network_info(draw, 128, 64)
-                    elif mode == 'temperature':
-                        self.draw_temperature(draw, 128, 64)
+                    self.draw_mode(draw)
                     
         except Exception as e:
             self.logger.error(f"Display update error: {e}")
 
     def auto_ntp_sync(self):
         """Automatically sync NTP if needed"""
-        if time.time() - self.last_ntp_sync > self.ntp_sync_interval:
-            self.sync_ntp()
+        if time.time() - self.last_ntp_sync <= self.ntp_sync_interval:
+            return
+        if self.metrics and self.metrics.snapshot().clock_synced:
+            # the kernel clock is already disciplined by the system's ntp
+            self.last_ntp_sync = time.time()
+            return
+        self.sync_ntp()
 
     def display_thread(self):
         """Main display update thread"""
         while self.running:
             try:
+                self.reload_settings()
                 self.auto_ntp_sync()
-                self.update_display()
+                if not self.event_ring:
+                    # with the daemon, frames are scheduled in event_thread
+                    self.update_display()
                 time.sleep(self.config['refresh_rate'])
             except Exception as e:
                 self.logger.error(f"Display thread error: {e}")
@@ -442,6 +684,11 @@ class NanoPiOLEDMonitor:
         display_thread = threading.Thread(target=self.display_thread)
         display_thread.daemon = True
         display_thread.start()
+
+        if self.event_ring:
+            event_thread = threading.Thread(target=self.event_thread)
+            event_thread.daemon = True
+            event_thread.start()
         
         self.logger.info("NanoPi OLED Monitor started")
         
@@ -466,12 +713,43 @@ class NanoPiOLEDMonitor:
             pass
         
         try:
+            if self.event_ring:
+                self.event_ring.close()
             GPIO.cleanup()
         except:
             pass
         
         self.logger.info("Cleanup completed")
 
+_embedded_monitor = None
+
+def embedded_main():
+    """Entry point when the NanoHatOLED daemon hosts this module (-e)"""
+    global _embedded_monitor
+    import nanohat_host
+
+    monitor = NanoPiOLEDMonitor()
+
+    def on_key(key, kind, timestamp_ns, value):
+        if kind == nanohat_host.FRAME:
+            monitor.update_display()
+            return
+        if key >= len(monitor.button_pins):
+            return
+        if kind == nanohat_host.KEY_DOWN or (kind == nanohat_host.KEY_REPEAT and key < 2):
+            monitor.button_callback(monitor.button_pins[key])
+            nanohat_host.want(monitor.screen_wants())
+
+    def tick(expirations):
+        monitor.ip_addresses = monitor.read_ip_addresses()
+        monitor.reload_settings()
+        monitor.auto_ntp_sync()
+
+    nanohat_host.on_key(on_key)
+    nanohat_host.want(monitor.screen_wants())
+    nanohat_host.every(int(monitor.config['refresh_rate'] * 1000), tick)
+    _embedded_monitor = monitor
+
 def create_systemd_service():
     """Create systemd service for auto-start"""
     service_content = f"""[Unit]